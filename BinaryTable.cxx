@@ -0,0 +1,232 @@
+/**
+ * @file n2n/BinaryTable.cxx
+ * Copyright (C) 2013 Houghton College
+ */
+
+#include "BinaryTable.hxx"
+#include "CSVFile.hxx"
+#include "Log.hxx"
+
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace n2n {
+
+/**
+ * The header of a sidecar. Its size is a multiple of 8, so the values
+ * which follow it are aligned.
+ */
+struct BinaryTableHeader
+{
+	char magic[8];		///< Identifies the file and format version
+	UInt_t schema;		///< Schema of the CSV file
+	Int_t csv_rows;		///< Number of rows of the CSV file
+	Int_t first_row;	///< First row of the CSV file stored
+	Int_t num_rows;		///< Number of rows stored
+	Int_t num_columns;	///< Number of columns stored
+	Int_t unused;		///< Keeps the size a multiple of 8
+	Long64_t csv_size;	///< Size of the CSV file when it was written
+	Long64_t csv_mtime;	///< Modification time of the CSV file then
+};
+
+char const BINARY_TABLE_MAGIC[8] = { 'N', '2', 'N', 'T', 'A', 'B', 'L', 2 };
+
+/**
+ * Check whether a sidecar can be trusted, from its header.
+ * @param header The header of the sidecar.
+ * @param schema The expected schema.
+ * @param size The size of the sidecar.
+ * @param csv_size The size of the CSV file now.
+ * @param csv_mtime The modification time of the CSV file now.
+ */
+bool TrustedHeader( BinaryTableHeader const & header, UInt_t schema,
+		Long64_t size, Long64_t csv_size, Long64_t csv_mtime )
+{
+	if ( memcmp( header.magic, BINARY_TABLE_MAGIC, sizeof( header.magic ) ) != 0 ||
+			header.schema != schema ||
+			header.csv_size != csv_size ||
+			header.csv_mtime != csv_mtime ||
+			header.csv_rows < 0 || header.first_row < 0 ||
+			header.num_rows < 0 || header.num_columns < 0 )
+		return false;
+
+	// Each value is a double and a one byte kind
+	Long64_t num_values = (Long64_t) header.num_rows * header.num_columns;
+	return size == (Long64_t) sizeof( header ) + num_values * (Long64_t) (sizeof( double ) + 1);
+}
+
+BinaryTable::BinaryTable()
+	: csv_rows_( 0 ), first_row_( 0 ), num_rows_( 0 ), num_columns_( 0 ),
+	  values_( NULL ), kinds_( NULL )
+{
+}
+
+TString BinaryTable::FileName( char const * csv_filename )
+{
+	TString filename = csv_filename;
+	if ( filename.EndsWith( ".csv" ) )
+		filename.Remove( filename.Length() - 4 );
+	filename += ".n2nb";
+	return filename;
+}
+
+void BinaryTable::Write( char const * csv_filename, CSVFile const & file,
+		UInt_t schema, int first_row, int num_columns )
+{
+	BinaryTableHeader header;
+	memset( &header, 0, sizeof( header ) );
+	if ( !FileState( csv_filename, &header.csv_size, &header.csv_mtime ) )
+		return;
+	memcpy( header.magic, BINARY_TABLE_MAGIC, sizeof( header.magic ) );
+	header.schema = schema;
+	header.csv_rows = file.NumRows();
+	header.first_row = first_row;
+	header.num_rows = file.NumRows() > first_row ? file.NumRows() - first_row : 0;
+	header.num_columns = num_columns;
+
+	size_t num_values = (size_t) header.num_rows * num_columns;
+	vector<double> values( num_values, 0.0 );
+	vector<unsigned char> kinds( num_values, FIELD_EMPTY );
+	vector<CSVField> fields;
+	int widest = 0;
+	for ( int i = 0; i < header.num_rows; ++i )
+	{
+		file.GetFields( first_row + i, &fields );
+		int n = fields.size() < num_columns ? fields.size() : num_columns;
+		for ( int col = 0; col < n; ++col )
+		{
+			size_t index = (size_t) col * header.num_rows + i;
+			values[index] = fields[col].ToDouble();
+			kinds[index] = fields[col].Kind();
+		}
+		if ( fields.size() > widest )
+			widest = fields.size();
+	}
+
+	// Columns added to or removed from the spreadsheet but not the field 
+	// enum, or vice versa, shift every later column
+	if ( header.num_rows > 0 && widest != num_columns )
+		LogMessage( LOG_WARNING, TString::Format( 
+			"%s: rows have %d columns, but %d are expected; "
+			"check the column layout", csv_filename, widest, num_columns ) );
+
+	TString filename = FileName( csv_filename );
+	TString filename_tmp = TemporaryFileName( filename );
+	ofstream os( filename_tmp, ios::out | ios::binary | ios::trunc );
+	os.write( (char const *) &header, sizeof( header ) );
+	if ( num_values > 0 )
+	{
+		os.write( (char const *) &values[0], num_values * sizeof( double ) );
+		os.write( (char const *) &kinds[0], num_values );
+	}
+	os.close();
+	if ( !os || !RenameReplacing( filename_tmp, filename ) )
+	{
+		// The CSV file is still correct, so only the speed up is lost
+		gSystem->Unlink( filename_tmp );
+		LogMessage( LOG_WARNING, TString::Format( "Unable to write %s",
+					filename.Data() ) );
+	}
+}
+
+bool BinaryTable::Open( char const * csv_filename, UInt_t schema )
+{
+	Close();
+
+	TString filename = FileName( csv_filename );
+	Long64_t size, mtime, csv_size, csv_mtime;
+	if ( !FileState( filename, &size, &mtime ) ||
+			!FileState( csv_filename, &csv_size, &csv_mtime ) ||
+			mtime < csv_mtime ||
+			size < (Long64_t) sizeof( BinaryTableHeader ) )
+		return false;
+
+#ifndef _WIN32
+	int fd = open( filename, O_RDONLY );
+	if ( fd < 0 )
+		return false;
+	void * map = mmap( NULL, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close( fd );
+	if ( map == MAP_FAILED )
+		return false;
+	shared_ptr<char const> data( (char const *) map,
+			[size]( char const * p ) { munmap( (void *) p, size ); } );
+	BinaryTableHeader const * header = (BinaryTableHeader const *) data.get();
+	if ( !TrustedHeader( *header, schema, size, csv_size, csv_mtime ) )
+		return false;
+#else
+	// Without a map, only a sidecar which will be trusted is read whole
+	BinaryTableHeader header_read;
+	ifstream is( filename, ios::in | ios::binary );
+	is.read( (char *) &header_read, sizeof( header_read ) );
+	if ( !is || !TrustedHeader( header_read, schema, size, csv_size, csv_mtime ) )
+		return false;
+	shared_ptr<char const> data( new char[size],
+			[]( char const * p ) { delete [] p; } );
+	memcpy( (char *) data.get(), &header_read, sizeof( header_read ) );
+	is.read( (char *) data.get() + sizeof( header_read ), 
+			size - sizeof( header_read ) );
+	if ( !is )
+		return false;
+	BinaryTableHeader const * header = (BinaryTableHeader const *) data.get();
+#endif
+
+	size_t num_values = (size_t) header->num_rows * header->num_columns;
+	data_ = data;
+	csv_rows_ = header->csv_rows;
+	first_row_ = header->first_row;
+	num_rows_ = header->num_rows;
+	num_columns_ = header->num_columns;
+	values_ = (double const *) (data_.get() + sizeof( *header ));
+	kinds_ = (unsigned char const *) (values_ + num_values);
+	return true;
+}
+
+void BinaryTable::Close()
+{
+	data_.reset();
+	csv_rows_ = first_row_ = num_rows_ = num_columns_ = 0;
+	values_ = NULL;
+	kinds_ = NULL;
+}
+
+bool BinaryTable::HasRow( int row_number ) const
+{
+	return data_ && row_number >= first_row_ && row_number < first_row_ + num_rows_;
+}
+
+bool BinaryTable::IsOpen() const
+{
+	return (bool) data_;
+}
+
+int BinaryTable::NumCSVRows() const
+{
+	return csv_rows_;
+}
+
+int BinaryTable::NumColumns() const
+{
+	return num_columns_;
+}
+
+double BinaryTable::Value( int row_number, int col ) const
+{
+	if ( col >= num_columns_ )
+		return 0;
+	return values_[(size_t) col * num_rows_ + row_number - first_row_];
+}
+
+FieldKind BinaryTable::Kind( int row_number, int col ) const
+{
+	if ( col >= num_columns_ )
+		return FIELD_EMPTY;
+	return (FieldKind) kinds_[(size_t) col * num_rows_ + row_number - first_row_];
+}
+
+} // namespace n2n
@@ -0,0 +1,126 @@
+/**
+ * @file n2n/BinaryTable.hxx
+ * Copyright (C) 2013 Houghton College
+ */
+
+#ifndef N2N_BINARYTABLE_INCL_
+#define N2N_BINARYTABLE_INCL_
+
+#include <memory>
+
+namespace n2n {
+
+struct CSVFile;
+
+/**
+ * What a field of a CSV file holds, as far as its numeric value goes.
+ */
+enum FieldKind
+{
+	FIELD_EMPTY,		///< Nothing; its value is 0
+	FIELD_NUMBER,		///< A number and nothing else
+	FIELD_TEXT		///< Anything else; its value is as atof() reads it
+};
+
+/**
+ * A binary sidecar holding the numeric value of every field of a CSV file,
+ * so that later loads need not read and convert the text again.
+ *
+ * The sidecar is written next to the CSV file, with a .n2nb extension.
+ * It holds a header, then one column of doubles per field, each value
+ * exactly as CSVField::ToDouble() converts it, then the FieldKind of each
+ * value, column by column. The file is memory mapped where possible, and
+ * only trusted while the CSV file has the size and modification time 
+ * recorded in the header (see FileState), is no newer than the sidecar,
+ * and has the same schema; the CSV file remains the one to edit.
+ */
+struct BinaryTable
+{
+	public:
+		/**
+		 * Create a table with no sidecar open.
+		 */
+		BinaryTable();
+
+		/**
+		 * Get the name of the sidecar of a CSV file.
+		 * @param csv_filename The path to the CSV file.
+		 */
+		static TString FileName( char const * csv_filename );
+
+		/**
+		 * Write the sidecar of a CSV file which was just saved.
+		 * @param csv_filename The path to the CSV file.
+		 * @param file The contents of the CSV file.
+		 * @param schema The schema of the file; see CSVFile::SetSchema.
+		 * @param first_row The first row containing data.
+		 * @param num_columns The number of columns to store.
+		 */
+		static void Write( char const * csv_filename, CSVFile const & file,
+				UInt_t schema, int first_row, int num_columns );
+
+		/**
+		 * Open the sidecar of a CSV file, if it can be trusted.
+		 * @param csv_filename The path to the CSV file.
+		 * @param schema The expected schema.
+		 * @return False if there is no sidecar which can be trusted.
+		 */
+		bool Open( char const * csv_filename, UInt_t schema );
+
+		/**
+		 * Close the sidecar.
+		 */
+		void Close();
+
+		/**
+		 * Check whether a row of the CSV file is in the sidecar.
+		 * @param row_number The row of the CSV file.
+		 */
+		bool HasRow( int row_number ) const;
+
+		/**
+		 * Check whether a sidecar is open.
+		 */
+		bool IsOpen() const;
+
+		/**
+		 * Get the number of rows of the CSV file, header rows included,
+		 * or 0 if no sidecar is open.
+		 */
+		int NumCSVRows() const;
+
+		/**
+		 * Get the number of columns stored.
+		 */
+		int NumColumns() const;
+
+		/**
+		 * Get the value of a field, or 0 if the column is not stored.
+		 * @param row_number The row of the CSV file, which must be in the
+		 * sidecar.
+		 * @param col The column of the field.
+		 */
+		double Value( int row_number, int col ) const;
+
+		/**
+		 * Get the kind of a field, or FIELD_EMPTY if the column is not
+		 * stored.
+		 * @param row_number The row of the CSV file, which must be in the
+		 * sidecar.
+		 * @param col The column of the field.
+		 */
+		FieldKind Kind( int row_number, int col ) const;
+
+	private:
+		shared_ptr<char const> data_;	///< Contents of the sidecar
+		int csv_rows_;			///< Number of rows of the CSV file
+		int first_row_;			///< First row of the CSV file stored
+		int num_rows_;			///< Number of rows stored
+		int num_columns_;		///< Number of columns stored
+		double const * values_;		///< Values, column by column
+		unsigned char const * kinds_;	///< Kinds of the values, likewise
+};
+
+} // namespace n2n
+
+#endif
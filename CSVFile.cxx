@@ -4,95 +4,583 @@
  */
 
 #include "CSVFile.hxx"
+#include "Log.hxx"
+#include "Profile.hxx"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows4Root.h>
+#undef ReplaceFile		// Would rename CSVFile::ReplaceFile
+#else
+#include <sys/stat.h>
+#endif
 
 namespace n2n {
 
+string CSVField::ToString() const
+{
+	if ( !escaped )
+		return string( begin, end );
+
+	string elem;
+	elem.reserve( Length() );
+
+	bool quoted = false;
+	for ( char const * c = begin; c != end; ++c )
+	{
+		if ( !quoted )
+		{
+			if ( *c == '"' )
+				quoted = true;
+			else
+				elem += *c;
+		}
+		else
+		{
+			if ( *c == '"' && c + 1 != end && c[1] == '"' )
+				elem += '"', ++c;
+			else if ( *c == '"' )
+				quoted = false;
+			else
+				elem += *c;
+		}
+	}
+
+	return elem;
+}
+
+double CSVField::ToDouble() const
+{
+	char buf[64];
+	if ( escaped || Length() >= (int) sizeof( buf ) )
+		return atof( ToString().c_str() );
+
+	memcpy( buf, begin, Length() );
+	buf[Length()] = '\0';
+	return atof( buf );
+}
+
+int CSVField::ToInt() const
+{
+	char buf[64];
+	if ( escaped || Length() >= (int) sizeof( buf ) )
+		return atoi( ToString().c_str() );
+
+	memcpy( buf, begin, Length() );
+	buf[Length()] = '\0';
+	return atoi( buf );
+}
+
+FieldKind CSVField::Kind() const
+{
+	char buf[64];
+	string text;
+	char const * str = buf;
+	if ( escaped || Length() >= (int) sizeof( buf ) )
+	{
+		text = ToString();
+		str = text.c_str();
+	}
+	else
+	{
+		memcpy( buf, begin, Length() );
+		buf[Length()] = '\0';
+	}
+
+	if ( *str == '\0' )
+		return FIELD_EMPTY;
+	char * end;
+	strtod( str, &end );
+	return *end == '\0' ? FIELD_NUMBER : FIELD_TEXT;
+}
+
+
+/**
+ * Get the file a name refers to, following symbolic links.
+ */
+TString ResolvedFileName( char const * filename )
+{
+#ifndef _WIN32
+	char * resolved = realpath( filename, NULL );
+	if ( resolved )
+	{
+		TString target = resolved;
+		free( resolved );
+		return target;
+	}
+#endif
+	return filename;
+}
+
+CSVFile::CSVFile()
+	: num_edited_( 0 ), file_size_( -1 ), file_mtime_( 0 ), text_loaded_( true ),
+	  schema_first_row_( 0 ), schema_num_columns_( 0 ), write_binary_( false )
+{
+#ifdef _WIN32
+	newline_ = "\r\n";
+#else
+	newline_ = "\n";
+#endif
+}
+
+CSVFile::~CSVFile()
+{
+}
+
 void CSVFile::Load( char const * filename )
 {
-	data_.clear();
+	ProfileTimer timer( "csv_load" );
+	StatFile( filename );
+	if ( !OpenBinary( filename ) )
+	{
+		ReadText();
+		return;
+	}
+
+	// The sidecar holds the numbers; the text waits until it is needed
+	text_loaded_ = false;
+	buffer_.clear();
+	IndexLines();
+}
+
+void CSVFile::ReadText()
+{
+	ProfileTimer timer( "csv_read" );
+	buffer_.clear();
 
-	ifstream is( filename );
-	string line;
-	while ( getline( is, line ) )
+	ifstream is( filename_.c_str(), ios::in | ios::binary );
+	is.seekg( 0, ios::end );
+	streamoff size = is.tellg();
+	if ( size > 0 )
 	{
-		data_.push_back( line );
+		buffer_.resize( size );
+		is.seekg( 0, ios::beg );
+		is.read( &buffer_[0], size );
+		buffer_.resize( is.gcount() );
 	}
+
+	IndexLines();
+
+	// Keep the line ending of the file
+	string::size_type newline = buffer_.find( '\n' );
+	if ( newline != string::npos )
+		newline_ = newline > 0 && buffer_[newline - 1] == '\r' ? "\r\n" : "\n";
+
+	if ( !FileUnchanged( filename_.c_str() ) )
+	{
+		if ( binary_.IsOpen() )
+			LogMessage( LOG_WARNING, TString::Format( 
+				"%s changed after it was loaded; reading its values "
+				"from the new text", filename_.c_str() ) );
+		binary_.Close();
+		StatFile( filename_.c_str() );
+	}
+	text_loaded_ = true;
+}
+
+void CSVFile::RequireText() const
+{
+	if ( text_loaded_ )
+		return;
+	lock_guard<mutex> lock( text_lock_ );
+	if ( !text_loaded_ )
+		const_cast<CSVFile *>( this )->ReadText();
 }
 
-void CSVFile::Save( char const * filename ) const
+void CSVFile::IndexLines()
 {
-	ofstream os( filename );
-	for ( vector<string>::iterator i = data_.begin();
-			i != data_.end(); ++i )
+	lines_.clear();
+	string::size_type begin = 0;
+	while ( begin < buffer_.size() )
 	{
-		os << *i << endl;
+		string::size_type end = buffer_.find( '\n', begin );
+		if ( end == string::npos )
+			end = buffer_.size();
+
+		Line line;
+		line.begin = begin;
+		line.length = end - begin;
+		if ( line.length > 0 && buffer_[end - 1] == '\r' )
+			--line.length;
+		lines_.push_back( line );
+
+		begin = end + 1;
 	}
+
+	edits_.assign( lines_.size(), string() );
+	edited_.assign( lines_.size(), false );
+	num_edited_ = 0;
+}
+
+void CSVFile::StatFile( char const * filename )
+{
+	filename_ = filename;
+	if ( !FileState( filename, &file_size_, &file_mtime_ ) )
+		file_size_ = -1;
+}
+
+bool CSVFile::FileUnchanged( char const * filename ) const
+{
+	Long64_t size, mtime;
+	return filename_ == filename && file_size_ >= 0 &&
+		FileState( filename, &size, &mtime ) &&
+		size == file_size_ && mtime == file_mtime_;
+}
+
+void CSVFile::Save( char const * filename, bool patch )
+{
+	ProfileTimer timer( "csv_save" );
+	ProfileCount( "csv_save", "rows_changed", num_edited_ );
+	bool unchanged = FileUnchanged( filename );
+	if ( unchanged && num_edited_ == 0 )
+		return;
+	RequireText();
+	if ( !(patch && unchanged && PatchFile( filename )) )
+		ReplaceFile( filename );
+	WriteBinary( filename );
+}
+
+void CSVFile::SetSchema( char const * name, int first_row, int num_columns )
+{
+	schema_name_ = name;
+	schema_first_row_ = first_row;
+	schema_num_columns_ = num_columns;
+	write_binary_ = true;
+}
+
+void CSVFile::SetWriteBinary( bool write )
+{
+	write_binary_ = write;
+}
+
+BinaryTable const * CSVFile::Binary() const
+{
+	return &binary_;
+}
+
+UInt_t CSVFile::Schema() const
+{
+	// 32-bit FNV-1a
+	UInt_t hash = 2166136261u;
+	TString layout = TString::Format( "%s %d %d", schema_name_.c_str(), 
+			schema_first_row_, schema_num_columns_ );
+	for ( int i = 0; i < layout.Length(); ++i )
+		hash = (hash ^ (unsigned char) layout[i]) * 16777619u;
+	return hash;
+}
+
+bool CSVFile::OpenBinary( char const * filename )
+{
+	binary_.Close();
+	return !schema_name_.empty() && binary_.Open( filename, Schema() );
+}
+
+void CSVFile::WriteBinary( char const * filename )
+{
+	binary_.Close();
+	if ( schema_name_.empty() || !write_binary_ )
+		return;
+
+	UInt_t schema = Schema();
+	BinaryTable::Write( filename, *this, schema, schema_first_row_, 
+			schema_num_columns_ );
+	binary_.Open( filename, schema );
+}
+
+bool CSVFile::PatchFile( char const * filename )
+{
+	// Rows which were on disk must keep their lengths
+	int num_file_rows = 0;
+	for ( int i = 0; i < NumRows(); ++i )
+		if ( lines_[i].begin != string::npos )
+			num_file_rows = i + 1;
+	for ( int i = 0; i < num_file_rows; ++i )
+		if ( edited_[i] && (lines_[i].begin == string::npos ||
+				edits_[i].size() != lines_[i].length) )
+			return false;
+
+	fstream fs( filename, ios::in | ios::out | ios::binary );
+	for ( int i = 0; i < num_file_rows && fs; ++i )
+	{
+		if ( !edited_[i] )
+			continue;
+		fs.seekp( lines_[i].begin );
+		fs.write( edits_[i].data(), edits_[i].size() );
+		buffer_.replace( lines_[i].begin, lines_[i].length, edits_[i] );
+	}
+
+	// Append added rows, ending the last row on disk first if needed
+	string tail;
+	if ( !buffer_.empty() && buffer_[buffer_.size() - 1] != '\n' &&
+			num_file_rows < NumRows() )
+		tail = newline_;
+	for ( int i = num_file_rows; i < NumRows(); ++i )
+		tail += edits_[i] + newline_;
+	if ( !tail.empty() )
+	{
+		fs.seekp( 0, ios::end );
+		fs.write( tail.data(), tail.size() );
+		buffer_ += tail;
+	}
+
+	fs.close();
+	if ( !fs )
+	{
+		TString msg = TString::Format( "Unable to write %s", filename );
+		LogMessage( LOG_ERROR, msg );
+		throw runtime_error( msg.Data() );
+	}
+	ProfileCount( "csv_save", "bytes_patched", tail.size() );
+
+	IndexLines();
+	StatFile( filename );
+	return true;
+}
+
+void CSVFile::ReplaceFile( char const * filename )
+{
+	string contents;
+	string::size_type size = 0;
+	for ( int i = 0; i < NumRows(); ++i )
+		size += (edited_[i] ? edits_[i].size() : lines_[i].length) + newline_.size();
+	contents.reserve( size );
+	for ( int i = 0; i < NumRows(); ++i )
+	{
+		char const * begin;
+		char const * end;
+		RowText( i, &begin, &end );
+		contents.append( begin, end );
+		contents += newline_;
+	}
+
+	// Replace the file a symbolic link points to, and keep its permissions
+	TString target = ResolvedFileName( filename );
+	TString filename_tmp = TemporaryFileName( target );
+	ofstream os( filename_tmp, ios::out | ios::binary | ios::trunc );
+	os.write( contents.data(), contents.size() );
+	os.close();
+	FileStat_t stat;
+	if ( os && gSystem->GetPathInfo( target, stat ) == 0 )
+		gSystem->Chmod( filename_tmp, stat.fMode & 07777 );
+	if ( !os || !RenameReplacing( filename_tmp, target ) )
+	{
+		gSystem->Unlink( filename_tmp );
+		TString msg = TString::Format( "Unable to write %s", filename );
+		LogMessage( LOG_ERROR, msg );
+		throw runtime_error( msg.Data() );
+	}
+	ProfileCount( "csv_save", "bytes_written", contents.size() );
+
+	buffer_.swap( contents );
+	IndexLines();
+	StatFile( filename );
 }
 
 vector<string> CSVFile::GetRow( int row_number ) const
 {
-	return ParseRow( data_[row_number] );
+	vector<CSVField> fields;
+	GetFields( row_number, &fields );
+
+	vector<string> row_vec;
+	row_vec.reserve( fields.size() );
+	for ( int i = 0; i < fields.size(); ++i )
+		row_vec.push_back( fields[i].ToString() );
+	return row_vec;
+}
+
+void CSVFile::GetFields( int row_number, vector<CSVField> * fields ) const
+{
+	RequireText();
+	char const * begin;
+	char const * end;
+	RowText( row_number, &begin, &end );
+	SplitRow( begin, end, fields );
+}
+
+FieldKind CSVFile::GetValue( int row_number, int col, double * value ) const
+{
+	if ( binary_.HasRow( row_number ) && col < binary_.NumColumns() &&
+			!RowChanged( row_number ) )
+	{
+		*value = binary_.Value( row_number, col );
+		return binary_.Kind( row_number, col );
+	}
+
+	vector<CSVField> fields;
+	GetFields( row_number, &fields );
+	if ( col >= fields.size() )
+	{
+		*value = 0;
+		return FIELD_EMPTY;
+	}
+	*value = fields[col].ToDouble();
+	return fields[col].Kind();
 }
 
 void CSVFile::SetRow( int row_number, vector<string> const & row )
 {
-	data_[row_number] = FormatRow( row );
+	RequireText();
+	string row_str = FormatRow( row );
+	char const * begin;
+	char const * end;
+	RowText( row_number, &begin, &end );
+	if ( row_str.size() == end - begin && 
+			memcmp( row_str.data(), begin, row_str.size() ) == 0 )
+		return;
+
+	edits_[row_number].swap( row_str );
+	if ( !edited_[row_number] )
+		++num_edited_;
+	edited_[row_number] = true;
+}
+
+void CSVFile::AddRow( vector<string> const & row )
+{
+	RequireText();
+	Line line;
+	line.begin = string::npos;	// Not in buffer_
+	line.length = 0;
+	lines_.push_back( line );
+	edits_.push_back( FormatRow( row ) );
+	edited_.push_back( true );
+	++num_edited_;
+}
+
+void CSVFile::SortRows( int first_row )
+{
+	RequireText();
+	vector< pair<string, int> > rows;
+	for ( int i = first_row; i < NumRows(); ++i )
+	{
+		char const * begin;
+		char const * end;
+		RowText( i, &begin, &end );
+		rows.push_back( make_pair( string( begin, end ), i ) );
+	}
+
+	bool sorted = true;
+	for ( int i = 1; i < rows.size() && sorted; ++i )
+		sorted = !(rows[i].first < rows[i - 1].first);
+	if ( sorted )
+		return;
+
+	sort( rows.begin(), rows.end() );
+	for ( int i = 0; i < rows.size(); ++i )
+	{
+		int row_number = first_row + i;
+		if ( rows[i].second == row_number )
+			continue;
+		edits_[row_number].swap( rows[i].first );
+		if ( !edited_[row_number] )
+			++num_edited_;
+		edited_[row_number] = true;
+	}
 }
 
 int CSVFile::NumRows() const
 {
-	return data_.size();
+	if ( !text_loaded_ )
+		return binary_.NumCSVRows();
+	return lines_.size();
 }
 
+int CSVFile::NumChangedRows() const
+{
+	return num_edited_;
+}
 
-vector<string> CSVFile::ParseRow( string row_str )
+bool CSVFile::RowChanged( int row_number ) const
 {
-	vector<string> row_vec;
+	return text_loaded_ && edited_[row_number];
+}
+
+
+void CSVFile::RowText( int row_number, char const ** begin, 
+		char const ** end ) const
+{
+	if ( edited_[row_number] )
+	{
+		string const & row_str = edits_[row_number];
+		*begin = row_str.data();
+		*end = row_str.data() + row_str.size();
+	}
+	else
+	{
+		Line const & line = lines_[row_number];
+		*begin = buffer_.data() + line.begin;
+		*end = *begin + line.length;
+	}
+}
+
+void CSVFile::SplitRow( char const * begin, char const * end,
+		vector<CSVField> * fields )
+{
+	fields->clear();
+
+	CSVField field;
+	field.begin = begin;
+	field.escaped = false;
 
 	bool quoted = false;
-	string elem = "";
-	for ( int i = 0; i < row_str.length(); ++i )
+	for ( char const * c = begin; c != end; ++c )
 	{
-		if ( !quoted )
+		if ( *c == '"' )
 		{
-			if ( row_str[i] == ',' )
-				row_vec.push_back( elem ), elem = "";
-			else if ( row_str[i] == '"' )
-				quoted = true;
-			else
-				elem += row_str[i];
+			quoted = !quoted;
+			field.escaped = true;
 		}
-		else
+		else if ( *c == ',' && !quoted )
 		{
-			if ( row_str[i] == '"' && row_str[i+1] == '"' )
-				elem += '"', ++i;
-			else if ( row_str[i] == '"' )
-				quoted = false;
-			else
-				elem += row_str[i];
+			field.end = c;
+			fields->push_back( field );
+			field.begin = c + 1;
+			field.escaped = false;
 		}
 	}
-	row_vec.push_back( elem );
+	field.end = end;
+	fields->push_back( field );
 
-	return row_vec;
+	// A plain quoted field needs no unescaping, so view its contents
+	for ( int i = 0; i < fields->size(); ++i )
+	{
+		CSVField & f = (*fields)[i];
+		if ( f.escaped && f.Length() >= 2 && f.begin[0] == '"' && 
+				f.end[-1] == '"' && 
+				memchr( f.begin + 1, '"', f.Length() - 2 ) == NULL )
+		{
+			++f.begin, --f.end;
+			f.escaped = false;
+		}
+	}
 }
 
-string CSVFile::FormatRow( vector<string> row_vec )
+string CSVFile::FormatRow( vector<string> const & row_vec )
 {
-	string row_str = "";
+	string row_str;
+
+	string::size_type length = row_vec.size();
+	for ( int i = 0; i < row_vec.size(); ++i )
+		length += row_vec[i].size() + 2;
+	row_str.reserve( length );
 
 	for ( int i = 0; i < row_vec.size(); ++i )
 	{
 		if ( row_vec[i].find( '"' ) != string::npos )
 		{
 			row_str += '"';
-			for ( int j = 0; j < row_vec[i].length(); ++j )
+			string::size_type begin = 0, end;
+			while ( (end = row_vec[i].find( '"', begin )) != string::npos )
 			{
-				if ( row_vec[i][j] == '"' )
-					row_str += "\"\"";
-				else
-					row_str += row_vec[i][j];
+				row_str.append( row_vec[i], begin, end - begin );
+				row_str += "\"\"";
+				begin = end + 1;
 			}
+			row_str.append( row_vec[i], begin, string::npos );
 			row_str += '"';
 		}
 		else if ( row_vec[i].find( ',' ) != string::npos )
@@ -111,4 +599,48 @@ string CSVFile::FormatRow( vector<string> row_vec )
 	return row_str;
 }
 
+TString TemporaryFileName( char const * filename )
+{
+	// Processes on other nodes sharing the directory may have the same pid
+	return TString::Format( "%s.%s.%d.tmp", filename, gSystem->HostName(),
+			gSystem->GetPid() );
+}
+
+bool FileState( char const * filename, Long64_t * size, Long64_t * mtime )
+{
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if ( !GetFileAttributesExA( filename, GetFileExInfoStandard, &data ) )
+		return false;
+	*size = ((Long64_t) data.nFileSizeHigh << 32) | data.nFileSizeLow;
+	*mtime = ((Long64_t) data.ftLastWriteTime.dwHighDateTime << 32) |
+		data.ftLastWriteTime.dwLowDateTime;	// 100 ns
+#else
+	struct stat st;
+	if ( ::stat( filename, &st ) != 0 )
+		return false;
+	*size = st.st_size;
+#ifdef __APPLE__
+	*mtime = (Long64_t) st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+	*mtime = (Long64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+#endif
+	return true;
+}
+
+bool RenameReplacing( char const * from, char const * to )
+{
+#ifdef _WIN32
+	// Replacing keeps the attributes and permissions of the old file, but
+	// needs one to exist
+	if ( ReplaceFileA( to, from, NULL, REPLACEFILE_IGNORE_MERGE_ERRORS, 
+				NULL, NULL ) )
+		return true;
+	return MoveFileExA( from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH ) != 0;
+#else
+	return gSystem->Rename( from, to ) == 0;
+#endif
+}
+
 } // namespace n2n
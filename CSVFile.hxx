@@ -6,27 +6,109 @@
 #ifndef N2N_CSVFILE_INCL_
 #define N2N_CSVFILE_INCL_
 
+#include "BinaryTable.hxx"
+
+#include <atomic>
+#include <mutex>
+#include <string>
 #include <vector>
 
 namespace n2n {
 
+/**
+ * A non-owning view of a single field in a CSV formatted row.
+ * The view is only valid until the file is reloaded or its row is 
+ * overwritten.
+ */
+struct CSVField
+{
+	char const * begin;	///< The first character of the field.
+	char const * end;	///< One past the last character of the field.
+	bool escaped;		///< True if the field must be unquoted before use.
+
+	/**
+	 * Get the number of characters in the raw field.
+	 */
+	int Length() const { return end - begin; }
+
+	/**
+	 * Materialize the value of the field, removing any quoting.
+	 */
+	string ToString() const;
+
+	/**
+	 * Convert the field to a number, as atof() would.
+	 */
+	double ToDouble() const;
+
+	/**
+	 * Convert the field to an integer, as atoi() would.
+	 */
+	int ToInt() const;
+
+	/**
+	 * Tell whether the field is empty, a number, or other text.
+	 */
+	FieldKind Kind() const;
+};
+
 /**
  * Provides access to CSV formatted data.
+ *
+ * The file is read into memory with a single read and only the line 
+ * boundaries are indexed when it is loaded. Rows are split into fields
+ * when they are requested.
+ *
+ * Rows changed since the file was last loaded or saved are tracked, so a
+ * save can be skipped when nothing changed, or can patch only the changed
+ * rows of the file.
+ *
+ * A file with a schema may also keep a BinaryTable sidecar, which holds
+ * the numeric values of its rows. While the sidecar can be trusted, 
+ * loading the file only opens the sidecar; the text is read when a row 
+ * is first needed as text, and numeric values are served from the 
+ * sidecar (see GetValue) until their row is changed.
  */
 struct CSVFile
 {
 	public:
 		/**
-		 * Load a file containing csv foramtted data.
+		 * Create an empty file.
+		 */
+		CSVFile();
+
+		virtual ~CSVFile();
+
+		/**
+		 * Load a file containing csv foramtted data. Tables which index
+		 * their rows override this to rebuild the index.
 		 * @param filename The file to load.
 		 */
-		void Load( char const * filename );
+		virtual void Load( char const * filename );
 
 		/**
 		 * Save a file containing csv formatted data.
+		 *
+		 * By default the whole file is written with a single write to a
+		 * temporary file, which then replaces the file, so the file is
+		 * never left half-written. Nothing is written if no row changed
+		 * since the file was last loaded from or saved to the same name,
+		 * and the file was not changed by anyone else since, judging by
+		 * its size and modification time (see FileState). The replaced
+		 * file keeps its permissions, and if its name is a symbolic 
+		 * link, the file it points to is replaced and the link kept;
+		 * on Windows links are not followed.
+		 *
+		 * When patching, if every changed row keeps its length or was
+		 * added after the last row on disk, only those rows are written
+		 * into the existing file. This is faster for large files, but a
+		 * crash can leave a partly written row. Otherwise the whole file
+		 * is replaced as above. Tables which index their rows override 
+		 * this to save them in a canonical order.
 		 * @param filename The file to save to.
+		 * @param patch True to write only the changed rows if possible.
 		 */
-		void Save( char const * filename ) const;
+		virtual void Save( char const * filename, bool patch = false );
 
 		/**
 		 * Retrieve a row from the file.
@@ -36,35 +118,242 @@ struct CSVFile
 		vector<string> GetRow( int row_number ) const;
 
 		/**
-		 * Overwrite a row in the file.
+		 * Retrieve views of the fields in a row without copying them.
+		 * @param row_number The row to retrieve.
+		 * @param fields Filled with one view per field in the row.
+		 */
+		void GetFields( int row_number, vector<CSVField> * fields ) const;
+
+		/**
+		 * Get the numeric value of a field, from the sidecar if it 
+		 * holds the row, so that the text need not be read.
+		 * @param row_number The row of the field.
+		 * @param col The column of the field.
+		 * @param value Set to the value, as CSVField::ToDouble() 
+		 * converts it, or 0 if the row has no such column.
+		 * @return The kind of the field; FIELD_EMPTY if the row has no 
+		 * such column.
+		 */
+		FieldKind GetValue( int row_number, int col, double * value ) const;
+
+		/**
+		 * Overwrite a row in the file. The row is only marked as changed
+		 * if its text differs.
 		 * @param row_number The row to overwrite.
 		 * @param row The values to write.
 		 */
 		void SetRow( int row_number, vector<string> const & row );
 
+		/**
+		 * Append a row to the end of the file.
+		 * @param row The values to write.
+		 */
+		void AddRow( vector<string> const & row );
+
 		/**
 		 * Get the number of rows in the file.
 		 */
 		int NumRows() const;
 
+		/**
+		 * Get the number of rows changed or added since the file was
+		 * last loaded or saved.
+		 */
+		int NumChangedRows() const;
+
+		/**
+		 * Check whether a row was changed or added since the file was
+		 * last loaded or saved.
+		 * @param row_number The row to check.
+		 */
+		bool RowChanged( int row_number ) const;
+
+		/**
+		 * Describe the layout of the file, and keep a binary sidecar of 
+		 * its numeric values from now on. The sidecar is written when 
+		 * the file is saved (see SetWriteBinary), and used when it is 
+		 * loaded if it is still up to date. Its schema is a hash of the
+		 * layout, i.e. of the field enum of the table, so a sidecar 
+		 * written by code with another layout is not trusted.
+		 * @param name The name of the layout, e.g. "RunSummary".
+		 * @param first_row The first row containing data.
+		 * @param num_columns The number of columns of data, e.g. 
+		 * RS_NUM_COLUMNS.
+		 */
+		void SetSchema( char const * name, int first_row, int num_columns );
+
+		/**
+		 * Choose whether Save writes the sidecar, which SetSchema turns
+		 * on. Writing it costs a conversion of every row, so tables 
+		 * which are saved often, or by shards which must not share 
+		 * writes, leave it to the saves which finish their work. A 
+		 * sidecar left behind by an earlier save is simply no longer
+		 * trusted.
+		 * @param write True to write the sidecar on each save.
+		 */
+		void SetWriteBinary( bool write );
+
+		/**
+		 * Get the sidecar of the file as last loaded or saved, which 
+		 * holds no rows if there is none to trust.
+		 */
+		BinaryTable const * Binary() const;
+
+	protected:
+		/**
+		 * Sort the rows from first_row on by their text, so that the file
+		 * is the same whatever order its rows were added in. Nothing is
+		 * marked as changed if the rows are already sorted.
+		 * @param first_row The first row to sort.
+		 */
+		void SortRows( int first_row );
+
 	private:
-		vector<string> data_;
+		/**
+		 * The location of a line in buffer_.
+		 */
+		struct Line
+		{
+			string::size_type begin;
+			string::size_type length;
+		};
+
+		string buffer_;			///< Contents of the file as loaded or saved
+		vector<Line> lines_;		///< Lines of buffer_
+		vector<string> edits_;		///< Rows replaced by SetRow
+		vector<bool> edited_;		///< True for rows found in edits_
+		int num_edited_;		///< Number of rows in edits_
+		string newline_;		///< Line ending of the file
+		string filename_;		///< File buffer_ was loaded from or saved to
+		Long64_t file_size_;		///< Size of that file after loading or saving
+		Long64_t file_mtime_;		///< Modification time of that file (see FileState)
+		atomic<bool> text_loaded_;	///< False until buffer_ is read after a load
+		mutable mutex text_lock_;	///< Guards the first read of buffer_
+		string schema_name_;		///< Name of the layout, if any
+		int schema_first_row_;		///< First row containing data
+		int schema_num_columns_;	///< Number of columns of data
+		bool write_binary_;		///< True to write the sidecar on save
+		BinaryTable binary_;		///< Sidecar of the file
+
+		/**
+		 * Read buffer_ from the file it was loaded from, and index it.
+		 * If the file changed since it was loaded, the sidecar no longer
+		 * describes it, and is closed.
+		 */
+		void ReadText();
+
+		/**
+		 * Read the text of the file, if that was put off when it was 
+		 * loaded. This is safe to call from several threads at once.
+		 */
+		void RequireText() const;
+
+		/**
+		 * Index the lines of buffer_ and forget every edit.
+		 */
+		void IndexLines();
+
+		/**
+		 * Remember the state of the file buffer_ was loaded from or
+		 * saved to, so later changes by others can be detected.
+		 */
+		void StatFile( char const * filename );
+
+		/**
+		 * Check whether the file is as it was when buffer_ was loaded
+		 * from or saved to it.
+		 */
+		bool FileUnchanged( char const * filename ) const;
+
+		/**
+		 * Calculate the schema of the file.
+		 */
+		UInt_t Schema() const;
+
+		/**
+		 * Open the sidecar of the file, if there is one to trust. 
+		 * Loading never writes a sidecar, so processes may load the 
+		 * same file at once.
+		 * @return False if no sidecar was opened.
+		 */
+		bool OpenBinary( char const * filename );
 
 		/**
-		 * Parse a string containing a csv formatted row.
-		 * @param row_str The string to parse.
-		 * @return A vector of values in the string.
+		 * Write the sidecar of a file which was just saved, if sidecars
+		 * are written, and open it.
 		 */
-		static vector<string> ParseRow( string row_str );
+		void WriteBinary( char const * filename );
+
+		/**
+		 * Write only the changed rows into the file.
+		 * @return False if the layout of the file does not allow it, 
+		 * in which case nothing was written.
+		 */
+		bool PatchFile( char const * filename );
+
+		/**
+		 * Replace the file with the current contents, via a temporary
+		 * file.
+		 */
+		void ReplaceFile( char const * filename );
+
+		/**
+		 * Get the text of a row.
+		 * @param row_number The row to retrieve.
+		 * @param begin Set to the first character of the row.
+		 * @param end Set to one past the last character of the row.
+		 */
+		void RowText( int row_number, char const ** begin, 
+				char const ** end ) const;
+
+		/**
+		 * Split a csv formatted row into fields.
+		 * @param begin The first character of the row.
+		 * @param end One past the last character of the row.
+		 * @param fields Filled with one view per field in the row.
+		 */
+		static void SplitRow( char const * begin, char const * end,
+				vector<CSVField> * fields );
 
 		/**
 		 * Format values into a csv formatted row.
 		 * @param row_vec The values to format.
 		 * @return A string containing those values.
 		 */
-		static string FormatRow( vector<string> row_vec );
+		static string FormatRow( vector<string> const & row_vec );
 };
 
+/**
+ * Get the name of a temporary file to write before it replaces a file.
+ * The name includes the host and process, so processes writing the same
+ * file at once, even on different nodes, do not share a temporary file.
+ * @param filename The file to be replaced.
+ */
+TString TemporaryFileName( char const * filename );
+
+/**
+ * Get the size and modification time of a file. The time is as fine as 
+ * the platform records it, e.g. to the nanosecond, so that a change made
+ * within the same second as another is still seen; it is only meant to 
+ * be compared.
+ * @param filename The file.
+ * @param size Set to the size of the file (bytes).
+ * @param mtime Set to the modification time of the file.
+ * @return False if the file does not exist.
+ */
+bool FileState( char const * filename, Long64_t * size, Long64_t * mtime );
+
+/**
+ * Rename a file, replacing any file which already has the new name. On
+ * Windows, where rename() fails if the new name exists, the old file is
+ * replaced in place, which keeps its attributes and permissions, or if
+ * that fails the file is moved over it.
+ * @param from The file to rename.
+ * @param to The new name of the file.
+ * @return False if the file could not be renamed.
+ */
+bool RenameReplacing( char const * from, char const * to );
+
 } // namespace n2n
 
 #endif
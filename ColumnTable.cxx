@@ -0,0 +1,92 @@
+/** 
+ * @file n2n/ColumnTable.cxx
+ * Copyright (C) 2013 Houghton College
+ */
+
+#include "ColumnTable.hxx"
+
+namespace n2n {
+
+void ColumnTable::Load( CSVFile const & file, int first_row, int num_columns )
+{
+	vector<int> rows;
+	for ( int i = first_row; i < file.NumRows(); ++i )
+		rows.push_back( i );
+	Load( file, rows, num_columns );
+}
+
+void ColumnTable::Load( CSVFile const & file, vector<int> const & rows, 
+		int num_columns )
+{
+	rows_ = rows;
+	num_rows_ = rows_.size();
+
+	columns_.assign( num_columns, vector<double>( num_rows_, 0.0 ) );
+
+	BinaryTable const * binary = file.Binary();
+	vector<CSVField> fields;
+	for ( int i = 0; i < num_rows_; ++i )
+	{
+		if ( binary->HasRow( rows_[i] ) && !file.RowChanged( rows_[i] ) )
+		{
+			for ( int col = 0; col < num_columns; ++col )
+				columns_[col][i] = binary->Value( rows_[i], col );
+			continue;
+		}
+
+		file.GetFields( rows_[i], &fields );
+		int n = fields.size() < num_columns ? fields.size() : num_columns;
+		for ( int col = 0; col < n; ++col )
+			columns_[col][i] = fields[col].ToDouble();
+	}
+}
+
+void ColumnTable::Store( CSVFile * file, vector<int> const & columns ) const
+{
+	for ( int i = 0; i < num_rows_; ++i )
+	{
+		vector<string> row = file->GetRow( rows_[i] );
+		if ( row.size() < columns_.size() )
+			row.resize( columns_.size() );
+
+		for ( int j = 0; j < columns.size(); ++j )
+		{
+			int col = columns[j];
+			row[col] = TString::Format( "%f", columns_[col][i] );
+		}
+
+		file->SetRow( rows_[i], row );
+	}
+}
+
+int ColumnTable::NumRows() const
+{
+	return num_rows_;
+}
+
+double * ColumnTable::Column( int col )
+{
+	return num_rows_ > 0 ? &columns_[col][0] : NULL;
+}
+
+double const * ColumnTable::Column( int col ) const
+{
+	return num_rows_ > 0 ? &columns_[col][0] : NULL;
+}
+
+UncertainD ColumnTable::GetUncertainD( int row, int val_col, int unc_col ) const
+{
+	UncertainD ret;
+	ret.val = columns_[val_col][row];
+	ret.unc = columns_[unc_col][row];
+	return ret;
+}
+
+void ColumnTable::SetUncertainD( UncertainD const & value, int row, 
+		int val_col, int unc_col )
+{
+	columns_[val_col][row] = value.val;
+	columns_[unc_col][row] = value.unc;
+}
+
+} // namespace n2n
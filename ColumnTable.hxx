@@ -0,0 +1,92 @@
+/** 
+ * @file n2n/ColumnTable.hxx
+ * Copyright (C) 2013 Houghton College
+ */
+
+#ifndef N2N_COLUMNTABLE_INCL_
+#define N2N_COLUMNTABLE_INCL_
+
+#include "CSVFile.hxx"
+#include "Uncertain.hxx"
+
+#include <vector>
+
+namespace n2n {
+
+/**
+ * The numeric contents of a CSV file, stored column by column.
+ *
+ * Every field is converted to a double once when the table is loaded, and
+ * converted back to text only for the columns which are stored. Unchanged
+ * rows of a file with a binary sidecar are read from the sidecar instead.
+ * Columns are indexed by the same field enums as the rows they came from,
+ * e.g. CSFields.
+ */
+struct ColumnTable
+{
+	public:
+		/**
+		 * Parse the rows of a file into columns.
+		 * @param file The file to read.
+		 * @param first_row The first row containing data.
+		 * @param num_columns The number of columns to read.
+		 */
+		void Load( CSVFile const & file, int first_row, int num_columns );
+
+		/**
+		 * Parse some rows of a file into columns.
+		 * @param file The file to read.
+		 * @param rows The rows to read, in the order they are stored in
+		 * the table.
+		 * @param num_columns The number of columns to read.
+		 */
+		void Load( CSVFile const & file, vector<int> const & rows, 
+				int num_columns );
+
+		/**
+		 * Write columns back into the rows they were loaded from.
+		 * @param file The file to write to.
+		 * @param columns The columns to write.
+		 */
+		void Store( CSVFile * file, vector<int> const & columns ) const;
+
+		/**
+		 * Get the number of rows in the table.
+		 */
+		int NumRows() const;
+
+		/**
+		 * Get the values of a column.
+		 * @param col The column to retrieve.
+		 * @return NumRows() contiguous values.
+		 */
+		double * Column( int col );
+		double const * Column( int col ) const;
+
+		/**
+		 * Read a value and its uncertainty from a row.
+		 * @param row The row to read, counted from the first loaded row.
+		 * @param val_col The column containing the value.
+		 * @param unc_col The column containing the uncertainty.
+		 */
+		UncertainD GetUncertainD( int row, int val_col, int unc_col ) const;
+
+		/**
+		 * Write a value and its uncertainty into a row.
+		 * @param value The value to write.
+		 * @param row The row to write, counted from the first loaded row.
+		 * @param val_col The column containing the value.
+		 * @param unc_col The column containing the uncertainty.
+		 */
+		void SetUncertainD( UncertainD const & value, int row, 
+				int val_col, int unc_col );
+
+	private:
+		vector<int> rows_;	///< Row of the file for each row of the table
+		int num_rows_;
+		vector< vector<double> > columns_;
+};
+
+} // namespace n2n
+
+#endif
@@ -7,10 +7,16 @@
 #define N2N_CROSSSECTION_INCL_
 
 #include "CSVFile.hxx"
+#include "NPCrossSection.hxx"
+#include "Parameters.hxx"
 #include "RunSummary.hxx"
+#include "SummedArea.hxx"
+#include "Uncertain.hxx"
 
 namespace n2n {
 
+struct Dependencies;
+
 /**
  * Cross Section column names
  */
@@ -68,20 +74,193 @@ enum CSFields {
 	CS_NUM_COLUMNS
 };
 
+/**
+ * The proton flux found with one candidate region of interest.
+ */
+struct ScanPoint
+{
+	Region roi;		///< The region of interest
+	Long64_t fg_protons;	///< Protons in the foreground run (protons)
+	Long64_t bg_protons;	///< Protons in the background run (protons)
+	UncertainD flux;	///< Proton flux (protons/s)
+};
+
+/**
+ * The distribution of one calculated value over many Monte Carlo samples.
+ */
+struct MCSummary
+{
+	double mean;		///< Mean of the samples
+	double std_dev;		///< Standard deviation of the samples
+	double p16;		///< 16th percentile
+	double p50;		///< Median
+	double p84;		///< 84th percentile
+};
+
+/**
+ * The Monte Carlo distributions of the calculated values of one row.
+ */
+struct MCRow
+{
+	MCSummary proton_flux;	///< Proton flux (protons/s)
+	MCSummary neutron_flux;	///< Neutron flux (neutrons/s)
+	MCSummary ch2_xsect;	///< (n,2n) cross section in CH2 (mbarn)
+	MCSummary c12_xsect;	///< (n,2n) cross section in C12 (mbarn)
+};
+
 
 struct CrossSection : public CSVFile
 {
 	public:
+		CrossSection();
+
+		/**
+		 * Set the n-p cross sections used to calculate the neutron flux.
+		 * @param np_xsect The table, which must outlive this object;
+		 * NPCrossSection::Default() by default.
+		 */
+		void SetNPCrossSection( NPCrossSection const * np_xsect );
+
+		/**
+		 * Set the geometry, densities and half-life used by LoadSummary,
+		 * Calculate and CalculateMonteCarlo.
+		 * @param params The parameters; Parameters() by default.
+		 */
+		void SetParameters( Parameters const & params );
+
+		/**
+		 * Recalculate only the rows whose inputs changed since they were 
+		 * recorded. Rows which are calculated are recorded.
+		 * @param deps The record to use, or NULL to always recalculate.
+		 */
+		void SetDependencies( Dependencies * deps );
+
+		/**
+		 * Reuse decay fits from a cache during CalculateSweep, e.g. 
+		 * those of RunSummary::Update. Newly calculated fits are stored
+		 * in the cache.
+		 * @param cache The cache to use, or NULL to always fit.
+		 */
+		void SetFitCache( FitCache * cache );
+
 		/**
 		 * Copy values from Run_Summary.csv file into the Cross_Sections.csv file
 		 * @param summary The run summary to use
 		 */
 		void LoadSummary( RunSummary const * const summary );
 
+		/**
+		 * Copy values from Run_Summary.csv file into some rows of the 
+		 * Cross_Sections.csv file
+		 * @param summary The run summary to use
+		 * @param rows The rows to update
+		 */
+		void LoadSummary( RunSummary const * const summary, 
+				vector<int> const & rows );
+
 		/**
 		 * Calculate cross sections based on the values in Cross_Sections.csv
 		 */
 		void Calculate();
+
+		/**
+		 * Calculate the cross sections of some rows only.
+		 * @param rows The rows to calculate.
+		 */
+		void Calculate( vector<int> const & rows );
+
+		/**
+		 * Find the rows which use a run as foreground or background.
+		 * @param run_number The run to look for.
+		 * @param rows Filled with the matching rows.
+		 */
+		void FindRun( int run_number, vector<int> * rows ) const;
+
+		/**
+		 * Find the rows whose foreground run is numbered from first_run
+		 * to last_run, e.g. the rows calculated by one shard of a 
+		 * campaign.
+		 * @param first_run The first run to look for.
+		 * @param last_run The last run to look for.
+		 * @param rows Filled with the matching rows.
+		 */
+		void FindRuns( int first_run, int last_run, vector<int> * rows ) const;
+
+		/**
+		 * Calculate cross sections by Monte Carlo, drawing every input 
+		 * with an uncertainty from a normal distribution, including the
+		 * geometry which Calculate() treats as exact.
+		 *
+		 * The detector and target dimensions are drawn with the same
+		 * normal deviates in every row, so they are fully correlated
+		 * between rows; all other inputs are independent for each row. The 
+		 * random numbers are a function of the seed, row and sample 
+		 * number only, so the results do not depend on num_workers.
+		 * @param num_samples The number of samples per row. With none,
+		 * every summary is NaN.
+		 * @param rows Filled with one entry per row, starting with the
+		 * first row of data.
+		 * @param num_workers The number of threads, or 0 to use one 
+		 * per core.
+		 * @param seed The random number seed.
+		 */
+		void CalculateMonteCarlo( int num_samples, vector<MCRow> * rows,
+				int num_workers = 0, ULong64_t seed = 1 ) const;
+
+		/**
+		 * Calculate the CH2 and C12 cross sections of every row for
+		 * each of many parameter sets, e.g. from LoadParameterSets.
+		 *
+		 * Values which no parameter affects, such as the protons and 
+		 * live fractions, are taken from the rows as they are, so
+		 * LoadSummary should be up to date. The decay curves of each
+		 * foreground run are parsed at most once and fit once per 
+		 * distinct half-life, unless the fit is in the cache (see 
+		 * SetFitCache); then the sets are calculated concurrently. Rows
+		 * without a foreground run are skipped with a warning, and give
+		 * NaN. Each
+		 * set takes the place of SetParameters, and gives exactly the 
+		 * cross sections LoadSummary and Calculate would with it.
+		 * @param summary The run summary, for the transit times.
+		 * @param dirname The directory containing the raw data 
+		 * directories.
+		 * @param sets The parameter sets.
+		 * @param results Filled with the CH2 then the C12 cross section
+		 * (mbarn) of each row, starting with the first row of data, for
+		 * each set in turn; i.e. 2 * (NumRows() - 3) values per set.
+		 * @param num_workers The number of threads, or 0 to use one 
+		 * per core.
+		 * @param method The method used to fit decay curves.
+		 */
+		void CalculateSweep( RunSummary const * summary, char const * dirname,
+				vector<Parameters> const & sets, vector<double> * results,
+				int num_workers = 0, 
+				decay::FitMethod method = decay::FIT_MINUIT ) const;
+
+		/**
+		 * Calculate the proton flux of a row for a grid of regions of
+		 * interest around a nominal region. Each boundary of the nominal 
+		 * region is moved independently by up to num_steps * step channels
+		 * in either direction; empty regions are skipped.
+		 * @param row_number The row whose clock and live times are used.
+		 * @param fg The foreground spectrum.
+		 * @param bg The background spectrum.
+		 * @param nominal The nominal region of interest.
+		 * @param step The change in a boundary between grid points (channels).
+		 * @param num_steps The number of grid points on either side of 
+		 * each nominal boundary.
+		 * @param points Filled with one entry per region.
+		 */
+		void ScanRegion( int row_number, SummedArea const & fg, 
+				SummedArea const & bg, Region const & nominal,
+				int step, int num_steps, 
+				vector<ScanPoint> * points ) const;
+
+	private:
+		NPCrossSection const * np_xsect_;
+		Parameters params_;
+		Dependencies * deps_;
+		FitCache * cache_;
 };
 
 } // namespace n2n
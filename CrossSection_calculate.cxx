@@ -4,233 +4,342 @@
  */
 
 #include "CrossSection.hxx"
-#include "Uncertain.hxx"
+#include "calculate.hxx"
+#include "Dependencies.hxx"
+#include "Log.hxx"
+#include "Profile.hxx"
+
+#include <limits>
 
 namespace n2n {
+
+CrossSection::CrossSection()
+	: np_xsect_( &NPCrossSection::Default() ), deps_( NULL ), cache_( NULL )
+{
+	SetSchema( "CrossSection", 3, CS_NUM_COLUMNS );
+}
+
+void CrossSection::SetNPCrossSection( NPCrossSection const * np_xsect )
+{
+	np_xsect_ = np_xsect;
+}
+
+void CrossSection::SetParameters( Parameters const & params )
+{
+	params_ = params;
+}
+
+void CrossSection::SetDependencies( Dependencies * deps )
+{
+	deps_ = deps;
+}
+
+void CrossSection::SetFitCache( FitCache * cache )
+{
+	cache_ = cache;
+}
+
 namespace calculate {
 
-/**
- * Calculate the proton flux, @f$N_p@f$.
- *
- * @f[N_p=
- *	\frac{N_{p,fg}}{t_{clock,fg}t_{live,fg}}-
- *      \frac{N_{p,bg}}{t_{clock,bg}t_{live,bg}}@f]
- * @f[{\delta_{N_p}}^2=
- * 	\left(\frac{\delta_{N_{p,fg}}}{t_{clock,fg}t_{live,fg}}\right)^2+
- * 	\left(\frac{\delta_{N_{p,bg}}}{t_{clock,bg}t_{live,bg}}\right)^2@f]
- *
- * @param fg_protons Number of protons in foreground, @f$N_{p,fg}@f$ (protons)
- * @param fg_clock Clock time of foreground, @f$t_{clock,fg}@f$ (s)
- * @param fg_live Fraction of live time in foreground, @f$t_{live,fg}@f$
- * @param bg_protons Number of protons in background, @f$N_{p,bg}@f$ (protons)
- * @param bg_clock Clock time of background, @f$t_{clock,bg}@f$ (s)
- * @param bg_live Fraction of live time in background, @f$t_{live,bg}@f$
- *
- * @return The proton flux, @f$N_p@f$ (@f$\frac{\text{protons}}{\text{s}}@f$)
- */
 UncertainD ProtonFlux( UncertainD fg_protons, double fg_clock, double fg_live, 
 		       UncertainD bg_protons, double bg_clock, double bg_live )
 {
-	UncertainD protons;
-	protons.val = fg_protons.val / (fg_clock * fg_live) - 
-                      bg_protons.val / (bg_clock * bg_live);
-	protons.unc = sqrt( pow( fg_protons.unc / (fg_clock * fg_live), 2 ) +
-			    pow( bg_protons.unc / (bg_clock * bg_live), 2 ) );
-	return protons;
+	enum { FG, BG };
+	UncertainSource<FG> fg( fg_protons );
+	UncertainSource<BG> bg( bg_protons );
+	return Evaluate( fg / (fg_clock * fg_live) - bg / (bg_clock * bg_live) );
 }
 
-/**
- * Calculate the @f$(n,p)@f$ cross section, @f$\sigma_{np}(T)@f$, at the given energy 
- * by interpolating between known cross sections.
- *
- * @param energy The kinetic energy, @f$T@f$ (MeV)
- * @return The cross section, @f$\sigma_{np}(T)@f$ 
- * (@f$\frac{\text{mbarn}}{\text{sr}}@f$)
- */
 double CalcNPCrossSection( double energy )
 {
-	// Data from http://nn-online.org/
-	// Lab frame
-	double energies[] = {  20,  22,  24,  26,  28 };	// (MeV)
-	double xsects[]   = { 153, 139, 128, 119, 111 };	// (mbarn/sr)
-
-	ROOT::Math::Interpolator interp( 5 );
-	interp.SetData( 5, energies, xsects );
-	return interp.Eval( energy );
+	return NPCrossSection::Default().Eval( energy );
 }
 
-/**
- * Calculate a solid angle from a distance and area.
- *
- * @f[\Omega=\frac{A}{d^2}@f]
- *
- * @param area The area of the target, @f$A@f$ (@f$\text{cm}^2@f$)
- * @param dist The distance to the target, @f$d@f$ (cm)
- * @return The solid angle, @f$\Omega@f$ (sr)
- */
 double CalcSolidAngle( double area, double dist )
 {
 	return area / (dist * dist);
 }
 
-double CalcThicknessH_CH2( double thickness )
+double CalcThicknessH_CH2( double thickness, double density )
 {
 	double mass_H = 1.007825;	// u
 	double mass_C = 12;		// u
 	double mass = 2 * mass_H + mass_C;
-	double density = 0.89;		// g/cm^3
 
 	// 1 u = 1.6605389e-24 g
 	// 1 barn = 1e-24 cm^2
 	return 2 * thickness * density / (mass * 1.6605389);
 }
 
-double CalcThicknessC_CH2( double thickness )
+double CalcThicknessC_CH2( double thickness, double density )
 {
 	double mass_H = 1.007825;	// u
 	double mass_C = 12;		// u
 	double mass = 2 * mass_H + mass_C;
-	double density = 0.89;		// g/cm^3
 
 	// 1 u = 1.6605389e-24 g
 	// 1 barn = 1e-24 cm^2
 	return thickness * density / (mass * 1.6605389);
 }
 
-double CalcThicknessC_C12( double thickness )
+double CalcThicknessC_C12( double thickness, double density )
 {
 	double mass = 12;		// u
-	double density = 2.276;		// g/cm^3
 
 	// 1 u = 1.6605389e-24 g
 	// 1 barn = 1e-24 cm^2
 	return thickness * density / (mass * 1.6605389);
 }
 
-/**
- * Calculate the neutron flux, @f$N_{flux}@f$.
- *
- * @f[N_{flux}=\frac{N_p}{\sigma_{np}(T)N_{H,CH_2}\Omega_{det}\Omega_{CH_2}}@f]
- * @f[\delta_{N_{flux}}=\frac{\delta_{N_p}}{\sigma_{np}(T)N_{H,CH_2}\Omega_{det}\Omega_{CH_2}}@f]
- *
- * @param protons The proton flux, @f$N_p@f$ (@f$\frac{\text{protons}}{\text{s}}@f$)
- * @param sigma_np The cross section of the @f$(n,p)@f$ reaction, @f$\sigma_{np}@f$ 
- * (@f$\frac{\text{mbarn}}{\text{sr}}@f$)
- * @param ch2 The @f$\text{CH}_2@f$ target.
- * @param sang_det The solid angle of the proton detector, @f$\Omega_{det}@f$ (sr)
- * @return The neutron flux, @f$N_{flux}@f$ 
- * (@f$\frac{\text{neutrons}}{\text{s}\cdot\text{sr}}@f$)
- */
 UncertainD CalcNeutronFlux( UncertainD protons, double sigma_np, double ch2_nH, double ch2_sang, 
 			    double det_sang )
 {
-	// 1 mbarn = 1e-3 barn
-	double denom = sigma_np * ch2_nH * ch2_sang * det_sang * 1e-3;
+	UncertainSource<0> n_p( protons );
 
-	UncertainD flux;
-	flux.val = protons.val / denom;
-	flux.unc = protons.unc / denom;
-	return flux;
+	// 1 mbarn = 1e-3 barn
+	return Evaluate( n_p / (sigma_np * ch2_nH * ch2_sang * det_sang * 1e-3) );
 }
 
-/**
- * Calculate the @f${}^{12}\text{C}(n,2n){}^{11}\text{C}@f$ cross section, 
- * @f$\sigma_{n2n}@f$, where @f$\lambda_{C11} = \frac{\ln(2)}{20.334~\text{min}}@f$
- * is the @f${}^{11}\text{C}@f$ decay constant.
- *
- * @f[\sigma_{n2n}=\frac{N_{C11}}{\text{efficiency}}\frac{\lambda_{C11}}
- * {N_{C,tar}N_{flux}\Omega_{tar}(1-e^{-\lambda_{C11}t_{act}})}@f]
- * @f[\delta_{\sigma_{n2n}}=\frac{N_{C11}}{\text{efficiency}}\frac{\lambda_{C11}}
- * {N_{C,tar}N_{flux}\Omega_{tar}(1-e^{-\lambda_{C11}t_{act}})}
- * \sqrt{\left(\frac{\delta_{N_{flux}}}{N_{flux}}\right)^2+
- * \left(\frac{\delta_{N_{C11}}}{N_{C11}}\right)^2}@f]
- * 
- * @param target The target for which the cross section should be calculated
- * @param neutrons The neutron flux, @f$N_{flux}@f$ 
- * (@f$\frac{\text{neutrons}}{\text{s}\cdot\text{sr}}@f$)
- * @param efficiency An efficiency correction factor
- * @param time The total activation time, @f$t_{act}@f$ (s)
- * (@f$\frac{\text{C nuclei}}{\text{barn}}@f$)
- * @return The cross section, @f$\sigma_{n2n}@f$ (mb)
- */
 UncertainD CalcN2NCrossSection( UncertainD tar_decay, UncertainD neutrons, double time, 
-                                double tar_nC, double tar_sang )
+                                double tar_nC, double tar_sang, double half_life )
 {	
 	// 1 min = 60 s
-	double decay = TMath::Log( 2 ) / (20.334 * 60);	// (1/s)
+	double decay = TMath::Log( 2 ) / (half_life * 60);	// (1/s)
+
+	enum { DECAY, FLUX };
+	UncertainSource<DECAY> n_c11( tar_decay );
+	UncertainSource<FLUX> n_flux( neutrons );
 
 	// 1 mbarn = 1e-3 barn
-	double denom = tar_nC * neutrons.val * tar_sang * 1e-3
-		* (1 - TMath::Exp( -decay * time ));
+	UncertainD xsect = Evaluate( n_c11 * decay / (tar_nC * n_flux * tar_sang * 1e-3
+		* (1 - TMath::Exp( -decay * time ))) );
 
-	UncertainD xsect;
-	xsect.val = tar_decay.val * decay / denom;
-	xsect.unc = xsect.val * sqrt( pow( neutrons.unc / neutrons.val, 2 ) +
-			pow( tar_decay.unc / tar_decay.val, 2 ) );
+	// Without decays the relative uncertainty is undefined; keep the NaN
+	// the sum of relative errors gave rather than report a finite value
+	if ( tar_decay.val == 0 )
+		xsect.unc = numeric_limits<double>::quiet_NaN();
 	return xsect;
 }
 
+void ProtonFlux( ColumnTable * table )
+{
+	double const * fg_protons = table->Column( CS_FG_PROTONS );
+	double const * fg_protons_unc = table->Column( CS_FG_PROTONS_UNC );
+	double const * fg_clock = table->Column( CS_FG_CLOCK_TIME );
+	double const * fg_live = table->Column( CS_FG_LIVE_FRAC );
+	double const * bg_protons = table->Column( CS_BG_PROTONS );
+	double const * bg_protons_unc = table->Column( CS_BG_PROTONS_UNC );
+	double const * bg_clock = table->Column( CS_BG_CLOCK_TIME );
+	double const * bg_live = table->Column( CS_BG_LIVE_FRAC );
+	double * flux = table->Column( CS_PROTON_FLUX );
+	double * flux_unc = table->Column( CS_PROTON_FLUX_UNC );
+
+	for ( int i = 0; i < table->NumRows(); ++i )
+	{
+		UncertainD fg = { fg_protons[i], fg_protons_unc[i] };
+		UncertainD bg = { bg_protons[i], bg_protons_unc[i] };
+		UncertainD protons = ProtonFlux( 
+			fg, fg_clock[i], fg_live[i], bg, bg_clock[i], bg_live[i] );
+		flux[i] = protons.val;
+		flux_unc[i] = protons.unc;
+	}
+}
+
+void CalcNeutronFlux( ColumnTable * table, NPCrossSection const & np_xsect,
+		Parameters const & params )
+{
+	double const * protons_val = table->Column( CS_PROTON_FLUX );
+	double const * protons_unc = table->Column( CS_PROTON_FLUX_UNC );
+	double const * fg_run = table->Column( CS_FG_RUN_NUMBER );
+	double const * energy = table->Column( CS_NEUTRON_ENERGY );
+	double const * det_area = table->Column( CS_DET_AREA );
+	double const * det_dist = table->Column( CS_DET_DISTANCE );
+	double const * ch2_area = table->Column( CS_CH2_AREA );
+	double const * ch2_dist = table->Column( CS_CH2_DISTANCE );
+	double const * ch2_thickness = table->Column( CS_CH2_THICKNESS );
+	double * flux = table->Column( CS_NEUTRON_FLUX );
+	double * flux_unc = table->Column( CS_NEUTRON_FLUX_UNC );
+
+	vector<double> sigma_np( table->NumRows() );
+	vector<int> out_of_range;
+	if ( table->NumRows() > 0 )
+		np_xsect.Eval( table->NumRows(), energy, &sigma_np[0], 0, &out_of_range );
+	for ( int i = 0; i < out_of_range.size(); ++i )
+		LogMessage( LOG_WARNING, TString::Format( 
+			"Run %g: neutron energy %g MeV is outside the n-p cross section table",
+			fg_run[out_of_range[i]], energy[out_of_range[i]] ) );
+
+	for ( int i = 0; i < table->NumRows(); ++i )
+	{
+		UncertainD protons = { protons_val[i], protons_unc[i] };
+		double ch2_nH = CalcThicknessH_CH2( ch2_thickness[i], params.ch2_density );
+		double ch2_sang = CalcSolidAngle( ch2_area[i], ch2_dist[i] );
+		double det_sang = CalcSolidAngle( det_area[i], det_dist[i] );
+
+		UncertainD neutrons = CalcNeutronFlux( 
+			protons, sigma_np[i], ch2_nH, ch2_sang, det_sang );
+		flux[i] = neutrons.val;
+		flux_unc[i] = neutrons.unc;
+	}
+}
+
+void CalcN2NCrossSection( ColumnTable * table, Parameters const & params )
+{
+	double const * neutrons_val = table->Column( CS_NEUTRON_FLUX );
+	double const * neutrons_unc = table->Column( CS_NEUTRON_FLUX_UNC );
+	double const * time = table->Column( CS_FG_CLOCK_TIME );
+
+	double const * ch2_decay = table->Column( CS_CH2_DECAY );
+	double const * ch2_decay_unc = table->Column( CS_CH2_DECAY_UNC );
+	double const * ch2_area = table->Column( CS_CH2_AREA );
+	double const * ch2_dist = table->Column( CS_CH2_DISTANCE );
+	double const * ch2_thickness = table->Column( CS_CH2_THICKNESS );
+	double * ch2_xsect = table->Column( CS_CH2_XSECT );
+	double * ch2_xsect_unc = table->Column( CS_CH2_XSECT_UNC );
+
+	double const * c12_decay = table->Column( CS_C12_DECAY );
+	double const * c12_decay_unc = table->Column( CS_C12_DECAY_UNC );
+	double const * c12_area = table->Column( CS_C12_AREA );
+	double const * c12_dist = table->Column( CS_C12_DISTANCE );
+	double const * c12_thickness = table->Column( CS_C12_THICKNESS );
+	double * c12_xsect = table->Column( CS_C12_XSECT );
+	double * c12_xsect_unc = table->Column( CS_C12_XSECT_UNC );
+
+	for ( int i = 0; i < table->NumRows(); ++i )
+	{
+		UncertainD neutrons = { neutrons_val[i], neutrons_unc[i] };
+
+		UncertainD ch2 = { ch2_decay[i], ch2_decay_unc[i] };
+		UncertainD sigma_ch2 = CalcN2NCrossSection( ch2, neutrons, time[i],
+			CalcThicknessC_CH2( ch2_thickness[i], params.ch2_density ),
+			CalcSolidAngle( ch2_area[i], ch2_dist[i] ), params.half_life );
+		ch2_xsect[i] = sigma_ch2.val;
+		ch2_xsect_unc[i] = sigma_ch2.unc;
+
+		UncertainD c12 = { c12_decay[i], c12_decay_unc[i] };
+		UncertainD sigma_c12 = CalcN2NCrossSection( c12, neutrons, time[i],
+			CalcThicknessC_C12( c12_thickness[i], params.c12_density ),
+			CalcSolidAngle( c12_area[i], c12_dist[i] ), params.half_life );
+		c12_xsect[i] = sigma_c12.val;
+		c12_xsect_unc[i] = sigma_c12.unc;
+	}
+}
+
 } // namespace calculate
 
 void CrossSection::Calculate()
 {
+	vector<int> rows;
 	for ( int i = 3; i < NumRows(); ++i )
-	{
-		vector<string> row = GetRow( i );
-
-		// CH2 target
-		UncertainD ch2_area = n2n::ReadUncertainD( row, CS_CH2_AREA, CS_CH2_AREA_UNC );
-		UncertainD ch2_distance = n2n::ReadUncertainD( row, CS_CH2_DISTANCE, CS_CH2_DISTANCE_UNC );
-		UncertainD ch2_thickness = n2n::ReadUncertainD( row, CS_CH2_THICKNESS, CS_CH2_THICKNESS_UNC );
-		UncertainD ch2_decay = n2n::ReadUncertainD( row, CS_CH2_DECAY, CS_CH2_DECAY_UNC );
-
-		// C12 target
-		UncertainD c12_area = n2n::ReadUncertainD( row, CS_C12_AREA, CS_C12_AREA_UNC );
-		UncertainD c12_distance = n2n::ReadUncertainD( row, CS_C12_DISTANCE, CS_C12_DISTANCE_UNC );
-		UncertainD c12_thickness = n2n::ReadUncertainD( row, CS_C12_THICKNESS, CS_C12_THICKNESS_UNC );
-		UncertainD c12_decay = n2n::ReadUncertainD( row, CS_C12_DECAY, CS_C12_DECAY_UNC );
-
-		// Calculate the proton flux
-		UncertainD fg_protons = n2n::ReadUncertainD( row, CS_FG_PROTONS, CS_FG_PROTONS_UNC );
-		UncertainD bg_protons = n2n::ReadUncertainD( row, CS_BG_PROTONS, CS_BG_PROTONS_UNC );
-
-		double fg_clock = atof( row[CS_FG_CLOCK_TIME].c_str() );
-		double fg_live = atof( row[CS_FG_LIVE_FRAC].c_str() );
-		double bg_clock = atof( row[CS_BG_CLOCK_TIME].c_str() );
-		double bg_live = atof( row[CS_BG_LIVE_FRAC].c_str() );
-
-		UncertainD protons = calculate::ProtonFlux( 
-			fg_protons, fg_clock, fg_live, bg_protons, bg_clock, bg_live );
-		n2n::WriteUncertainD( protons, &row, CS_PROTON_FLUX, CS_PROTON_FLUX_UNC );
+		rows.push_back( i );
+	Calculate( rows );
+}
 
-		// Calculate the neutron flux
-		double area_det  = atof( row[CS_DET_AREA].c_str() );
-		double dist_det  = atof( row[CS_DET_DISTANCE].c_str() );
-		double sang_det = calculate::CalcSolidAngle( area_det, dist_det );
+/**
+ * The columns each calculated value depends on. The proton flux depends on
+ * the protons, clock times and live fractions; the neutron flux also on the 
+ * energy and the geometry of the detector and the CH2 target; the cross 
+ * sections also on the C11 decays and the geometry of both targets.
+ */
+int const CALC_INPUTS[] = {
+	CS_FG_PROTONS, CS_FG_PROTONS_UNC, CS_FG_CLOCK_TIME, CS_FG_LIVE_FRAC,
+	CS_BG_PROTONS, CS_BG_PROTONS_UNC, CS_BG_CLOCK_TIME, CS_BG_LIVE_FRAC,
+	CS_NEUTRON_ENERGY, CS_DET_AREA, CS_DET_DISTANCE, 
+	CS_CH2_AREA, CS_CH2_DISTANCE, CS_CH2_THICKNESS,
+	CS_CH2_DECAY, CS_CH2_DECAY_UNC,
+	CS_C12_AREA, CS_C12_DISTANCE, CS_C12_THICKNESS,
+	CS_C12_DECAY, CS_C12_DECAY_UNC
+};
+
+int const CALC_OUTPUTS[] = {
+	CS_PROTON_FLUX, CS_PROTON_FLUX_UNC,
+	CS_NEUTRON_FLUX, CS_NEUTRON_FLUX_UNC,
+	CS_CH2_XSECT, CS_CH2_XSECT_UNC,
+	CS_C12_XSECT, CS_C12_XSECT_UNC
+};
+
+int const NUM_CALC_INPUTS = sizeof( CALC_INPUTS ) / sizeof( CALC_INPUTS[0] );
+int const NUM_CALC_OUTPUTS = sizeof( CALC_OUTPUTS ) / sizeof( CALC_OUTPUTS[0] );
+
+void CrossSection::Calculate( vector<int> const & rows )
+{
+	ProfileTimer timer( "cross_calculate" );
 
-		double energy  = atof( row[CS_NEUTRON_ENERGY].c_str() );
-		double sigma_np = calculate::CalcNPCrossSection( energy );
+	// Skip the rows which are up to date
+	vector<int> changed;
+	vector<Fingerprint> inputs;
+	if ( deps_ )
+	{
+		Fingerprint common;
+		params_.AddTo( &common, PAR_DENSITY | PAR_HALF_LIFE );
+		np_xsect_->AddTo( &common );
+		for ( int i = 0; i < rows.size(); ++i )
+		{
+			vector<string> row = GetRow( rows[i] );
+			Fingerprint fp = common;
+			fp.Add( row, CALC_INPUTS, NUM_CALC_INPUTS );
+			inputs.push_back( fp );
+			fp.Add( row, CALC_OUTPUTS, NUM_CALC_OUTPUTS );
+			if ( deps_->Unchanged( TString::Format( "cross row %d", rows[i] + 1 ), fp ) )
+				inputs.pop_back();
+			else
+				changed.push_back( rows[i] );
+		}
+		ProfileCount( "cross_calculate", "skipped", rows.size() - changed.size() );
+	}
+	vector<int> const & todo = deps_ ? changed : rows;
 
-		double ch2_sang = calculate::CalcSolidAngle( ch2_area.val, ch2_distance.val );
-		double ch2_nH = calculate::CalcThicknessH_CH2( ch2_thickness.val );
-		double ch2_nC = calculate::CalcThicknessC_CH2( ch2_thickness.val );
+	ProfileCount( "cross_calculate", "rows", todo.size() );
+	ColumnTable table;
+	table.Load( *this, todo, CS_NUM_COLUMNS );
 
-		double c12_sang = calculate::CalcSolidAngle( c12_area.val, c12_distance.val );
-		double c12_nC = calculate::CalcThicknessC_C12( c12_thickness.val );
+	calculate::ProtonFlux( &table );
+	calculate::CalcNeutronFlux( &table, *np_xsect_, params_ );
+	calculate::CalcN2NCrossSection( &table, params_ );
 
-		UncertainD neutrons = calculate::CalcNeutronFlux( 
-			protons, sigma_np, ch2_nH, ch2_sang, sang_det );
-		n2n::WriteUncertainD( neutrons, &row, CS_NEUTRON_FLUX, CS_NEUTRON_FLUX_UNC );
+	table.Store( this, vector<int>( CALC_OUTPUTS, CALC_OUTPUTS + NUM_CALC_OUTPUTS ) );
 
-		// Calculate cross sections
-		UncertainD sigma_n2n_ch2 = calculate::CalcN2NCrossSection( 
-			ch2_decay, neutrons, fg_clock, ch2_nC, ch2_sang );
-		UncertainD sigma_n2n_c12 = calculate::CalcN2NCrossSection( 
-			c12_decay, neutrons, fg_clock, c12_nC, c12_sang );
-		n2n::WriteUncertainD( sigma_n2n_ch2, &row, CS_CH2_XSECT, CS_CH2_XSECT_UNC );
-		n2n::WriteUncertainD( sigma_n2n_c12, &row, CS_C12_XSECT, CS_C12_XSECT_UNC );
+	for ( int i = 0; i < inputs.size(); ++i )
+	{
+		inputs[i].Add( GetRow( todo[i] ), CALC_OUTPUTS, NUM_CALC_OUTPUTS );
+		deps_->Record( TString::Format( "cross row %d", todo[i] + 1 ), inputs[i] );
+	}
+}
 
-		SetRow( i, row );
+void CrossSection::ScanRegion( int row_number, SummedArea const & fg, 
+		SummedArea const & bg, Region const & nominal,
+		int step, int num_steps, vector<ScanPoint> * points ) const
+{
+	vector<CSVField> row;
+	GetFields( row_number, &row );
+	double fg_clock = row[CS_FG_CLOCK_TIME].ToDouble();
+	double fg_live = row[CS_FG_LIVE_FRAC].ToDouble();
+	double bg_clock = row[CS_BG_CLOCK_TIME].ToDouble();
+	double bg_live = row[CS_BG_LIVE_FRAC].ToDouble();
+
+	points->clear();
+	for ( int i = -num_steps; i <= num_steps; ++i )
+	for ( int j = -num_steps; j <= num_steps; ++j )
+	for ( int k = -num_steps; k <= num_steps; ++k )
+	for ( int l = -num_steps; l <= num_steps; ++l )
+	{
+		ScanPoint point;
+		point.roi.min_x = nominal.min_x + i * step;
+		point.roi.max_x = nominal.max_x + j * step;
+		point.roi.min_y = nominal.min_y + k * step;
+		point.roi.max_y = nominal.max_y + l * step;
+		if ( point.roi.min_x > point.roi.max_x || 
+				point.roi.min_y > point.roi.max_y )
+			continue;
+
+		point.fg_protons = fg.CountsInRegion( point.roi );
+		point.bg_protons = bg.CountsInRegion( point.roi );
+
+		UncertainD fg_protons = { (double) point.fg_protons, sqrt( (double) point.fg_protons ) };
+		UncertainD bg_protons = { (double) point.bg_protons, sqrt( (double) point.bg_protons ) };
+		point.flux = calculate::ProtonFlux( 
+			fg_protons, fg_clock, fg_live, bg_protons, bg_clock, bg_live );
+		points->push_back( point );
 	}
 }
 
@@ -4,6 +4,7 @@
  */
 
 #include "CrossSection.hxx"
+#include "Profile.hxx"
 
 namespace n2n {
 namespace loadsum {
@@ -22,25 +23,33 @@ void UpdateRunData( vector<string> & row, vector<string> const & fg, vector<stri
 	row[CS_BG_LIVE_FRAC_UNC] = "0";
 }
 
-void UpdateGeometry( vector<string> & row )
+/**
+ * Format a parameter exactly, but without needless digits.
+ */
+string FormatParameter( double value )
+{
+	return TString::Format( "%.15g", value ).Data();
+}
+
+void UpdateGeometry( vector<string> & row, Parameters const & params )
 {
-	row[CS_DET_AREA]	= "0.7133";	// cm^2
+	row[CS_DET_AREA]	= FormatParameter( params.det_area );
 	row[CS_DET_AREA_UNC]	= "0";
-	row[CS_DET_DISTANCE]	= "12.07";	// cm
+	row[CS_DET_DISTANCE]	= FormatParameter( params.det_distance );
 	row[CS_DET_DISTANCE_UNC] = "0";
 
-	row[CS_CH2_AREA]	= "5.067075";	// cm^2
+	row[CS_CH2_AREA]	= FormatParameter( params.ch2_area );
 	row[CS_CH2_AREA_UNC]	= "0";
-	row[CS_CH2_DISTANCE]	= "6.46";	// cm
+	row[CS_CH2_DISTANCE]	= FormatParameter( params.ch2_distance );
 	row[CS_CH2_DISTANCE_UNC] = "0";
-	row[CS_CH2_THICKNESS]	= "0.164";	// cm
+	row[CS_CH2_THICKNESS]	= FormatParameter( params.ch2_thickness );
 	row[CS_CH2_THICKNESS_UNC] = "0";
 
-	row[CS_C12_AREA]	= "43.20869";	// cm^2
+	row[CS_C12_AREA]	= FormatParameter( params.c12_area );
 	row[CS_C12_AREA_UNC]	= "0";
-	row[CS_C12_DISTANCE]	= "14.52";	// cm
+	row[CS_C12_DISTANCE]	= FormatParameter( params.c12_distance );
 	row[CS_C12_DISTANCE_UNC] = "0";
-	row[CS_C12_THICKNESS]	= "0.889";	// cm
+	row[CS_C12_THICKNESS]	= FormatParameter( params.c12_thickness );
 	row[CS_C12_THICKNESS_UNC] = "0";
 }
 
@@ -56,7 +65,8 @@ void UpdateCalcValues( vector<string> & row, vector<string> const & fg, vector<s
 	row[CS_C12_DECAY_UNC]	= fg[RS_C12_DECAY_ERR];
 }
 
-void UpdateSummary( vector<string> & row, RunSummary const * const summary )
+void UpdateSummary( vector<string> & row, RunSummary const * const summary,
+		Parameters const & params )
 {
 	int fg_run_number = atoi( row[CS_FG_RUN_NUMBER].c_str() );
 	int bg_run_number = atoi( row[CS_BG_RUN_NUMBER].c_str() );
@@ -68,7 +78,7 @@ void UpdateSummary( vector<string> & row, RunSummary const * const summary )
 	assert( bg.size() == RS_NUM_COLUMNS );
 
 	loadsum::UpdateRunData( row, fg, bg );
-	loadsum::UpdateGeometry( row );
+	loadsum::UpdateGeometry( row, params );
 	loadsum::UpdateCalcValues( row, fg, bg );
 }
 
@@ -76,11 +86,50 @@ void UpdateSummary( vector<string> & row, RunSummary const * const summary )
 
 void CrossSection::LoadSummary( RunSummary const * const summary )
 {
+	vector<int> rows;
+	for ( int i = 3; i < NumRows(); ++i )
+		rows.push_back( i );
+	LoadSummary( summary, rows );
+}
+
+void CrossSection::LoadSummary( RunSummary const * const summary, 
+		vector<int> const & rows )
+{
+	ProfileTimer timer( "cross_loadsum" );
+	ProfileCount( "cross_loadsum", "rows", rows.size() );
+	for ( int i = 0; i < rows.size(); ++i )
+	{
+		vector<string> row = GetRow( rows[i] );
+		loadsum::UpdateSummary( row, summary, params_ );
+		SetRow( rows[i], row );
+	}
+}
+
+void CrossSection::FindRun( int run_number, vector<int> * rows ) const
+{
+	rows->clear();
+	vector<CSVField> fields;
+	for ( int i = 3; i < NumRows(); ++i )
+	{
+		GetFields( i, &fields );
+		if ( fields.size() > CS_BG_RUN_NUMBER && 
+				(fields[CS_FG_RUN_NUMBER].ToInt() == run_number || 
+				 fields[CS_BG_RUN_NUMBER].ToInt() == run_number) )
+			rows->push_back( i );
+	}
+}
+
+void CrossSection::FindRuns( int first_run, int last_run, vector<int> * rows ) const
+{
+	rows->clear();
+	vector<CSVField> fields;
 	for ( int i = 3; i < NumRows(); ++i )
 	{
-		vector<string> row = GetRow( i );
-		loadsum::UpdateSummary( row, summary );
-		SetRow( i, row );
+		GetFields( i, &fields );
+		if ( fields.size() > CS_FG_RUN_NUMBER && 
+				fields[CS_FG_RUN_NUMBER].ToInt() >= first_run && 
+				fields[CS_FG_RUN_NUMBER].ToInt() <= last_run )
+			rows->push_back( i );
 	}
 }
 
@@ -0,0 +1,293 @@
+/**
+ * @file n2n/CrossSection_montecarlo.cxx
+ * Copyright (C) 2013 Houghton College
+ */
+
+#include "CrossSection.hxx"
+#include "calculate.hxx"
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <thread>
+
+namespace n2n {
+
+/**
+ * Inputs to the cross section calculation which are sampled.
+ * Inputs after MC_DET_AREA describe the apparatus, and are correlated
+ * between rows.
+ */
+enum MCInputs {
+	MC_FG_PROTONS,
+	MC_FG_CLOCK_TIME,
+	MC_FG_LIVE_FRAC,
+	MC_BG_PROTONS,
+	MC_BG_CLOCK_TIME,
+	MC_BG_LIVE_FRAC,
+	MC_NEUTRON_ENERGY,
+	MC_CH2_DECAY,
+	MC_C12_DECAY,
+	MC_DET_AREA,
+	MC_DET_DISTANCE,
+	MC_CH2_AREA,
+	MC_CH2_DISTANCE,
+	MC_CH2_THICKNESS,
+	MC_C12_AREA,
+	MC_C12_DISTANCE,
+	MC_C12_THICKNESS,
+	MC_NUM_INPUTS
+};
+
+/**
+ * The column of each of MCInputs.
+ */
+int const MC_COLUMNS[MC_NUM_INPUTS] = {
+	CS_FG_PROTONS, CS_FG_CLOCK_TIME, CS_FG_LIVE_FRAC,
+	CS_BG_PROTONS, CS_BG_CLOCK_TIME, CS_BG_LIVE_FRAC,
+	CS_NEUTRON_ENERGY, CS_CH2_DECAY, CS_C12_DECAY,
+	CS_DET_AREA, CS_DET_DISTANCE,
+	CS_CH2_AREA, CS_CH2_DISTANCE, CS_CH2_THICKNESS,
+	CS_C12_AREA, CS_C12_DISTANCE, CS_C12_THICKNESS
+};
+
+/**
+ * Number of samples calculated together. Must be even, so that both
+ * normal deviates of each Box-Muller pair land in the same batch.
+ */
+int const MC_BATCH_SIZE = 4096;
+
+/**
+ * Scramble the bits of a 64-bit integer (the splitmix64 finalizer).
+ */
+inline ULong64_t MCMix( ULong64_t z )
+{
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+/**
+ * Fill an array with standard normal deviates. Deviate i is a function
+ * of the stream and first + i only, so any range of samples can be
+ * generated independently of the others.
+ * @param stream Identifies the random number stream.
+ * @param first The number of the first sample; must be even.
+ * @param n The number of samples.
+ * @param z Filled with n deviates.
+ */
+void MCNormals( ULong64_t stream, int first, int n, double * z )
+{
+	double const scale = 1.0 / 9007199254740992.0;	// 2^-53
+	double const two_pi = TMath::TwoPi();
+	for ( int i = 0; i < n; i += 2 )
+	{
+		ULong64_t pair = (first + i) / 2;
+		ULong64_t h1 = MCMix( stream ^ MCMix( 2 * pair ) );
+		ULong64_t h2 = MCMix( stream ^ MCMix( 2 * pair + 1 ) );
+		double u1 = ((h1 >> 11) + 1) * scale;	// (0,1]
+		double u2 = (h2 >> 11) * scale;		// [0,1)
+		double r = sqrt( -2 * log( u1 ) );
+		z[i] = r * cos( two_pi * u2 );
+		if ( i + 1 < n )
+			z[i + 1] = r * sin( two_pi * u2 );
+	}
+}
+
+/**
+ * Rows to be sampled, shared between worker threads.
+ */
+struct MCTask
+{
+	int num_samples;			///< Samples per row
+	int num_batches;			///< Batches per row
+	NPCrossSection const * np_xsect;	///< n-p cross sections at 0 deg
+	Parameters const * params;		///< Densities and half-life of C11
+	atomic<int> next;			///< Index of the next batch
+	UncertainD inputs[MC_NUM_INPUTS];	///< Inputs of the current row
+	ULong64_t streams[MC_NUM_INPUTS];	///< Random stream of each input
+	vector<double> proton_flux;		///< Samples of the current row
+	vector<double> neutron_flux;		///< Samples of the current row
+	vector<double> ch2_xsect;		///< Samples of the current row
+	vector<double> c12_xsect;		///< Samples of the current row
+};
+
+/**
+ * Calculate batches of samples of the current row until none remain.
+ */
+void SampleBatches( MCTask * task )
+{
+	// One array per input, then scratch space
+	vector<double> buffer( (MC_NUM_INPUTS + 4) * MC_BATCH_SIZE );
+	double * x[MC_NUM_INPUTS];
+	for ( int k = 0; k < MC_NUM_INPUTS; ++k )
+		x[k] = &buffer[k * MC_BATCH_SIZE];
+	double * sigma_np = &buffer[MC_NUM_INPUTS * MC_BATCH_SIZE];
+	double * ch2_nH = sigma_np + MC_BATCH_SIZE;
+	double * ch2_sang = ch2_nH + MC_BATCH_SIZE;
+	double * activation = ch2_sang + MC_BATCH_SIZE;
+
+	// 1 min = 60 s
+	double const decay = TMath::Log( 2 ) / (task->params->half_life * 60);	// (1/s)
+
+	int b;
+	while ( (b = task->next++) < task->num_batches )
+	{
+		int first = b * MC_BATCH_SIZE;
+		int n = min( MC_BATCH_SIZE, task->num_samples - first );
+
+		for ( int k = 0; k < MC_NUM_INPUTS; ++k )
+		{
+			double val = task->inputs[k].val;
+			double unc = task->inputs[k].unc;
+			double * xk = x[k];
+			if ( unc == 0 )
+			{
+				fill( xk, xk + n, val );
+				continue;
+			}
+			MCNormals( task->streams[k], first, n, xk );
+			for ( int i = 0; i < n; ++i )
+				xk[i] = val + unc * xk[i];
+		}
+
+		if ( task->inputs[MC_NEUTRON_ENERGY].unc == 0 )
+			fill( sigma_np, sigma_np + n, task->np_xsect->Eval(
+					task->inputs[MC_NEUTRON_ENERGY].val ) );
+		else
+			task->np_xsect->Eval( n, x[MC_NEUTRON_ENERGY], sigma_np );
+
+		double * protons = &task->proton_flux[first];
+		double * neutrons = &task->neutron_flux[first];
+		double * ch2_xsect = &task->ch2_xsect[first];
+		double * c12_xsect = &task->c12_xsect[first];
+
+		for ( int i = 0; i < n; ++i )
+		{
+			protons[i] =
+				x[MC_FG_PROTONS][i] / (x[MC_FG_CLOCK_TIME][i] * x[MC_FG_LIVE_FRAC][i]) -
+				x[MC_BG_PROTONS][i] / (x[MC_BG_CLOCK_TIME][i] * x[MC_BG_LIVE_FRAC][i]);
+			ch2_nH[i] = calculate::CalcThicknessH_CH2( x[MC_CH2_THICKNESS][i],
+					task->params->ch2_density );
+			ch2_sang[i] = calculate::CalcSolidAngle(
+					x[MC_CH2_AREA][i], x[MC_CH2_DISTANCE][i] );
+			activation[i] = 1 - exp( -decay * x[MC_FG_CLOCK_TIME][i] );
+		}
+
+		// 1 mbarn = 1e-3 barn
+		for ( int i = 0; i < n; ++i )
+			neutrons[i] = protons[i] / (sigma_np[i] * ch2_nH[i] * ch2_sang[i] *
+				calculate::CalcSolidAngle( x[MC_DET_AREA][i], x[MC_DET_DISTANCE][i] ) *
+				1e-3);
+
+		for ( int i = 0; i < n; ++i )
+		{
+			ch2_xsect[i] = x[MC_CH2_DECAY][i] * decay / (
+				calculate::CalcThicknessC_CH2( x[MC_CH2_THICKNESS][i],
+					task->params->ch2_density ) *
+				neutrons[i] * ch2_sang[i] * 1e-3 * activation[i] );
+			c12_xsect[i] = x[MC_C12_DECAY][i] * decay / (
+				calculate::CalcThicknessC_C12( x[MC_C12_THICKNESS][i],
+					task->params->c12_density ) *
+				neutrons[i] *
+				calculate::CalcSolidAngle( x[MC_C12_AREA][i], x[MC_C12_DISTANCE][i] ) *
+				1e-3 * activation[i] );
+		}
+	}
+}
+
+/**
+ * Summarize samples. The samples are reordered.
+ * @return The summary, which is all NaN if there are no samples.
+ */
+MCSummary SummarizeSamples( vector<double> * samples )
+{
+	int n = samples->size();
+	if ( n == 0 )
+	{
+		double const nan = numeric_limits<double>::quiet_NaN();
+		MCSummary summary = { nan, nan, nan, nan, nan };
+		return summary;
+	}
+
+	double sum = 0;
+	for ( int i = 0; i < n; ++i )
+		sum += (*samples)[i];
+
+	MCSummary summary;
+	summary.mean = sum / n;
+
+	double sum2 = 0;
+	for ( int i = 0; i < n; ++i )
+	{
+		double d = (*samples)[i] - summary.mean;
+		sum2 += d * d;
+	}
+	summary.std_dev = n > 1 ? sqrt( sum2 / (n - 1) ) : 0;
+
+	double * p[] = { &summary.p16, &summary.p50, &summary.p84 };
+	double const fractions[] = { 0.16, 0.50, 0.84 };
+	for ( int j = 0; j < 3; ++j )
+	{
+		vector<double>::iterator nth = samples->begin() +
+			(int) (fractions[j] * (n - 1) + 0.5);
+		nth_element( samples->begin(), nth, samples->end() );
+		*p[j] = *nth;
+	}
+	return summary;
+}
+
+void CrossSection::CalculateMonteCarlo( int num_samples, vector<MCRow> * rows,
+		int num_workers, ULong64_t seed ) const
+{
+	ColumnTable table;
+	table.Load( *this, 3, CS_NUM_COLUMNS );
+
+	MCTask task;
+	task.num_samples = num_samples;
+	task.num_batches = (num_samples + MC_BATCH_SIZE - 1) / MC_BATCH_SIZE;
+	task.np_xsect = np_xsect_;
+	task.params = &params_;
+	task.proton_flux.resize( num_samples );
+	task.neutron_flux.resize( num_samples );
+	task.ch2_xsect.resize( num_samples );
+	task.c12_xsect.resize( num_samples );
+
+	if ( num_workers <= 0 )
+		num_workers = thread::hardware_concurrency();
+	if ( num_workers > task.num_batches )
+		num_workers = task.num_batches;
+
+	rows->resize( table.NumRows() );
+	for ( int i = 0; i < table.NumRows(); ++i )
+	{
+		for ( int k = 0; k < MC_NUM_INPUTS; ++k )
+		{
+			task.inputs[k] = table.GetUncertainD( i,
+					MC_COLUMNS[k], MC_COLUMNS[k] + 1 );
+
+			// The apparatus uses the same stream in every row
+			ULong64_t row_key = k < MC_DET_AREA ? i + 1 : 0;
+			task.streams[k] = MCMix( MCMix( MCMix( seed ) ^ row_key ) ^ k );
+		}
+
+		task.next = 0;
+		if ( num_workers > 1 )
+		{
+			vector<thread> workers;
+			for ( int j = 0; j < num_workers; ++j )
+				workers.push_back( thread( SampleBatches, &task ) );
+			for ( int j = 0; j < num_workers; ++j )
+				workers[j].join();
+		}
+		else
+			SampleBatches( &task );
+
+		(*rows)[i].proton_flux = SummarizeSamples( &task.proton_flux );
+		(*rows)[i].neutron_flux = SummarizeSamples( &task.neutron_flux );
+		(*rows)[i].ch2_xsect = SummarizeSamples( &task.ch2_xsect );
+		(*rows)[i].c12_xsect = SummarizeSamples( &task.c12_xsect );
+	}
+}
+
+} // namespace n2n
@@ -0,0 +1,277 @@
+/**
+ * @file n2n/CrossSection_sweep.cxx
+ * Copyright (C) 2013 Houghton College
+ */
+
+#include "CrossSection.hxx"
+#include "pipeline.hxx"
+#include "calculate.hxx"
+#include "Log.hxx"
+#include "Profile.hxx"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <thread>
+
+namespace n2n {
+
+/**
+ * The decay curves of one foreground run, fit once at each half-life of
+ * a sweep.
+ */
+struct SweepRun
+{
+	int run_number;			///< The run
+	double trans_time;		///< Transit time (min)
+	bool have_puck;			///< Whether the graphite was counted
+	bool have_plastic;		///< Whether the CH2 was counted
+	vector<decay::FitResult> puck;		///< Fit of the puck, by half-life
+	vector<decay::FitResult> plastic;	///< Fit of the plastic, by half-life
+};
+
+/**
+ * Work shared between the worker threads of a sweep.
+ */
+struct SweepTask
+{
+	vector<SweepRun> runs;			///< Foreground runs
+	vector<double> half_lives;		///< Distinct half-lives (min)
+	char const * dirname_decay;		///< Directory containing decay curves
+	decay::FitMethod fit_method;		///< Method used to fit decay curves
+	FitCache * cache;			///< Cache of decay fits, or NULL
+
+	ColumnTable const * base;		///< Rows before any parameter is applied
+	vector<int> row_runs;			///< Index in runs of each row
+	NPCrossSection const * np_xsect;	///< n-p cross sections at 0 deg
+	vector<Parameters> const * sets;	///< Parameter sets
+	vector<double> * results;		///< Cross sections of every set and row
+
+	atomic<int> next;			///< Index of the next run or set
+	mutex error_lock;			///< Protects error
+	exception_ptr error;			///< First error thrown by a worker
+};
+
+/**
+ * Parse and fit the decay curves of runs until none remain. Each curve is
+ * fit at every half-life whose fit is not cached, and only parsed if 
+ * there is one.
+ */
+void SweepFitRuns( SweepTask * task )
+{
+	int i;
+	while ( (i = task->next++) < task->runs.size() )
+	{
+		try
+		{
+			SweepRun & run = task->runs[i];
+			ProfileRun profile_run( run.run_number );
+			char const * formats[] = { "Run%03d_puck.csv", "Run%03d_plastic.csv" };
+			bool * have[] = { &run.have_puck, &run.have_plastic };
+			vector<decay::FitResult> * fits[] = { &run.puck, &run.plastic };
+			for ( int j = 0; j < 2; ++j )
+			{
+				TString filename = pipeline::DataPath( task->dirname_decay,
+						TString::Format( formats[j], run.run_number ) );
+
+				// NOTE: TSystem::AccessPathName returns *false* if the file exists!
+				*have[j] = !gSystem->AccessPathName( filename );
+				if ( !*have[j] )
+					continue;
+
+				TGraphErrors * ge = NULL;
+				fits[j]->resize( task->half_lives.size() );
+				for ( int k = 0; k < task->half_lives.size(); ++k )
+				{
+					double half_life = task->half_lives[k];
+					decay::FitResult & fit = (*fits[j])[k];
+					if ( LookupDecayFit( filename, task->cache, task->fit_method,
+								half_life, &fit ) )
+						continue;
+					if ( !ge )
+						ge = decay::ParseDataFile( filename );
+					fit = decay::Fit( ge, task->fit_method, half_life );
+					StoreDecayFit( filename, task->cache, task->fit_method,
+							half_life, fit );
+				}
+				delete ge;
+			}
+		}
+		catch ( ... )
+		{
+			lock_guard<mutex> guard( task->error_lock );
+			if ( !task->error )
+				task->error = current_exception();
+			task->next = task->runs.size();
+		}
+	}
+}
+
+/**
+ * Calculate the cross sections of every row for parameter sets until none
+ * remain.
+ */
+void SweepSets( SweepTask * task )
+{
+	int num_rows = task->base->NumRows();
+	vector<string> scratch( CS_NUM_COLUMNS );
+	int s;
+	while ( (s = task->next++) < task->sets->size() )
+	{
+		Parameters const & params = (*task->sets)[s];
+		ColumnTable table = *task->base;
+
+		// The geometry and the decays pass through text exactly as
+		// LoadSummary writes them
+		loadsum::UpdateGeometry( scratch, params );
+		int const geometry[] = { CS_DET_AREA, CS_DET_DISTANCE,
+			CS_CH2_AREA, CS_CH2_DISTANCE, CS_CH2_THICKNESS,
+			CS_C12_AREA, CS_C12_DISTANCE, CS_C12_THICKNESS };
+		for ( int k = 0; k < sizeof( geometry ) / sizeof( geometry[0] ); ++k )
+			fill( table.Column( geometry[k] ), table.Column( geometry[k] ) + num_rows,
+					atof( scratch[geometry[k]].c_str() ) );
+
+		int h = lower_bound( task->half_lives.begin(), task->half_lives.end(),
+				params.half_life ) - task->half_lives.begin();
+		for ( int i = 0; i < num_rows; ++i )
+		{
+			if ( task->row_runs[i] < 0 )
+				continue;
+			SweepRun const & run = task->runs[task->row_runs[i]];
+			if ( run.have_puck )
+			{
+				UncertainD n_c11 = decay::Counts( run.puck[h], run.trans_time,
+						params.efficiency );
+				WriteUncertainD( n_c11, &scratch, CS_C12_DECAY, CS_C12_DECAY_UNC );
+				table.SetUncertainD( ReadUncertainD( scratch,
+					CS_C12_DECAY, CS_C12_DECAY_UNC ), i, CS_C12_DECAY, CS_C12_DECAY_UNC );
+			}
+			if ( run.have_plastic )
+			{
+				UncertainD n_c11 = decay::Counts( run.plastic[h], run.trans_time,
+						params.efficiency * params.ch2_factor );
+				WriteUncertainD( n_c11, &scratch, CS_CH2_DECAY, CS_CH2_DECAY_UNC );
+				table.SetUncertainD( ReadUncertainD( scratch,
+					CS_CH2_DECAY, CS_CH2_DECAY_UNC ), i, CS_CH2_DECAY, CS_CH2_DECAY_UNC );
+			}
+		}
+
+		calculate::ProtonFlux( &table );
+		calculate::CalcNeutronFlux( &table, *task->np_xsect, params );
+		calculate::CalcN2NCrossSection( &table, params );
+
+		double * out = &(*task->results)[(size_t) s * num_rows * 2];
+		double const * ch2 = table.Column( CS_CH2_XSECT );
+		double const * c12 = table.Column( CS_C12_XSECT );
+		double const nan = numeric_limits<double>::quiet_NaN();
+		for ( int i = 0; i < num_rows; ++i )
+		{
+			bool skipped = task->row_runs[i] < 0;
+			out[2 * i] = skipped ? nan : ch2[i];
+			out[2 * i + 1] = skipped ? nan : c12[i];
+		}
+	}
+}
+
+/**
+ * Run a stage of a sweep on several threads.
+ */
+void SweepRunWorkers( void (*stage)( SweepTask * ), SweepTask * task,
+		int num_workers, int num_items )
+{
+	task->next = 0;
+	if ( num_workers > num_items )
+		num_workers = num_items;
+	if ( num_workers > 1 )
+	{
+		vector<thread> workers;
+		for ( int i = 0; i < num_workers; ++i )
+			workers.push_back( thread( stage, task ) );
+		for ( int i = 0; i < num_workers; ++i )
+			workers[i].join();
+	}
+	else
+		stage( task );
+
+	if ( task->error )
+		rethrow_exception( task->error );
+}
+
+void CrossSection::CalculateSweep( RunSummary const * summary, char const * dirname,
+		vector<Parameters> const & sets, vector<double> * results,
+		int num_workers, decay::FitMethod method ) const
+{
+	ProfileTimer timer( "cross_sweep" );
+	TString dirname_decay = pipeline::DataPath( dirname, "Decay Curves" );
+
+	ColumnTable base;
+	base.Load( *this, 3, CS_NUM_COLUMNS );
+
+	SweepTask task;
+	task.dirname_decay = dirname_decay;
+	task.fit_method = method;
+	task.cache = cache_;
+	task.base = &base;
+	task.np_xsect = np_xsect_;
+	task.sets = &sets;
+	task.results = results;
+	results->assign( sets.size() * base.NumRows() * 2, 0.0 );
+
+	for ( int s = 0; s < sets.size(); ++s )
+		task.half_lives.push_back( sets[s].half_life );
+	sort( task.half_lives.begin(), task.half_lives.end() );
+	task.half_lives.erase( unique( task.half_lives.begin(), task.half_lives.end() ),
+			task.half_lives.end() );
+
+	// Each foreground run is fit once, however many rows use it
+	map<int, int> run_index;
+	double const * fg_run = base.Column( CS_FG_RUN_NUMBER );
+	vector<CSVField> fields;
+	for ( int i = 0; i < base.NumRows(); ++i )
+	{
+		GetFields( i + 3, &fields );
+		if ( fields.size() <= CS_FG_RUN_NUMBER || 
+				fields[CS_FG_RUN_NUMBER].Length() == 0 )
+		{
+			LogMessage( LOG_WARNING, TString::Format(
+				"Cross section row %d has no foreground run, and is skipped",
+				i + 4 ) );
+			task.row_runs.push_back( -1 );
+			continue;
+		}
+
+		int run_number = (int) fg_run[i];
+		if ( !run_index.count( run_number ) )
+		{
+			SweepRun run;
+			run.run_number = run_number;
+			run.trans_time = (int) summary->GetRunValue( run_number, 
+					RS_INTERIM_TIME ) / 60.0;	// min
+			run.have_puck = run.have_plastic = false;
+			run_index[run_number] = task.runs.size();
+			task.runs.push_back( run );
+		}
+		task.row_runs.push_back( run_index[run_number] );
+	}
+	ProfileCount( "cross_sweep", "runs", task.runs.size() );
+	ProfileCount( "cross_sweep", "half_lives", task.half_lives.size() );
+	ProfileCount( "cross_sweep", "sets", sets.size() );
+
+	if ( num_workers <= 0 )
+		num_workers = thread::hardware_concurrency();
+	if ( num_workers > 1 )
+		ROOT::EnableThreadSafety();
+	{
+		ProfileTimer timer( "sweep_fit" );
+		decay::MinimizerScope minimizer;
+		SweepRunWorkers( SweepFitRuns, &task, num_workers, task.runs.size() );
+	}
+	{
+		ProfileTimer timer( "sweep_calculate" );
+		SweepRunWorkers( SweepSets, &task, num_workers, sets.size() );
+	}
+}
+
+} // namespace n2n
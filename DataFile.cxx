@@ -0,0 +1,282 @@
+/** 
+ * @file n2n/DataFile.cxx
+ * Copyright (C) 2013 Houghton College
+ */
+
+#include "DataFile.hxx"
+
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+
+namespace n2n {
+
+/**
+ * Check for a character which separates values in a row.
+ */
+inline bool IsSpace( char c )
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+/**
+ * Parse an integer, advancing past it.
+ * @return False if there is no integer at the position, or it does not
+ * fit in an Int_t.
+ */
+inline bool ParseInt( char const ** pos, Int_t * value )
+{
+	char const * p = *pos;
+	bool negative = ( *p == '-' );
+	if ( *p == '-' || *p == '+' )
+		++p;
+	if ( *p < '0' || *p > '9' )
+		return false;
+
+	Long64_t v = 0;
+	while ( *p >= '0' && *p <= '9' )
+	{
+		v = v * 10 + (*p++ - '0');
+		if ( v > (Long64_t) INT_MAX + negative )
+			return false;
+	}
+
+	*value = negative ? -v : v;
+	*pos = p;
+	return true;
+}
+
+/**
+ * Parse a decimal number, advancing past it.
+ * @return False if there is no number at the position.
+ */
+inline bool ParseDouble( char const ** pos, double * value )
+{
+	// Powers of ten which are exactly representable as doubles
+	static double const powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7,
+		1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18,
+		1e19, 1e20, 1e21, 1e22 };
+
+	char const * p = *pos;
+	bool negative = ( *p == '-' );
+	if ( *p == '-' || *p == '+' )
+		++p;
+
+	unsigned long long mantissa = 0;
+	int digits = 0, exponent = 0;
+	for ( ; *p >= '0' && *p <= '9'; ++p, ++digits )
+		mantissa = mantissa * 10 + (*p - '0');
+	if ( *p == '.' )
+	{
+		for ( ++p; *p >= '0' && *p <= '9'; ++p, ++digits )
+			mantissa = mantissa * 10 + (*p - '0'), --exponent;
+	}
+	if ( digits == 0 )
+		return false;
+
+	// Up to 15 digits the mantissa is exact, so one multiplication or
+	// division by an exact power of ten rounds correctly
+	bool exact = ( digits <= 15 );
+	if ( *p == 'e' || *p == 'E' )
+	{
+		char const * e = p + 1;
+		Int_t exp_value;
+		if ( ParseInt( &e, &exp_value ) && exp_value > -1000 && exp_value < 1000 )
+			exponent += exp_value, p = e;
+		else
+			exact = false;
+	}
+
+	if ( exact && exponent >= -22 && exponent <= 22 )
+	{
+		double v = (double) mantissa;
+		v = exponent < 0 ? v / powers[-exponent] : v * powers[exponent];
+		*value = negative ? -v : v;
+	}
+	else
+	{
+		// Too many digits or too large an exponent to convert exactly, so
+		// leave it to strtod
+		char * end;
+		*value = strtod( *pos, &end );
+		p = end;
+	}
+
+	*pos = p;
+	return true;
+}
+
+
+void DataFile::Load( char const * filename )
+{
+	filename_ = filename;
+	buffer_.clear();
+
+	ifstream is( filename, ios::in | ios::binary );
+	if ( !is )
+	{
+		cerr << "Could not read data file: " << filename << endl;
+		throw runtime_error( "Missing data file" );
+	}
+
+	is.seekg( 0, ios::end );
+	streamoff size = is.tellg();
+	if ( size > 0 )
+	{
+		buffer_.resize( size );
+		is.seekg( 0, ios::beg );
+		is.read( &buffer_[0], size );
+		buffer_.resize( is.gcount() );
+	}
+}
+
+bool DataFile::StartsWith( char const * marker ) const
+{
+	return buffer_.compare( 0, strlen( marker ), marker ) == 0;
+}
+
+string::size_type DataFile::FindSection( char const * marker,
+		string::size_type offset ) const
+{
+	string::size_type length = strlen( marker );
+	char const * begin = buffer_.c_str();
+	char const * end = begin + buffer_.size();
+
+	char const * p = begin + offset;
+	while ( p < end && (p = (char const *) memchr( p, '[', end - p )) != NULL )
+	{
+		bool line_start = ( p == begin || p[-1] == '\n' );
+		if ( line_start && end - p >= length && memcmp( p, marker, length ) == 0 )
+		{
+			char const * q = p + length;
+			while ( q < end && IsSpace( *q ) )
+				++q;
+			if ( q == end )
+				return buffer_.size();
+			if ( *q == '\n' )
+				return q + 1 - begin;
+		}
+		++p;
+	}
+
+	return string::npos;
+}
+
+bool DataFile::NextRow( string::size_type * offset, int num_values, 
+		Int_t * values ) const
+{
+	if ( !SkipToRow( offset ) )
+		return false;
+
+	char const * p = buffer_.c_str() + *offset;
+	for ( int i = 0; i < num_values; ++i )
+	{
+		while ( IsSpace( *p ) )
+			++p;
+		if ( !ParseInt( &p, &values[i] ) )
+			Error( *offset, "expected an integer" );
+	}
+	while ( IsSpace( *p ) )
+		++p;
+	if ( *p != '\n' && *p != '\0' )
+		Error( *offset, "unexpected text after the last value" );
+
+	*offset = p - buffer_.c_str() + ( *p == '\n' ? 1 : 0 );
+	return true;
+}
+
+bool DataFile::NextRow( string::size_type * offset, int num_values, 
+		double * values ) const
+{
+	if ( !SkipToRow( offset ) )
+		return false;
+
+	char const * p = buffer_.c_str() + *offset;
+	for ( int i = 0; i < num_values; ++i )
+	{
+		while ( IsSpace( *p ) )
+			++p;
+		if ( !ParseDouble( &p, &values[i] ) )
+			Error( *offset, "expected a number" );
+	}
+	while ( IsSpace( *p ) )
+		++p;
+	if ( *p != '\n' && *p != '\0' )
+		Error( *offset, "unexpected text after the last value" );
+
+	*offset = p - buffer_.c_str() + ( *p == '\n' ? 1 : 0 );
+	return true;
+}
+
+bool DataFile::NextLine( string::size_type * offset, string * line ) const
+{
+	if ( *offset >= buffer_.size() )
+		return false;
+
+	string::size_type end = buffer_.find( '\n', *offset );
+	if ( end == string::npos )
+		end = buffer_.size();
+	string::size_type length = end - *offset;
+	if ( length > 0 && buffer_[end - 1] == '\r' )
+		--length;
+	line->assign( buffer_, *offset, length );
+	*offset = end + 1;
+	return true;
+}
+
+int DataFile::LineNumber( string::size_type offset ) const
+{
+	int line = 1;
+	char const * p = buffer_.c_str();
+	char const * end = p + (offset < buffer_.size() ? offset : buffer_.size());
+	while ( (p = (char const *) memchr( p, '\n', end - p )) != NULL )
+		++line, ++p;
+	return line;
+}
+
+string::size_type DataFile::Size() const
+{
+	return buffer_.size();
+}
+
+char const * DataFile::Filename() const
+{
+	return filename_.c_str();
+}
+
+bool DataFile::SkipToRow( string::size_type * offset ) const
+{
+	char const * begin = buffer_.c_str();
+	char const * end = begin + buffer_.size();
+	char const * p = begin + *offset;
+
+	while ( p < end )
+	{
+		char const * q = p;
+		while ( q < end && IsSpace( *q ) )
+			++q;
+		if ( q == end )
+			break;
+		if ( *q == '\n' )
+		{
+			p = q + 1;
+			continue;
+		}
+		if ( *q == '[' )
+			break;
+
+		*offset = p - begin;
+		return true;
+	}
+
+	*offset = p - begin;
+	return false;
+}
+
+void DataFile::Error( string::size_type offset, char const * message ) const
+{
+	cerr << filename_ << ":" << LineNumber( offset ) << ": " << message << endl;
+	throw runtime_error( "Malformed data file" );
+}
+
+} // namespace n2n
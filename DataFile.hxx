@@ -0,0 +1,105 @@
+/** 
+ * @file n2n/DataFile.hxx
+ * Copyright (C) 2013 Houghton College
+ */
+
+#ifndef N2N_DATAFILE_INCL_
+#define N2N_DATAFILE_INCL_
+
+#include <string>
+
+namespace n2n {
+
+/**
+ * The contents of a text data file produced by MPA4, read with a single 
+ * read and parsed in place.
+ *
+ * Sections are found by scanning for their markers, e.g. "[DATA]", and the
+ * rows of numbers in a section are parsed without the C++ streams or the 
+ * locale. Malformed rows are reported with their line number.
+ */
+struct DataFile
+{
+	public:
+		/**
+		 * Read a file into memory.
+		 * @param filename The file to read.
+		 */
+		void Load( char const * filename );
+
+		/**
+		 * Check the marker at the beginning of the file.
+		 * @param marker The expected beginning of the first line.
+		 * @return True if the first line starts with the marker.
+		 */
+		bool StartsWith( char const * marker ) const;
+
+		/**
+		 * Find a section of the file.
+		 * @param marker The line which begins the section, e.g. "[DATA]".
+		 * @param offset Where to start looking.
+		 * @return The offset of the first line in the section, or 
+		 * string::npos if the section was not found.
+		 */
+		string::size_type FindSection( char const * marker,
+				string::size_type offset = 0 ) const;
+
+		/**
+		 * Parse a row of whitespace-separated integers. Blank lines are
+		 * skipped, and a line beginning with '[' ends the section.
+		 * @param offset The offset of the row, advanced to the next row.
+		 * @param num_values The number of values expected in the row.
+		 * @param values Set to the values in the row.
+		 * @return False at the end of the section.
+		 */
+		bool NextRow( string::size_type * offset, int num_values, 
+				Int_t * values ) const;
+
+		/**
+		 * Parse a row of whitespace-separated numbers, as above.
+		 */
+		bool NextRow( string::size_type * offset, int num_values, 
+				double * values ) const;
+
+		/**
+		 * Get a line of text, e.g. of a header.
+		 * @param offset The offset of the line, advanced to the next line.
+		 * @param line Set to the line, without its line ending.
+		 * @return False at the end of the file.
+		 */
+		bool NextLine( string::size_type * offset, string * line ) const;
+
+		/**
+		 * Get the line number of an offset, counting from 1.
+		 */
+		int LineNumber( string::size_type offset ) const;
+
+		/**
+		 * Get the size of the file (bytes).
+		 */
+		string::size_type Size() const;
+
+		/**
+		 * Get the name of the file.
+		 */
+		char const * Filename() const;
+
+	private:
+		string filename_;	///< Name of the file
+		string buffer_;		///< Contents of the file
+
+		/**
+		 * Find the beginning of the next row, skipping blank lines.
+		 * @return False if there are no more rows in the section.
+		 */
+		bool SkipToRow( string::size_type * offset ) const;
+
+		/**
+		 * Report a malformed row.
+		 */
+		void Error( string::size_type offset, char const * message ) const;
+};
+
+} // namespace n2n
+
+#endif
@@ -0,0 +1,135 @@
+/**
+ * @file n2n/Dependencies.cxx
+ * Copyright (C) 2013 Houghton College
+ */
+
+#include "Dependencies.hxx"
+
+namespace n2n {
+
+Fingerprint::Fingerprint()
+	: hash_( 14695981039346656037ull )
+{
+}
+
+void Fingerprint::Add( void const * data, size_t size )
+{
+	unsigned char const * p = (unsigned char const *) data;
+	for ( size_t i = 0; i < size; ++i )
+		hash_ = (hash_ ^ p[i]) * 1099511628211ull;
+}
+
+void Fingerprint::Add( string const & s )
+{
+	Add( s.c_str(), s.size() + 1 );
+}
+
+void Fingerprint::Add( double x )
+{
+	Add( &x, sizeof( x ) );
+}
+
+void Fingerprint::Add( vector<string> const & row, int const * columns,
+		int num_columns )
+{
+	for ( int i = 0; i < num_columns; ++i )
+		Add( columns[i] < row.size() ? row[columns[i]] : string() );
+}
+
+bool Fingerprint::AddFile( char const * filename )
+{
+	FileStat_t stat;
+	if ( gSystem->GetPathInfo( filename, stat ) != 0 )
+	{
+		Add( string( "missing" ) );
+		return false;
+	}
+	Long64_t size = stat.fSize;
+	Long64_t mtime = stat.fMtime;
+	Add( &size, sizeof( size ) );
+	Add( &mtime, sizeof( mtime ) );
+	return true;
+}
+
+ULong64_t Fingerprint::Value() const
+{
+	return hash_;
+}
+
+void Dependencies::Load( char const * filename )
+{
+	CSVFile::Load( filename );
+	Index();
+}
+
+void Dependencies::Save( char const * filename, bool patch )
+{
+	{
+		lock_guard<mutex> guard( lock_ );
+		SortRows( 0 );
+		Index();
+	}
+	CSVFile::Save( filename, patch );
+}
+
+bool Dependencies::Unchanged( char const * key, Fingerprint const & fp ) const
+{
+	lock_guard<mutex> guard( lock_ );
+	map<string, int>::const_iterator i = index_.find( key );
+	if ( i == index_.end() )
+		return false;
+
+	vector<string> row = GetRow( i->second );
+	return row[DP_FINGERPRINT] == TString::Format( "%016llx", fp.Value() ).Data();
+}
+
+void Dependencies::Record( char const * key, Fingerprint const & fp )
+{
+	vector<string> row( DP_NUM_COLUMNS );
+	row[DP_KEY] = key;
+	row[DP_FINGERPRINT] = TString::Format( "%016llx", fp.Value() );
+
+	lock_guard<mutex> guard( lock_ );
+	map<string, int>::iterator i = index_.find( key );
+	if ( i != index_.end() )
+		SetRow( i->second, row );
+	else
+	{
+		index_[key] = NumRows();
+		AddRow( row );
+	}
+}
+
+void Dependencies::Merge( CSVFile const & other )
+{
+	lock_guard<mutex> guard( lock_ );
+	for ( int i = 0; i < other.NumRows(); ++i )
+	{
+		vector<string> row = other.GetRow( i );
+		if ( row.size() < DP_NUM_COLUMNS )
+			continue;
+
+		map<string, int>::iterator j = index_.find( row[DP_KEY] );
+		if ( j != index_.end() )
+			SetRow( j->second, row );
+		else
+		{
+			index_[row[DP_KEY]] = NumRows();
+			AddRow( row );
+		}
+	}
+}
+
+void Dependencies::Index()
+{
+	index_.clear();
+	for ( int i = 0; i < NumRows(); ++i )
+	{
+		vector<string> row = GetRow( i );
+		if ( row.size() < DP_NUM_COLUMNS )
+			continue;
+		index_[row[DP_KEY]] = i;
+	}
+}
+
+} // namespace n2n
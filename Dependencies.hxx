@@ -0,0 +1,140 @@
+/**
+ * @file n2n/Dependencies.hxx
+ * Copyright (C) 2013 Houghton College
+ */
+
+#ifndef N2N_DEPENDENCIES_INCL_
+#define N2N_DEPENDENCIES_INCL_
+
+#include "CSVFile.hxx"
+
+#include <map>
+#include <mutex>
+
+namespace n2n {
+
+/**
+ * A 64-bit FNV-1a hash of everything a result was calculated from.
+ */
+struct Fingerprint
+{
+	public:
+		/**
+		 * Create the fingerprint of nothing.
+		 */
+		Fingerprint();
+
+		/**
+		 * Add bytes.
+		 */
+		void Add( void const * data, size_t size );
+
+		/**
+		 * Add a string, terminated so that neighbouring strings cannot
+		 * run together.
+		 */
+		void Add( string const & s );
+
+		/**
+		 * Add an exact number.
+		 */
+		void Add( double x );
+
+		/**
+		 * Add some fields of a row.
+		 * @param row The row.
+		 * @param columns The columns to add; missing columns add an
+		 * empty string.
+		 * @param num_columns The number of columns.
+		 */
+		void Add( vector<string> const & row, int const * columns, int num_columns );
+
+		/**
+		 * Add the size and modification time of a file, or that it is
+		 * missing.
+		 * @return True if the file exists.
+		 */
+		bool AddFile( char const * filename );
+
+		/**
+		 * Get the hash.
+		 */
+		ULong64_t Value() const;
+
+	private:
+		ULong64_t hash_;
+};
+
+/**
+ * Dependencies column names
+ */
+enum DPFields {
+	DP_KEY,			///< The result, e.g. "run 12 c11"
+	DP_FINGERPRINT,		///< Fingerprint of its inputs and outputs
+	DP_NUM_COLUMNS
+};
+
+/**
+ * A persistent record of what each derived result was last calculated
+ * from, so that only results whose inputs changed are recalculated.
+ *
+ * A result, such as the C11 decays of one run, is identified by a key.
+ * Its fingerprint covers every input it depends on, e.g. the size and
+ * modification time of the data files, the fields of other columns and
+ * the parameters used, together with the values it wrote. The result is
+ * up to date while the fingerprint is unchanged, so editing either an
+ * input or the result itself causes it to be recalculated. Unchanged and
+ * Record may be called from several threads.
+ */
+struct Dependencies : public CSVFile
+{
+	public:
+		/**
+		 * Load a record file. A missing file gives an empty record.
+		 * @param filename The file to load.
+		 */
+		virtual void Load( char const * filename );
+
+		/**
+		 * Save the record, sorted so that the file is the same whatever
+		 * order its entries were added in, e.g. by Recalculate or by 
+		 * any number of shards.
+		 * @param filename The file to save to.
+		 * @param patch True to write only the changed rows if possible.
+		 */
+		virtual void Save( char const * filename, bool patch = false );
+
+		/**
+		 * Check whether a result is up to date.
+		 * @param key The result.
+		 * @param fp The fingerprint of its current inputs and outputs.
+		 */
+		bool Unchanged( char const * key, Fingerprint const & fp ) const;
+
+		/**
+		 * Record the fingerprint of a result which was just calculated.
+		 * @param key The result.
+		 * @param fp The fingerprint of its inputs and new outputs.
+		 */
+		void Record( char const * key, Fingerprint const & fp );
+
+		/**
+		 * Add the results recorded by another record, e.g. one written
+		 * by a shard of a campaign, replacing any with the same key.
+		 * @param other The results to add.
+		 */
+		void Merge( CSVFile const & other );
+
+	private:
+		map<string, int> index_;	///< Row of each result
+		mutable mutex lock_;		///< Protects Unchanged, Record, Merge and Save
+
+		/**
+		 * Rebuild index_ from the rows.
+		 */
+		void Index();
+};
+
+} // namespace n2n
+
+#endif
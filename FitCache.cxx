@@ -0,0 +1,114 @@
+/** 
+ * @file n2n/FitCache.cxx
+ * Copyright (C) 2013 Houghton College
+ */
+
+#include "FitCache.hxx"
+
+namespace n2n {
+
+void FitCache::Load( char const * filename )
+{
+	CSVFile::Load( filename );
+	Index();
+}
+
+void FitCache::Save( char const * filename, bool patch )
+{
+	{
+		lock_guard<mutex> guard( lock_ );
+		SortRows( 0 );
+		Index();
+	}
+	CSVFile::Save( filename, patch );
+}
+
+bool FitCache::Lookup( char const * filename, char const * config,
+		vector<string> * values ) const
+{
+	lock_guard<mutex> guard( lock_ );
+	map<string, int>::const_iterator i = index_.find( Key( filename, config ) );
+	if ( i == index_.end() )
+		return false;
+
+	FileStat_t stat;
+	if ( gSystem->GetPathInfo( filename, stat ) != 0 )
+		return false;
+
+	vector<string> row = GetRow( i->second );
+	if ( atoll( row[FC_SIZE].c_str() ) != stat.fSize ||
+			atol( row[FC_MTIME].c_str() ) != stat.fMtime )
+		return false;
+
+	values->assign( row.begin() + FC_VALUES, row.end() );
+	return true;
+}
+
+void FitCache::Store( char const * filename, char const * config,
+		vector<string> const & values )
+{
+	FileStat_t stat;
+	if ( gSystem->GetPathInfo( filename, stat ) != 0 )
+		return;
+
+	vector<string> row( FC_VALUES );
+	row[FC_FILENAME] = filename;
+	row[FC_CONFIG] = config;
+	row[FC_SIZE] = TString::Format( "%lld", (Long64_t) stat.fSize );
+	row[FC_MTIME] = TString::Format( "%ld", (Long_t) stat.fMtime );
+	row.insert( row.end(), values.begin(), values.end() );
+
+	lock_guard<mutex> guard( lock_ );
+	string key = Key( filename, config );
+	map<string, int>::iterator i = index_.find( key );
+	if ( i != index_.end() )
+		SetRow( i->second, row );
+	else
+	{
+		index_[key] = NumRows();
+		AddRow( row );
+	}
+}
+
+void FitCache::Merge( CSVFile const & other )
+{
+	lock_guard<mutex> guard( lock_ );
+	for ( int i = 0; i < other.NumRows(); ++i )
+	{
+		vector<string> row = other.GetRow( i );
+		if ( row.size() < FC_VALUES )
+			continue;
+
+		string key = Key( row[FC_FILENAME].c_str(), row[FC_CONFIG].c_str() );
+		map<string, int>::iterator j = index_.find( key );
+		if ( j != index_.end() )
+			SetRow( j->second, row );
+		else
+		{
+			index_[key] = NumRows();
+			AddRow( row );
+		}
+	}
+}
+
+string FitCache::Key( char const * filename, char const * config )
+{
+	string key = filename;
+	key += '\n';
+	key += config;
+	return key;
+}
+
+void FitCache::Index()
+{
+	index_.clear();
+	for ( int i = 0; i < NumRows(); ++i )
+	{
+		vector<string> row = GetRow( i );
+		if ( row.size() < FC_VALUES )
+			continue;
+		index_[Key( row[FC_FILENAME].c_str(), row[FC_CONFIG].c_str() )] = i;
+	}
+}
+
+} // namespace n2n
@@ -0,0 +1,96 @@
+/** 
+ * @file n2n/FitCache.hxx
+ * Copyright (C) 2013 Houghton College
+ */
+
+#ifndef N2N_FITCACHE_INCL_
+#define N2N_FITCACHE_INCL_
+
+#include "CSVFile.hxx"
+
+#include <map>
+#include <mutex>
+
+namespace n2n {
+
+/**
+ * Fit cache column names
+ */
+enum FCFields {
+	FC_FILENAME,		///< Data file the values were calculated from
+	FC_CONFIG,		///< Description of the calculation
+	FC_SIZE,		///< Size of the data file (bytes)
+	FC_MTIME,		///< Modification time of the data file
+	FC_VALUES		///< First of the calculated values
+};
+
+/**
+ * A persistent cache of values calculated from raw data files.
+ *
+ * Each entry is keyed by the data file it was calculated from and a 
+ * description of the calculation, e.g. the fixed parameters of a fit.
+ * An entry is only used while the size and modification time of the data
+ * file are unchanged. Lookup and Store may be called from several threads.
+ */
+struct FitCache : public CSVFile
+{
+	public:
+		/**
+		 * Load a cache file. A missing file gives an empty cache.
+		 * @param filename The file to load.
+		 */
+		virtual void Load( char const * filename );
+
+		/**
+		 * Save the cache, sorted so that the file is the same whatever
+		 * order its entries were added in, e.g. by Recalculate or by 
+		 * any number of shards.
+		 * @param filename The file to save to.
+		 * @param patch True to write only the changed rows if possible.
+		 */
+		virtual void Save( char const * filename, bool patch = false );
+
+		/**
+		 * Retrieve cached values.
+		 * @param filename The data file the values were calculated from.
+		 * @param config A description of the calculation.
+		 * @param values Set to the cached values, if found.
+		 * @return True if the values were found and are still valid.
+		 */
+		bool Lookup( char const * filename, char const * config,
+				vector<string> * values ) const;
+
+		/**
+		 * Store calculated values, replacing any previous entry.
+		 * @param filename The data file the values were calculated from.
+		 * @param config A description of the calculation.
+		 * @param values The calculated values.
+		 */
+		void Store( char const * filename, char const * config,
+				vector<string> const & values );
+
+		/**
+		 * Add the entries of another cache, e.g. one written by a shard
+		 * of a campaign, replacing any entry with the same key.
+		 * @param other The entries to add.
+		 */
+		void Merge( CSVFile const & other );
+
+	private:
+		map<string, int> index_;	///< Row of each entry
+		mutable mutex lock_;		///< Protects Lookup, Store, Merge and Save
+
+		/**
+		 * Rebuild index_ from the rows.
+		 */
+		void Index();
+
+		/**
+		 * Get the key for an entry.
+		 */
+		static string Key( char const * filename, char const * config );
+};
+
+} // namespace n2n
+
+#endif
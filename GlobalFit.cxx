@@ -0,0 +1,275 @@
+/** 
+ * @file n2n/GlobalFit.cxx
+ * Copyright (C) 2013 Houghton College
+ */
+
+#include "GlobalFit.hxx"
+
+#include <thread>
+
+namespace n2n {
+namespace decay {
+
+GlobalFit::GlobalFit()
+	: num_workers_( 1 )
+{
+	lambda_.val = lambda_.unc = 0;
+}
+
+void GlobalFit::AddCurve( TGraphErrors const * ge )
+{
+	AddCurve( ge->GetN(), ge->GetX(), ge->GetY() );
+}
+
+void GlobalFit::AddCurve( int n, double const * t, double const * y )
+{
+	Curve c;
+	c.t.assign( t, t + n );
+	c.y.assign( y, y + n );
+	c.sum_y = 0;
+	c.y_log_y = 0;
+	for ( int i = 0; i < n; ++i )
+	{
+		c.sum_y += y[i];
+		if ( y[i] > 0 )
+			c.y_log_y += y[i] * log( y[i] );
+	}
+	c.n0 = c.a = 0;
+	c.n0_fit.val = c.n0_fit.unc = c.a_fit.val = c.a_fit.unc = 0;
+	c.nll = c.dnll = 0;
+	c.status = 1;
+	curves_.push_back( c );
+}
+
+int GlobalFit::NumCurves() const
+{
+	return curves_.size();
+}
+
+void GlobalFit::SetNumWorkers( int num_workers )
+{
+	num_workers_ = num_workers;
+}
+
+bool GlobalFit::Fit( double lambda_min, double lambda_max )
+{
+	double nll;
+	double lo = lambda_min, hi = lambda_max;
+	double g_lo = Evaluate( lo, &nll );
+	double g_hi = Evaluate( hi, &nll );
+	if ( !(g_lo < 0 && g_hi > 0) )
+	{
+		cerr << "Global decay fit: no minimum between lambda = " 
+			<< lambda_min << " and " << lambda_max << endl;
+		return false;
+	}
+
+	// Find the root of dL/dlambda by the Illinois method
+	double lambda = lo;
+	int side = 0;
+	for ( int iter = 0; iter < 200 && hi - lo > 1e-12 * hi; ++iter )
+	{
+		lambda = (lo * g_hi - hi * g_lo) / (g_hi - g_lo);
+		double g = Evaluate( lambda, &nll );
+		if ( g == 0 )
+			break;
+
+		if ( g < 0 )
+		{
+			lo = lambda, g_lo = g;
+			if ( side == -1 )
+				g_hi /= 2;
+			side = -1;
+		}
+		else
+		{
+			hi = lambda, g_hi = g;
+			if ( side == 1 )
+				g_lo /= 2;
+			side = 1;
+		}
+	}
+
+	// The error is given by the curvature of the profile likelihood
+	double h = 1e-4 * lambda;
+	double curvature = (Evaluate( lambda + h, &nll ) - 
+			Evaluate( lambda - h, &nll )) / (2 * h);
+	Evaluate( lambda, &nll );
+
+	lambda_.val = lambda;
+	lambda_.unc = curvature > 0 ? 1 / sqrt( curvature ) : 0;
+	return curvature > 0;
+}
+
+UncertainD GlobalFit::Lambda() const
+{
+	return lambda_;
+}
+
+UncertainD GlobalFit::HalfLife() const
+{
+	UncertainD half_life;
+	half_life.val = TMath::Log( 2 ) / lambda_.val;
+	half_life.unc = half_life.val * lambda_.unc / lambda_.val;
+	return half_life;
+}
+
+FitResult GlobalFit::CurveResult( int curve ) const
+{
+	Curve const & c = curves_[curve];
+
+	FitResult fit;
+	fit.n0 = c.n0_fit;
+	fit.a = c.a_fit;
+	fit.lambda = lambda_.val;
+	fit.chi2 = 2 * (c.nll - c.sum_y + c.y_log_y);
+	fit.ndf = c.t.size() - 2;
+	fit.status = c.status;
+	return fit;
+}
+
+double GlobalFit::Evaluate( double lambda, double * nll )
+{
+	int num_workers = num_workers_ > 0 ? num_workers_ : 
+		thread::hardware_concurrency();
+	if ( num_workers > curves_.size() )
+		num_workers = curves_.size();
+
+	if ( num_workers > 1 )
+	{
+		vector<thread> workers;
+		for ( int i = 0; i < num_workers; ++i )
+		{
+			int begin = curves_.size() * i / num_workers;
+			int end = curves_.size() * (i + 1) / num_workers;
+			workers.push_back( thread( &GlobalFit::FitCurves, this, 
+						lambda, begin, end ) );
+		}
+		for ( int i = 0; i < num_workers; ++i )
+			workers[i].join();
+	}
+	else
+		FitCurves( lambda, 0, curves_.size() );
+
+	// Sum in a fixed order, so the result is independent of num_workers
+	double dnll = 0;
+	*nll = 0;
+	for ( int k = 0; k < curves_.size(); ++k )
+	{
+		*nll += curves_[k].nll;
+		dnll += curves_[k].dnll;
+	}
+	return dnll;
+}
+
+void GlobalFit::FitCurves( double lambda, int begin, int end )
+{
+	for ( int k = begin; k < end; ++k )
+		FitCurve( curves_[k], lambda );
+}
+
+void GlobalFit::FitCurve( Curve & c, double lambda )
+{
+	int n = c.t.size();
+	vector<double> e( n );
+	for ( int i = 0; i < n; ++i )
+		e[i] = TMath::Exp( -lambda * c.t[i] );
+
+	// Start from the previous optimum if it is still allowed, or else
+	// from a least squares fit
+	bool positive = ( c.status == 0 );
+	for ( int i = 0; i < n && positive; ++i )
+		positive = c.n0 * e[i] + c.a > 0;
+
+	if ( !positive )
+	{
+		vector<double> ey( n );
+		for ( int i = 0; i < n; ++i )
+			ey[i] = sqrt( c.y[i] > 1 ? c.y[i] : 1 );
+		FitResult start = FitDecayCurveLinear( n, &c.t[0], &c.y[0], &ey[0], lambda );
+		c.n0 = start.n0.val > 0 ? start.n0.val : 1;
+		c.a = start.a.val > 0 ? start.a.val : 1e-3;
+	}
+
+	double n0 = c.n0, a = c.a;
+	double f = 0, g_n = 0, g_a = 0, h_nn = 0, h_na = 0, h_aa = 0;
+	bool converged = false;
+	for ( int iter = 0; iter < 100; ++iter )
+	{
+		f = g_n = g_a = h_nn = h_na = h_aa = 0;
+		for ( int i = 0; i < n; ++i )
+		{
+			double mu = n0 * e[i] + a;
+			double r = c.y[i] / mu;
+			f += mu - c.y[i] * log( mu );
+			g_n += e[i] * (1 - r);
+			g_a += 1 - r;
+			h_nn += r / mu * e[i] * e[i];
+			h_na += r / mu * e[i];
+			h_aa += r / mu;
+		}
+		if ( converged )
+			break;
+
+		double det = h_nn * h_aa - h_na * h_na;
+		if ( det <= 0 )
+			break;
+		double d_n = -(h_aa * g_n - h_na * g_a) / det;
+		double d_a = -(h_nn * g_a - h_na * g_n) / det;
+		double slope = g_n * d_n + g_a * d_a;
+		if ( -slope < 1e-10 * (1 + fabs( f )) )
+		{
+			converged = true;
+			continue;
+		}
+
+		// Halve the Newton step until the likelihood improves
+		double step = 1;
+		bool improved = false;
+		for ( int j = 0; j < 50 && !improved; ++j, step /= 2 )
+		{
+			double n0_new = n0 + step * d_n;
+			double a_new = a + step * d_a;
+
+			double f_new = 0;
+			bool positive = true;
+			for ( int i = 0; i < n && positive; ++i )
+			{
+				double mu = n0_new * e[i] + a_new;
+				positive = mu > 0;
+				if ( positive )
+					f_new += mu - c.y[i] * log( mu );
+			}
+			if ( positive && f_new <= f + 1e-4 * step * slope )
+			{
+				n0 = n0_new, a = a_new;
+				improved = true;
+			}
+		}
+
+		// Without improvement the optimum is found to rounding error
+		if ( !improved )
+			converged = true;
+	}
+
+	double det = h_nn * h_aa - h_na * h_na;
+	c.status = converged && det > 0 ? 0 : 1;
+	c.n0 = n0;
+	c.a = a;
+	c.n0_fit.val = n0;
+	c.n0_fit.unc = det > 0 ? sqrt( h_aa / det ) : 0;
+	c.a_fit.val = a;
+	c.a_fit.unc = det > 0 ? sqrt( h_nn / det ) : 0;
+	c.nll = f;
+
+	// By the envelope theorem, dL/dlambda needs only the partial derivative
+	c.dnll = 0;
+	for ( int i = 0; i < n; ++i )
+	{
+		double mu = n0 * e[i] + a;
+		c.dnll += -c.t[i] * n0 * e[i] * (1 - c.y[i] / mu);
+	}
+}
+
+} // namespace decay
+} // namespace n2n
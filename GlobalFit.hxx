@@ -0,0 +1,131 @@
+/** 
+ * @file n2n/GlobalFit.hxx
+ * Copyright (C) 2013 Houghton College
+ */
+
+#ifndef N2N_GLOBALFIT_INCL_
+#define N2N_GLOBALFIT_INCL_
+
+#include "decay.hxx"
+
+#include <vector>
+
+namespace n2n {
+namespace decay {
+
+/**
+ * A simultaneous fit of many decay curves which share a free decay 
+ * constant, @f$\lambda@f$, while each curve @f$k@f$ has its own 
+ * @f$N_{0,k}@f$ and @f$A_k@f$.
+ *
+ * The counts are treated as Poisson distributed, and the negative log 
+ * likelihood
+ * @f[L(\lambda)=\min_{N_{0,k},A_k}\sum_k\sum_i\left(\mu_{ki}-y_{ki}\ln\mu_{ki}\right),
+ * \quad\mu_{ki}=N_{0,k}e^{-\lambda t_{ki}}+A_k@f]
+ * is profiled: for each trial @f$\lambda@f$ every curve is fit 
+ * independently, in parallel, by Newton's method. The derivative of the
+ * profile, @f$dL/d\lambda=\partial L/\partial\lambda@f$ at the curve
+ * optima, is used to locate the minimum, and its slope gives the error.
+ */
+struct GlobalFit
+{
+	public:
+		GlobalFit();
+
+		/**
+		 * Add a decay curve to the fit.
+		 * @param ge The curve, as returned by @ref ParseDataFile.
+		 */
+		void AddCurve( TGraphErrors const * ge );
+
+		/**
+		 * Add a decay curve to the fit.
+		 * @param n The number of points.
+		 * @param t The times of the points (min).
+		 * @param y The counts of the points.
+		 */
+		void AddCurve( int n, double const * t, double const * y );
+
+		/**
+		 * Get the number of curves in the fit.
+		 */
+		int NumCurves() const;
+
+		/**
+		 * Set the number of threads used to evaluate the likelihood.
+		 * @param num_workers The number of threads, or 0 to use one 
+		 * per core.
+		 */
+		void SetNumWorkers( int num_workers );
+
+		/**
+		 * Find the decay constant which maximizes the likelihood.
+		 * @param lambda_min The smallest decay constant to consider (1/min).
+		 * @param lambda_max The largest decay constant to consider (1/min).
+		 * @return True if a minimum was found inside the range.
+		 */
+		bool Fit( double lambda_min, double lambda_max );
+
+		/**
+		 * Get the fitted decay constant, @f$\lambda@f$ (1/min).
+		 */
+		UncertainD Lambda() const;
+
+		/**
+		 * Get the fitted half-life, @f$\ln 2/\lambda@f$ (min).
+		 */
+		UncertainD HalfLife() const;
+
+		/**
+		 * Get the parameters of one curve at the fitted decay constant.
+		 * The chi-square is the Poisson likelihood ratio statistic.
+		 * @param curve The curve, in the order they were added.
+		 */
+		FitResult CurveResult( int curve ) const;
+
+	private:
+		/**
+		 * A decay curve and the constants of its likelihood.
+		 */
+		struct Curve
+		{
+			vector<double> t;	///< Times of the points (min)
+			vector<double> y;	///< Counts of the points
+			double sum_y;		///< Sum of y, for the deviance
+			double y_log_y;		///< Sum of y ln y, for the deviance
+			double n0;		///< N0 at the last decay constant
+			double a;		///< A at the last decay constant
+			UncertainD n0_fit;	///< N0 at the fitted decay constant
+			UncertainD a_fit;	///< A at the fitted decay constant
+			double nll;		///< Negative log likelihood at the optimum
+			double dnll;		///< Its derivative with respect to lambda
+			int status;		///< 0 if the curve converged
+		};
+
+		vector<Curve> curves_;
+		int num_workers_;
+		UncertainD lambda_;
+
+		/**
+		 * Fit every curve at a decay constant.
+		 * @param lambda The decay constant (1/min).
+		 * @param nll Set to the profiled negative log likelihood.
+		 * @return The derivative of the profile with respect to lambda.
+		 */
+		double Evaluate( double lambda, double * nll );
+
+		/**
+		 * Fit the curves in [begin, end) at a decay constant.
+		 */
+		void FitCurves( double lambda, int begin, int end );
+
+		/**
+		 * Fit one curve at a decay constant.
+		 */
+		static void FitCurve( Curve & c, double lambda );
+};
+
+} // namespace decay
+} // namespace n2n
+
+#endif
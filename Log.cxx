@@ -0,0 +1,44 @@
+/** 
+ * @file n2n/Log.cxx
+ * Copyright (C) 2013 Houghton College
+ */
+
+#include "Log.hxx"
+
+#include <atomic>
+#include <mutex>
+
+namespace n2n {
+
+static atomic<int> log_level( LOG_WARNING );
+static ostream * log_stream = &cerr;
+static mutex log_lock;
+
+void SetLogLevel( LogLevel level )
+{
+	log_level = level;
+}
+
+void SetLogStream( ostream * stream )
+{
+	lock_guard<mutex> guard( log_lock );
+	log_stream = stream;
+}
+
+bool LogEnabled( LogLevel level )
+{
+	return level <= log_level;
+}
+
+void LogMessage( LogLevel level, char const * message )
+{
+	if ( !LogEnabled( level ) )
+		return;
+
+	char const * names[] = { "error", "warning", "info", "debug" };
+	lock_guard<mutex> guard( log_lock );
+	if ( log_stream )
+		*log_stream << names[level] << ": " << message << '\n';
+}
+
+} // namespace n2n
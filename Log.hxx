@@ -0,0 +1,53 @@
+/** 
+ * @file n2n/Log.hxx
+ * Copyright (C) 2013 Houghton College
+ */
+
+#ifndef N2N_LOG_INCL_
+#define N2N_LOG_INCL_
+
+#include <iostream>
+
+namespace n2n {
+
+/**
+ * Importance of a log message; a lower level is more important.
+ */
+enum LogLevel {
+	LOG_ERROR,		///< The analysis cannot continue
+	LOG_WARNING,		///< Suspicious input which was worked around
+	LOG_INFO,		///< Progress of the analysis
+	LOG_DEBUG		///< Details for tracking down problems
+};
+
+/**
+ * Set the least important level of message which is written.
+ * @param level The level; LOG_WARNING by default.
+ */
+void SetLogLevel( LogLevel level );
+
+/**
+ * Set the stream log messages are written to.
+ * @param stream The stream, or NULL to discard every message; cerr by 
+ * default.
+ */
+void SetLogStream( ostream * stream );
+
+/**
+ * Check whether messages of a level are written, so that expensive 
+ * messages need not be formatted.
+ * @param level The level to check.
+ */
+bool LogEnabled( LogLevel level );
+
+/**
+ * Write a message to the log, if its level is enabled. Messages from
+ * different threads are not interleaved.
+ * @param level The importance of the message.
+ * @param message The message, without a trailing newline.
+ */
+void LogMessage( LogLevel level, char const * message );
+
+} // namespace n2n
+
+#endif
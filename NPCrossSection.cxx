@@ -0,0 +1,226 @@
+/** 
+ * @file n2n/NPCrossSection.cxx
+ * Copyright (C) 2013 Houghton College
+ */
+
+#include "NPCrossSection.hxx"
+#include "CSVFile.hxx"
+#include "Dependencies.hxx"
+#include "Log.hxx"
+
+#include <algorithm>
+#include <limits>
+
+namespace n2n {
+
+void NPCrossSection::Load( char const * filename )
+{
+	CSVFile file;
+	file.Load( filename );
+
+	// (angle, energy, cross section) of every row
+	vector< pair<double, pair<double, double> > > points;
+	vector<CSVField> fields;
+	for ( int i = 0; i < file.NumRows(); ++i )
+	{
+		file.GetFields( i, &fields );
+		if ( fields.size() < 3 )
+			continue;
+
+		string energy = fields[0].ToString();
+		char * end;
+		double value = strtod( energy.c_str(), &end );
+		if ( end == energy.c_str() )
+			continue;
+
+		points.push_back( make_pair( fields[1].ToDouble(), 
+				make_pair( value, fields[2].ToDouble() ) ) );
+	}
+	sort( points.begin(), points.end() );
+
+	splines_.clear();
+	for ( int i = 0; i < points.size(); )
+	{
+		int j = i;
+		vector<double> energies, xsects;
+		for ( ; j < points.size() && points[j].first == points[i].first; ++j )
+		{
+			energies.push_back( points[j].second.first );
+			xsects.push_back( points[j].second.second );
+		}
+		if ( energies.size() < 2 )
+		{
+			TString msg = TString::Format( 
+				"%s: need at least 2 energies at %g deg", 
+				filename, points[i].first );
+			LogMessage( LOG_ERROR, msg );
+			throw runtime_error( msg.Data() );
+		}
+		AddAngle( points[i].first, energies.size(), &energies[0], &xsects[0] );
+		i = j;
+	}
+	LogMessage( LOG_DEBUG, TString::Format( "%s: %d angles", filename, NumAngles() ) );
+}
+
+void NPCrossSection::AddAngle( double angle, int n, double const * energies, 
+		double const * xsects )
+{
+	for ( int i = 0; i + 1 < n; ++i )
+	{
+		if ( !(energies[i] < energies[i + 1]) )
+		{
+			TString msg = TString::Format( 
+				"n-p cross sections at %g deg: energies must increase", angle );
+			LogMessage( LOG_ERROR, msg );
+			throw runtime_error( msg.Data() );
+		}
+	}
+
+	Spline s;
+	s.angle = angle;
+	s.x.assign( energies, energies + n );
+	s.a.assign( xsects, xsects + n );
+	s.b.resize( n );
+	s.c.resize( n );
+	s.d.resize( n );
+
+	// Solve the tridiagonal system for c, with c[0] = c[n-1] = 0
+	vector<double> h( n - 1 ), diag( n ), rhs( n );
+	for ( int i = 0; i + 1 < n; ++i )
+		h[i] = s.x[i + 1] - s.x[i];
+	s.c[0] = s.c[n - 1] = 0;
+	for ( int i = 1; i + 1 < n; ++i )
+	{
+		diag[i] = 2 * (h[i - 1] + h[i]);
+		rhs[i] = 3 * ((s.a[i + 1] - s.a[i]) / h[i] - (s.a[i] - s.a[i - 1]) / h[i - 1]);
+		if ( i > 1 )
+		{
+			double m = h[i - 1] / diag[i - 1];
+			diag[i] -= m * h[i - 1];
+			rhs[i] -= m * rhs[i - 1];
+		}
+	}
+	for ( int i = n - 2; i >= 1; --i )
+		s.c[i] = (rhs[i] - h[i] * s.c[i + 1]) / diag[i];
+
+	for ( int i = 0; i + 1 < n; ++i )
+	{
+		s.b[i] = (s.a[i + 1] - s.a[i]) / h[i] - h[i] * (s.c[i + 1] + 2 * s.c[i]) / 3;
+		s.d[i] = (s.c[i + 1] - s.c[i]) / (3 * h[i]);
+	}
+	s.b[n - 1] = s.d[n - 1] = 0;
+
+	vector<Spline>::iterator pos = splines_.begin();
+	while ( pos != splines_.end() && pos->angle < angle )
+		++pos;
+	if ( pos != splines_.end() && pos->angle == angle )
+		*pos = s;
+	else
+		splines_.insert( pos, s );
+}
+
+double NPCrossSection::Eval( double energy, double angle ) const
+{
+	double xsect;
+	Eval( 1, &energy, &xsect, angle );
+	return xsect;
+}
+
+int NPCrossSection::Eval( int n, double const * energies, double * xsects,
+		double angle, vector<int> * out_of_range ) const
+{
+	double const nan = numeric_limits<double>::quiet_NaN();
+	if ( out_of_range )
+		out_of_range->clear();
+
+	// Find the angles on either side
+	int hi = 0;
+	while ( hi < splines_.size() && splines_[hi].angle < angle )
+		++hi;
+	if ( hi == splines_.size() || (splines_[hi].angle != angle && hi == 0) )
+	{
+		fill( xsects, xsects + n, nan );
+		if ( out_of_range )
+			for ( int i = 0; i < n; ++i )
+				out_of_range->push_back( i );
+		return n;
+	}
+	int lo = splines_[hi].angle == angle ? hi : hi - 1;
+	double w = lo == hi ? 0 : 
+		(angle - splines_[lo].angle) / (splines_[hi].angle - splines_[lo].angle);
+
+	int num_out = 0;
+	int hint_lo = 0, hint_hi = 0;
+	for ( int i = 0; i < n; ++i )
+	{
+		double xsect = EvalSpline( splines_[lo], energies[i], &hint_lo );
+		if ( w != 0 )
+			xsect += w * (EvalSpline( splines_[hi], energies[i], &hint_hi ) - xsect);
+		xsects[i] = xsect;
+
+		if ( xsect != xsect )
+		{
+			++num_out;
+			if ( out_of_range )
+				out_of_range->push_back( i );
+		}
+	}
+	return num_out;
+}
+
+int NPCrossSection::NumAngles() const
+{
+	return splines_.size();
+}
+
+void NPCrossSection::AddTo( Fingerprint * fp ) const
+{
+	for ( int i = 0; i < splines_.size(); ++i )
+	{
+		Spline const & s = splines_[i];
+		fp->Add( s.angle );
+		for ( int j = 0; j < s.x.size(); ++j )
+			fp->Add( s.x[j] );
+		for ( int j = 0; j < s.a.size(); ++j )
+			fp->Add( s.a[j] );
+	}
+}
+
+NPCrossSection const & NPCrossSection::Default()
+{
+	struct DefaultTable : public NPCrossSection
+	{
+		DefaultTable()
+		{
+			// Data from http://nn-online.org/
+			// Lab frame
+			double energies[] = {  20,  22,  24,  26,  28 };	// (MeV)
+			double xsects[]   = { 153, 139, 128, 119, 111 };	// (mbarn/sr)
+			AddAngle( 0, 5, energies, xsects );
+		}
+	};
+	static DefaultTable table;
+	return table;
+}
+
+double NPCrossSection::EvalSpline( Spline const & s, double energy, int * hint )
+{
+	int n = s.x.size();
+	if ( !(energy >= s.x[0] && energy <= s.x[n - 1]) )
+		return numeric_limits<double>::quiet_NaN();
+
+	// Reuse the previous interval if possible, otherwise search for it
+	int i = *hint;
+	if ( !(s.x[i] <= energy && (i + 2 == n || energy < s.x[i + 1])) )
+	{
+		i = upper_bound( s.x.begin(), s.x.end(), energy ) - s.x.begin() - 1;
+		if ( i > n - 2 )
+			i = n - 2;
+		*hint = i;
+	}
+
+	double dx = energy - s.x[i];
+	return s.a[i] + dx * (s.b[i] + dx * (s.c[i] + dx * s.d[i]));
+}
+
+} // namespace n2n
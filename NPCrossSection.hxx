@@ -0,0 +1,109 @@
+/** 
+ * @file n2n/NPCrossSection.hxx
+ * Copyright (C) 2013 Houghton College
+ */
+
+#ifndef N2N_NPCROSSSECTION_INCL_
+#define N2N_NPCROSSSECTION_INCL_
+
+#include <vector>
+
+namespace n2n {
+
+struct Fingerprint;
+
+/**
+ * A table of the @f$(n,p)@f$ elastic scattering cross section, 
+ * @f$\sigma_{np}(T,\theta)@f$, in the lab frame.
+ *
+ * At each tabulated angle, the cross section is interpolated in energy with
+ * a natural cubic spline (as ROOT::Math::Interpolator does by default)
+ * whose coefficients are calculated once when the table is filled. 
+ * Between tabulated angles it is interpolated linearly. Energies and 
+ * angles outside the table give NaN rather than an extrapolation.
+ */
+struct NPCrossSection
+{
+	public:
+		/**
+		 * Load a table from a csv file. Each row contains an energy
+		 * (MeV), a lab angle (deg) and a cross section (mbarn/sr);
+		 * rows which do not start with a number, such as headers, are
+		 * skipped. The rows of each angle need not be sorted.
+		 * @param filename The file to load.
+		 */
+		void Load( char const * filename );
+
+		/**
+		 * Add the cross sections at one angle to the table.
+		 * @param angle The lab angle (deg).
+		 * @param n The number of energies; at least 2.
+		 * @param energies The energies (MeV), in increasing order.
+		 * @param xsects The cross sections (mbarn/sr).
+		 */
+		void AddAngle( double angle, int n, double const * energies, 
+				double const * xsects );
+
+		/**
+		 * Calculate the cross section at one energy.
+		 * @param energy The kinetic energy of the neutron, @f$T@f$ (MeV).
+		 * @param angle The lab angle of the proton, @f$\theta@f$ (deg).
+		 * @return The cross section (mbarn/sr), or NaN if the energy or
+		 * angle is outside the table.
+		 */
+		double Eval( double energy, double angle = 0 ) const;
+
+		/**
+		 * Calculate the cross section at many energies, such as a 
+		 * column of CS_NEUTRON_ENERGY. Neighbouring energies in the same
+		 * interval of the table are found without a search, so dense,
+		 * sorted grids are fastest.
+		 * @param n The number of energies.
+		 * @param energies The kinetic energies of the neutron (MeV).
+		 * @param xsects Filled with n cross sections (mbarn/sr).
+		 * @param angle The lab angle of the proton (deg).
+		 * @param out_of_range If not NULL, filled with the index of each
+		 * energy outside the table.
+		 * @return The number of energies outside the table.
+		 */
+		int Eval( int n, double const * energies, double * xsects, 
+				double angle = 0, vector<int> * out_of_range = NULL ) const;
+
+		/**
+		 * Get the number of angles in the table.
+		 */
+		int NumAngles() const;
+
+		/**
+		 * Add the whole table to a fingerprint.
+		 * @param fp The fingerprint to add to.
+		 */
+		void AddTo( Fingerprint * fp ) const;
+
+		/**
+		 * Get the table used when no other is given: the cross sections 
+		 * at 0 deg from 20 to 28 MeV, from http://nn-online.org/.
+		 */
+		static NPCrossSection const & Default();
+
+	private:
+		/**
+		 * A natural cubic spline through the cross sections at one angle.
+		 * On interval i, @f$\sigma=a_i+b_i\,dx+c_i\,dx^2+d_i\,dx^3@f$, 
+		 * where @f$dx=T-x_i@f$.
+		 */
+		struct Spline
+		{
+			double angle;		///< Lab angle (deg)
+			vector<double> x;	///< Energies (MeV)
+			vector<double> a, b, c, d;	///< Coefficients per interval
+		};
+
+		static double EvalSpline( Spline const & s, double energy, int * hint );
+
+		vector<Spline> splines_;	///< Sorted by angle
+};
+
+} // namespace n2n
+
+#endif
@@ -0,0 +1,219 @@
+/**
+ * @file n2n/Parameters.cxx
+ * Copyright (C) 2013 Houghton College
+ */
+
+#include "Parameters.hxx"
+#include "Dependencies.hxx"
+#include "CSVFile.hxx"
+#include "decay.hxx"
+#include "Log.hxx"
+
+#include <cstring>
+#include <limits>
+
+namespace n2n {
+
+/**
+ * The name and group of one parameter.
+ */
+struct ParameterInfo
+{
+	char const * name;		///< Name in a parameter file
+	double Parameters::* value;	///< The parameter
+	unsigned group;			///< Group of the parameter
+};
+
+ParameterInfo const PARAMETERS[] = {
+	{ "det_area", &Parameters::det_area, PAR_GEOMETRY },
+	{ "det_distance", &Parameters::det_distance, PAR_GEOMETRY },
+	{ "ch2_area", &Parameters::ch2_area, PAR_GEOMETRY },
+	{ "ch2_distance", &Parameters::ch2_distance, PAR_GEOMETRY },
+	{ "ch2_thickness", &Parameters::ch2_thickness, PAR_GEOMETRY },
+	{ "c12_area", &Parameters::c12_area, PAR_GEOMETRY },
+	{ "c12_distance", &Parameters::c12_distance, PAR_GEOMETRY },
+	{ "c12_thickness", &Parameters::c12_thickness, PAR_GEOMETRY },
+	{ "efficiency", &Parameters::efficiency, PAR_EFFICIENCY },
+	{ "ch2_factor", &Parameters::ch2_factor, PAR_EFFICIENCY },
+	{ "half_life", &Parameters::half_life, PAR_HALF_LIFE },
+	{ "ch2_density", &Parameters::ch2_density, PAR_DENSITY },
+	{ "c12_density", &Parameters::c12_density, PAR_DENSITY }
+};
+
+int const NUM_PARAMETERS = sizeof( PARAMETERS ) / sizeof( PARAMETERS[0] );
+
+Parameters::Parameters()
+	: det_area( 0.7133 ), det_distance( 12.07 ),
+	  ch2_area( 5.067075 ), ch2_distance( 6.46 ), ch2_thickness( 0.164 ),
+	  c12_area( 43.20869 ), c12_distance( 14.52 ), c12_thickness( 0.889 ),
+	  efficiency( 0.12 ), ch2_factor( 5.83 ), half_life( decay::HALF_LIFE ),
+	  ch2_density( 0.89 ), c12_density( 2.276 )
+{
+}
+
+/**
+ * Report an unknown parameter in a file.
+ */
+void UnknownParameter( char const * filename, int row_number, string const & name )
+{
+	TString msg = TString::Format( "%s row %d: unknown parameter '%s'",
+			filename, row_number + 1, name.c_str() );
+	LogMessage( LOG_ERROR, msg );
+	throw runtime_error( msg.Data() );
+}
+
+void Parameters::Load( char const * filename )
+{
+	CSVFile file;
+	file.Load( filename );
+
+	vector<CSVField> fields;
+	for ( int i = 0; i < file.NumRows(); ++i )
+	{
+		file.GetFields( i, &fields );
+		if ( fields.size() < 2 )
+			continue;
+
+		string text = fields[1].ToString();
+		char * end;
+		double value = strtod( text.c_str(), &end );
+		if ( end == text.c_str() )
+			continue;
+
+		string name = fields[0].ToString();
+		if ( !Set( name.c_str(), value ) )
+			UnknownParameter( filename, i, name );
+	}
+}
+
+bool Parameters::Set( char const * name, double value )
+{
+	for ( int i = 0; i < NUM_PARAMETERS; ++i )
+	{
+		if ( strcmp( PARAMETERS[i].name, name ) == 0 )
+		{
+			this->*PARAMETERS[i].value = value;
+			return true;
+		}
+	}
+	return false;
+}
+
+double Parameters::Get( char const * name ) const
+{
+	for ( int i = 0; i < NUM_PARAMETERS; ++i )
+		if ( strcmp( PARAMETERS[i].name, name ) == 0 )
+			return this->*PARAMETERS[i].value;
+	return numeric_limits<double>::quiet_NaN();
+}
+
+void Parameters::AddTo( Fingerprint * fp, unsigned groups ) const
+{
+	for ( int i = 0; i < NUM_PARAMETERS; ++i )
+		if ( PARAMETERS[i].group & groups )
+			fp->Add( this->*PARAMETERS[i].value );
+}
+
+/**
+ * Read a field as a number.
+ * @return False if the field is not a number.
+ */
+bool ParseParameter( CSVField const & field, double * value )
+{
+	string text = field.ToString();
+	char * end;
+	*value = strtod( text.c_str(), &end );
+	return end != text.c_str() && *end == '\0';
+}
+
+void LoadParameterSets( char const * filename, Parameters const & base,
+		vector<Parameters> * sets, vector<string> * names )
+{
+	CSVFile file;
+	file.Load( filename );
+	sets->clear();
+	names->clear();
+
+	// A grid names a parameter at the start of every row, followed by its
+	// values, so its first row holds a value; a list names its parameters
+	// in its first row, and starts every other row with a value
+	bool grid = false;
+	vector<CSVField> fields;
+	double value;
+	if ( file.NumRows() > 0 )
+	{
+		file.GetFields( 0, &fields );
+		for ( int j = 1; j < fields.size() && !grid; ++j )
+			grid = ParseParameter( fields[j], &value );
+	}
+	for ( int i = 1; i < file.NumRows(); ++i )
+	{
+		file.GetFields( i, &fields );
+		if ( !fields.empty() && ParseParameter( fields[0], &value ) )
+			grid = false;
+	}
+
+	if ( grid )
+	{
+		sets->push_back( base );
+		for ( int i = 0; i < file.NumRows(); ++i )
+		{
+			file.GetFields( i, &fields );
+			if ( fields.empty() || fields[0].ToString().empty() )
+				continue;
+
+			string name = fields[0].ToString();
+			vector<double> values;
+			for ( int j = 1; j < fields.size(); ++j )
+				if ( ParseParameter( fields[j], &value ) )
+					values.push_back( value );
+			if ( values.empty() )
+			{
+				TString msg = TString::Format( "%s row %d: no values for '%s'",
+						filename, i + 1, name.c_str() );
+				LogMessage( LOG_ERROR, msg );
+				throw runtime_error( msg.Data() );
+			}
+
+			vector<Parameters> grown;
+			for ( int j = 0; j < sets->size(); ++j )
+			{
+				for ( int k = 0; k < values.size(); ++k )
+				{
+					grown.push_back( (*sets)[j] );
+					if ( !grown.back().Set( name.c_str(), values[k] ) )
+						UnknownParameter( filename, i, name );
+				}
+			}
+			sets->swap( grown );
+			names->push_back( name );
+		}
+		return;
+	}
+
+	// Otherwise the first row names the parameters of a list, which may
+	// have no sets
+	if ( file.NumRows() == 0 )
+		return;
+	Parameters probe;
+	file.GetFields( 0, &fields );
+	for ( int j = 0; j < fields.size() && !fields[j].ToString().empty(); ++j )
+	{
+		names->push_back( fields[j].ToString() );
+		if ( !probe.Set( names->back().c_str(), 0 ) )
+			UnknownParameter( filename, 0, names->back() );
+	}
+	for ( int i = 1; i < file.NumRows(); ++i )
+	{
+		file.GetFields( i, &fields );
+		if ( fields.empty() || !ParseParameter( fields[0], &value ) )
+			continue;
+
+		sets->push_back( base );
+		for ( int j = 0; j < fields.size() && j < names->size(); ++j )
+			if ( ParseParameter( fields[j], &value ) )
+				sets->back().Set( (*names)[j].c_str(), value );
+	}
+}
+
+} // namespace n2n
@@ -0,0 +1,109 @@
+/**
+ * @file n2n/Parameters.hxx
+ * Copyright (C) 2013 Houghton College
+ */
+
+#ifndef N2N_PARAMETERS_INCL_
+#define N2N_PARAMETERS_INCL_
+
+namespace n2n {
+
+struct Fingerprint;
+
+/**
+ * Groups of parameters, combined with | to describe what a result
+ * depends on.
+ */
+enum ParameterGroup {
+	PAR_GEOMETRY = 1,	///< Areas, distances and thicknesses
+	PAR_EFFICIENCY = 2,	///< Efficiencies of the decay counters
+	PAR_HALF_LIFE = 4,	///< Half-life of C11
+	PAR_DENSITY = 8,	///< Densities of the targets
+	PAR_ALL = 15
+};
+
+/**
+ * The constants of the experiment which are not measured run by run.
+ *
+ * Each has a name by which it is set in a parameter file:
+ * det_area, det_distance, ch2_area, ch2_distance, ch2_thickness, c12_area,
+ * c12_distance, c12_thickness, efficiency, ch2_factor, half_life,
+ * ch2_density and c12_density.
+ */
+struct Parameters
+{
+	double det_area;	///< Area of detector (cm^2)
+	double det_distance;	///< Distance of detector (cm)
+	double ch2_area;	///< Area of CH2 target (cm^2)
+	double ch2_distance;	///< Distance of CH2 target (cm)
+	double ch2_thickness;	///< Thickness of CH2 target (cm)
+	double c12_area;	///< Area of C12 target (cm^2)
+	double c12_distance;	///< Distance of C12 target (cm)
+	double c12_thickness;	///< Thickness of C12 target (cm)
+	double efficiency;	///< Efficiency of counting C11 decays in graphite
+	double ch2_factor;	///< Efficiency in CH2 relative to graphite
+	double half_life;	///< Half-life of C11 (min)
+	double ch2_density;	///< Density of CH2 (g/cm^3)
+	double c12_density;	///< Density of graphite (g/cm^3)
+
+	/**
+	 * Create the parameters of the 2012 experiment.
+	 */
+	Parameters();
+
+	/**
+	 * Load parameters from a csv file. Each row contains a name and a
+	 * value; rows whose value is not a number, such as headers, are
+	 * skipped, and parameters which are not given keep their values. A
+	 * missing file changes nothing.
+	 * @param filename The file to load.
+	 * @throw runtime_error A row names an unknown parameter.
+	 */
+	void Load( char const * filename );
+
+	/**
+	 * Set a parameter by name.
+	 * @param name The name of the parameter.
+	 * @param value The new value.
+	 * @return False if there is no such parameter.
+	 */
+	bool Set( char const * name, double value );
+
+	/**
+	 * Get a parameter by name.
+	 * @param name The name of the parameter.
+	 * @return The value, or NaN if there is no such parameter.
+	 */
+	double Get( char const * name ) const;
+
+	/**
+	 * Add the values of some groups of parameters to a fingerprint.
+	 * @param fp The fingerprint to add to.
+	 * @param groups The groups to add, combined with |.
+	 */
+	void AddTo( Fingerprint * fp, unsigned groups ) const;
+};
+
+/**
+ * Load a list or a grid of parameter sets from a csv file, for a sweep. 
+ *
+ * A list has a header row naming some parameters, then one row of values
+ * per set; an empty file, or a list with only its header, gives no sets.
+ * A grid has one row per parameter, each with its name followed by its 
+ * values, and gives every combination of those values; the first 
+ * parameter varies slowest.
+ * Parameters which are not named keep their values from base.
+ *
+ * @param filename The file to load.
+ * @param base The values of parameters which are not named.
+ * @param sets Filled with the parameter sets.
+ * @param names Filled with the names of the parameters which vary.
+ * @throw runtime_error The file names an unknown parameter, or a grid
+ * parameter has no values.
+ */
+void LoadParameterSets( char const * filename, Parameters const & base,
+		vector<Parameters> * sets, vector<string> * names );
+
+} // namespace n2n
+
+#endif
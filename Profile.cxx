@@ -0,0 +1,239 @@
+/**
+ * @file n2n/Profile.cxx
+ * Copyright (C) 2013 Houghton College
+ */
+
+#include "Profile.hxx"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace n2n {
+
+/**
+ * Timings and counters of one stage.
+ */
+struct ProfileStage
+{
+	int calls;			///< Number of times the stage was timed
+	double seconds;			///< Total time (s)
+	map<string, double> counters;	///< Counters, by name
+
+	ProfileStage() : calls( 0 ), seconds( 0 ) {}
+};
+
+/**
+ * One timed stage, for the trace.
+ */
+struct ProfileEvent
+{
+	char const * stage;	///< The stage
+	int run_number;		///< The run, or -1
+	int thread;		///< The thread which timed the stage
+	double start;		///< Start time (us)
+	double duration;	///< Duration (us)
+};
+
+/**
+ * The state of one thread. It is kept by thread id rather than in 
+ * thread_local variables, which the interpreter does not support.
+ */
+struct ProfileThread
+{
+	int number;		///< Number of the thread in the trace
+	int run_number;		///< The run of the thread, or -1
+
+	ProfileThread() : number( -1 ), run_number( -1 ) {}
+};
+
+static atomic<bool> profile_enabled( false );
+static mutex profile_lock;
+static map< pair<int, string>, ProfileStage > profile_stages;	// By run and stage
+static vector<ProfileEvent> profile_events;
+static map<thread::id, ProfileThread> profile_threads;
+
+/**
+ * Get the state of the calling thread. profile_lock must be held.
+ */
+ProfileThread & CurrentProfileThread()
+{
+	ProfileThread & t = profile_threads[this_thread::get_id()];
+	if ( t.number < 0 )
+		t.number = profile_threads.size() - 1;
+	return t;
+}
+
+/**
+ * Get the current time (us), for measuring intervals.
+ */
+double ProfileClock()
+{
+	return chrono::duration<double, micro>(
+			chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+void SetProfiling( bool enabled )
+{
+	profile_enabled = enabled;
+}
+
+bool ProfilingEnabled()
+{
+	return profile_enabled.load( memory_order_relaxed );
+}
+
+void ResetProfile()
+{
+	lock_guard<mutex> guard( profile_lock );
+	profile_stages.clear();
+	profile_events.clear();
+}
+
+void ProfileCount( char const * stage, char const * counter, double amount )
+{
+	if ( !ProfilingEnabled() )
+		return;
+
+	lock_guard<mutex> guard( profile_lock );
+	int run_number = CurrentProfileThread().run_number;
+	profile_stages[make_pair( run_number, string( stage ) )].counters[counter] += amount;
+}
+
+ProfileTimer::ProfileTimer( char const * stage )
+	: stage_( ProfilingEnabled() ? stage : NULL ), start_( 0 )
+{
+	if ( stage_ )
+		start_ = ProfileClock();
+}
+
+ProfileTimer::~ProfileTimer()
+{
+	if ( !stage_ )
+		return;
+
+	double duration = ProfileClock() - start_;
+	lock_guard<mutex> guard( profile_lock );
+	ProfileThread const & t = CurrentProfileThread();
+	ProfileEvent event = { stage_, t.run_number, t.number, start_, duration };
+	ProfileStage & stage = profile_stages[make_pair( t.run_number, string( stage_ ) )];
+	++stage.calls;
+	stage.seconds += duration * 1e-6;
+	profile_events.push_back( event );
+}
+
+ProfileRun::ProfileRun( int run_number )
+	: previous_( -1 ), enabled_( ProfilingEnabled() )
+{
+	if ( !enabled_ )
+		return;
+
+	lock_guard<mutex> guard( profile_lock );
+	ProfileThread & t = CurrentProfileThread();
+	previous_ = t.run_number;
+	t.run_number = run_number;
+}
+
+ProfileRun::~ProfileRun()
+{
+	if ( !enabled_ )
+		return;
+
+	lock_guard<mutex> guard( profile_lock );
+	CurrentProfileThread().run_number = previous_;
+}
+
+/**
+ * Write a stage as a JSON object.
+ */
+void WriteProfileStage( ostream & os, ProfileStage const & stage )
+{
+	os << "{ \"calls\": " << stage.calls << ", \"seconds\": " << stage.seconds;
+	map<string, double>::const_iterator i;
+	for ( i = stage.counters.begin(); i != stage.counters.end(); ++i )
+		os << ", \"" << i->first << "\": " << i->second;
+	os << " }";
+}
+
+void SaveProfile( char const * filename )
+{
+	lock_guard<mutex> guard( profile_lock );
+
+	// Totals of each stage over every run
+	map<string, ProfileStage> totals;
+	map< pair<int, string>, ProfileStage >::const_iterator i;
+	for ( i = profile_stages.begin(); i != profile_stages.end(); ++i )
+	{
+		ProfileStage & total = totals[i->first.second];
+		total.calls += i->second.calls;
+		total.seconds += i->second.seconds;
+		map<string, double>::const_iterator j;
+		for ( j = i->second.counters.begin(); j != i->second.counters.end(); ++j )
+			total.counters[j->first] += j->second;
+	}
+
+	std::ofstream os( filename );
+	os.precision( 15 );	// Exact byte counts
+	os << "{\n  \"stages\": {";
+	map<string, ProfileStage>::const_iterator j;
+	for ( j = totals.begin(); j != totals.end(); ++j )
+	{
+		os << (j == totals.begin() ? "\n" : ",\n") << "    \"" << j->first << "\": ";
+		WriteProfileStage( os, j->second );
+	}
+	os << " },\n  \"runs\": [";
+
+	// profile_stages is ordered by run, then by stage
+	int run_number = 0;
+	for ( i = profile_stages.begin(); i != profile_stages.end(); ++i )
+	{
+		if ( i == profile_stages.begin() || i->first.first != run_number )
+		{
+			if ( i != profile_stages.begin() )
+				os << " } },";
+			run_number = i->first.first;
+			os << "\n    { \"run\": ";
+			if ( run_number < 0 )
+				os << "null";
+			else
+				os << run_number;
+			os << ", \"stages\": {";
+		}
+		else
+			os << ",";
+		os << "\n      \"" << i->first.second << "\": ";
+		WriteProfileStage( os, i->second );
+	}
+	if ( !profile_stages.empty() )
+		os << " } }";
+	os << " ]\n}\n";
+}
+
+void SaveProfileTrace( char const * filename )
+{
+	lock_guard<mutex> guard( profile_lock );
+	double origin = profile_events.empty() ? 0 : profile_events[0].start;
+	for ( int i = 1; i < profile_events.size(); ++i )
+		if ( profile_events[i].start < origin )
+			origin = profile_events[i].start;
+
+	std::ofstream os( filename );
+	os << "{ \"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+	for ( int i = 0; i < profile_events.size(); ++i )
+	{
+		ProfileEvent const & e = profile_events[i];
+		os << (i ? ",\n" : "\n") << "  { \"name\": \"" << e.stage
+			<< "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << e.thread
+			<< ", \"ts\": " << TString::Format( "%.3f", e.start - origin )
+			<< ", \"dur\": " << TString::Format( "%.3f", e.duration );
+		if ( e.run_number >= 0 )
+			os << ", \"args\": { \"run\": " << e.run_number << " }";
+		os << " }";
+	}
+	os << " ] }\n";
+}
+
+} // namespace n2n
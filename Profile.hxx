@@ -0,0 +1,113 @@
+/**
+ * @file n2n/Profile.hxx
+ * Copyright (C) 2013 Houghton College
+ */
+
+#ifndef N2N_PROFILE_INCL_
+#define N2N_PROFILE_INCL_
+
+namespace n2n {
+
+/**
+ * Turn the collection of timings and counters on or off. Profiling is off
+ * by default, and then each timer and counter costs a single check.
+ * @param enabled True to collect timings and counters.
+ */
+void SetProfiling( bool enabled );
+
+/**
+ * Check whether timings and counters are collected.
+ */
+bool ProfilingEnabled();
+
+/**
+ * Discard every timing and counter collected so far.
+ */
+void ResetProfile();
+
+/**
+ * Add to a counter of a stage, e.g. the bytes parsed. Counters are
+ * aggregated by stage and by the run of the calling thread (see
+ * @ref ProfileRun).
+ * @param stage The stage, which must be a string literal.
+ * @param counter The counter, which must be a string literal.
+ * @param amount The amount to add.
+ */
+void ProfileCount( char const * stage, char const * counter, double amount = 1 );
+
+/**
+ * Time a stage from construction to destruction.
+ *
+ * @code
+ * {
+ * 	ProfileTimer timer( "decay_fit" );
+ * 	// Fit the decay curve
+ * }
+ * @endcode
+ */
+class ProfileTimer
+{
+	public:
+		/**
+		 * Start timing a stage.
+		 * @param stage The stage, which must be a string literal.
+		 */
+		ProfileTimer( char const * stage );
+
+		/**
+		 * Stop timing the stage.
+		 */
+		~ProfileTimer();
+
+	private:
+		char const * stage_;	///< The stage, or NULL if profiling is off
+		double start_;		///< Start time (us)
+
+		ProfileTimer( ProfileTimer const & );
+		ProfileTimer & operator=( ProfileTimer const & );
+};
+
+/**
+ * Attribute the timings and counters of the calling thread to a run, from
+ * construction to destruction.
+ */
+class ProfileRun
+{
+	public:
+		/**
+		 * Start attributing timings and counters to a run.
+		 * @param run_number The run.
+		 */
+		ProfileRun( int run_number );
+
+		/**
+		 * Restore the run which was current before.
+		 */
+		~ProfileRun();
+
+	private:
+		int previous_;		///< Run which was current before
+		bool enabled_;		///< False if profiling was off
+
+		ProfileRun( ProfileRun const & );
+		ProfileRun & operator=( ProfileRun const & );
+};
+
+/**
+ * Save the timings and counters of each stage as JSON, both for each run
+ * and in total. Times are wall clock seconds, and include the time of any
+ * stages nested within.
+ * @param filename The file to save.
+ */
+void SaveProfile( char const * filename );
+
+/**
+ * Save every timed stage as a trace in the Chrome trace event format,
+ * which can be viewed as a flame graph by chrome://tracing or Speedscope.
+ * @param filename The file to save.
+ */
+void SaveProfileTrace( char const * filename );
+
+} // namespace n2n
+
+#endif
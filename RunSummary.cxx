@@ -4,83 +4,574 @@
  */
 
 #include "RunSummary.hxx"
+#include "pipeline.hxx"
+#include "DataFile.hxx"
 #include "proton.hxx"
 #include "decay.hxx"
+#include "Dependencies.hxx"
+#include "FitCache.hxx"
+#include "Log.hxx"
+#include "Profile.hxx"
+
+#include <climits>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
 
 namespace n2n {
 
+RunSummary::RunSummary()
+	: cache_( NULL ), num_workers_( 1 ), read_ahead_( 4 ),
+	  fit_method_( decay::FIT_MINUIT ), deps_( NULL )
+{
+	// Only the saves which finish a campaign write the sidecar; see
+	// pipeline::Recalculate and pipeline::MergeShards
+	SetSchema( "RunSummary", 2, RS_NUM_COLUMNS );
+	SetWriteBinary( false );
+}
+
+void RunSummary::Load( char const * filename )
+{
+	CSVFile::Load( filename );
+
+	// Rows 0 and 1 are headers
+	rows_.clear();
+	run_numbers_.clear();
+	index_.clear();
+	for ( int i = 2; i < NumRows(); ++i )
+	{
+		double value;
+		FieldKind kind = GetValue( i, RS_RUN_NUMBER, &value );
+		if ( kind == FIELD_EMPTY )
+			continue;
+
+		if ( kind != FIELD_NUMBER || !(value >= INT_MIN && value <= INT_MAX) ||
+				value != (int) value )
+		{
+			LogMessage( LOG_WARNING, TString::Format( 
+				"%s row %d: skipping invalid run number '%s'", 
+				filename, i + 1, GetRow( i )[RS_RUN_NUMBER].c_str() ) );
+			continue;
+		}
+
+		int run_number = (int) value;
+		rows_.push_back( i );
+		run_numbers_.push_back( run_number );
+		pair<unordered_map<int, int>::iterator, bool> inserted = 
+			index_.insert( make_pair( run_number, i ) );
+		if ( !inserted.second )
+			LogMessage( LOG_WARNING, TString::Format( 
+				"%s row %d: duplicate run %d, using row %d", 
+				filename, i + 1, run_number, inserted.first->second + 1 ) );
+	}
+	LogMessage( LOG_DEBUG, TString::Format( "%s: %d runs", 
+				filename, (int) rows_.size() ) );
+}
+
+int RunSummary::RunRow( int run_number ) const
+{
+	unordered_map<int, int>::const_iterator i = index_.find( run_number );
+	if ( i == index_.end() )
+	{
+		TString msg = TString::Format( "Run %d is not in the run summary", run_number );
+		LogMessage( LOG_ERROR, msg );
+		throw runtime_error( msg.Data() );
+	}
+	return i->second;
+}
+
 vector<string> RunSummary::GetRun( int run_number ) const
 {
-	vector<string> row = GetRow( run_number + 2 );
-	cout << row[n2n::RS_RUN_NUMBER] << "\t" << run_number << endl;
-	assert( atoi( row[n2n::RS_RUN_NUMBER].c_str() ) == run_number );
-	return row;
+	return GetRow( RunRow( run_number ) );
+}
+
+double RunSummary::GetRunValue( int run_number, int col ) const
+{
+	double value;
+	GetValue( RunRow( run_number ), col, &value );
+	return value;
 }
 
 void RunSummary::SetRun( int run_number, vector<string> const & row )
 {
-	assert( atoi( row[n2n::RS_RUN_NUMBER].c_str() ) == run_number );
-	SetRow( run_number + 2, row );
+	int row_number = RunRow( run_number );
+	CheckRunNumber( row_number, row );
+	SetRow( row_number, row );
+}
+
+bool RunSummary::HasRun( int run_number ) const
+{
+	return index_.count( run_number ) != 0;
 }
 
 int RunSummary::NumRuns() const
 {
-	return NumRows() - 2;
+	return rows_.size();
+}
+
+vector<string> RunSummary::GetRunAt( int index ) const
+{
+	return GetRow( rows_[index] );
+}
+
+int RunSummary::GetRunNumberAt( int index ) const
+{
+	return run_numbers_[index];
+}
+
+void RunSummary::SetRunAt( int index, vector<string> const & row )
+{
+	CheckRunNumber( rows_[index], row );
+	SetRow( rows_[index], row );
+}
+
+void RunSummary::CheckRunNumber( int row_number, vector<string> const & row ) const
+{
+	vector<CSVField> fields;
+	GetFields( row_number, &fields );
+	if ( row.empty() || row[RS_RUN_NUMBER] != fields[RS_RUN_NUMBER].ToString() )
+	{
+		TString msg = TString::Format( "Run number of row %d cannot change", 
+				row_number + 1 );
+		LogMessage( LOG_ERROR, msg );
+		throw runtime_error( msg.Data() );
+	}
+}
+
+/**
+ * Describe a decay fit in the cache.
+ */
+TString DecayFitConfig( decay::FitMethod method, double half_life )
+{
+	TString config = TString::Format( "decay half_life=%.15g", half_life );
+	if ( method != decay::FIT_MINUIT )
+		config += " method=linear";
+	else
+		config += TString::Format( " minimizer=%s", decay::MINIMIZER );
+	return config;
+}
+
+bool LookupDecayFit( char const * filename, FitCache * cache,
+		decay::FitMethod method, double half_life, decay::FitResult * fit )
+{
+	vector<string> values;
+	if ( cache && method != decay::FIT_CROSSCHECK &&
+			cache->Lookup( filename, DecayFitConfig( method, half_life ), 
+				&values ) && values.size() == 8 )
+	{
+		fit->n0.val = atof( values[0].c_str() );
+		fit->n0.unc = atof( values[1].c_str() );
+		fit->a.val = atof( values[2].c_str() );
+		fit->a.unc = atof( values[3].c_str() );
+		fit->lambda = atof( values[4].c_str() );
+		fit->chi2 = atof( values[5].c_str() );
+		fit->ndf = atoi( values[6].c_str() );
+		fit->status = atoi( values[7].c_str() );
+		ProfileCount( "decay_fit", "cache_hits" );
+		return true;
+	}
+	ProfileCount( "decay_fit", "cache_misses" );
+	return false;
+}
+
+void StoreDecayFit( char const * filename, FitCache * cache,
+		decay::FitMethod method, double half_life, decay::FitResult const & fit )
+{
+	if ( !cache || method == decay::FIT_CROSSCHECK )
+		return;
+
+	vector<string> values( 8 );
+	values[0] = TString::Format( "%.17g", fit.n0.val );
+	values[1] = TString::Format( "%.17g", fit.n0.unc );
+	values[2] = TString::Format( "%.17g", fit.a.val );
+	values[3] = TString::Format( "%.17g", fit.a.unc );
+	values[4] = TString::Format( "%.17g", fit.lambda );
+	values[5] = TString::Format( "%.17g", fit.chi2 );
+	values[6] = TString::Format( "%d", fit.ndf );
+	values[7] = TString::Format( "%d", fit.status );
+	cache->Store( filename, DecayFitConfig( method, half_life ), values );
+}
+
+/**
+ * Describe a count of the protons in a region of interest in the cache.
+ */
+TString ProtonCountConfig( Region const & roi )
+{
+	return TString::Format( "protons roi=%d %d %d %d",
+			roi.min_x, roi.max_x, roi.min_y, roi.max_y );
+}
+
+/**
+ * Look up a count of the protons in a region of interest in the cache.
+ * @return False if they must be counted.
+ */
+bool LookupProtonCount( char const * filename, Region const & roi, FitCache * cache,
+		Int_t * protons )
+{
+	vector<string> values;
+	if ( cache && cache->Lookup( filename, ProtonCountConfig( roi ), &values ) && 
+			values.size() == 1 )
+	{
+		ProfileCount( "proton_count", "cache_hits" );
+		*protons = atoi( values[0].c_str() );
+		return true;
+	}
+	ProfileCount( "proton_count", "cache_misses" );
+	return false;
+}
+
+/**
+ * Store a count of the protons in a region of interest in the cache, if any.
+ */
+void StoreProtonCount( char const * filename, Region const & roi, FitCache * cache,
+		Int_t protons )
+{
+	if ( cache )
+		cache->Store( filename, ProtonCountConfig( roi ), 
+				vector<string>( 1, string( TString::Format( "%d", protons ) ) ) );
+}
+
+/**
+ * Look up the region of interest and the protons in it of an .mpa file,
+ * read both from the same file, in the cache.
+ * @return False if they must be counted.
+ */
+bool LookupProtonMPA( char const * filename, FitCache * cache, Region * roi,
+		Int_t * protons )
+{
+	vector<string> values;
+	if ( cache && cache->Lookup( filename, "protons mpa", &values ) && values.size() == 5 )
+	{
+		ProfileCount( "proton_count", "cache_hits" );
+		roi->min_x = atoi( values[0].c_str() );
+		roi->max_x = atoi( values[1].c_str() );
+		roi->min_y = atoi( values[2].c_str() );
+		roi->max_y = atoi( values[3].c_str() );
+		*protons = atoi( values[4].c_str() );
+		return true;
+	}
+	ProfileCount( "proton_count", "cache_misses" );
+	return false;
+}
+
+/**
+ * Store the region of interest and the protons in it of an .mpa file in 
+ * the cache, if any.
+ */
+void StoreProtonMPA( char const * filename, FitCache * cache, Region const & roi,
+		Int_t protons )
+{
+	if ( !cache )
+		return;
+
+	vector<string> values( 5 );
+	values[0] = TString::Format( "%d", roi.min_x );
+	values[1] = TString::Format( "%d", roi.max_x );
+	values[2] = TString::Format( "%d", roi.min_y );
+	values[3] = TString::Format( "%d", roi.max_y );
+	values[4] = TString::Format( "%d", protons );
+	cache->Store( filename, "protons mpa", values );
 }
 
-void UpdateC11( vector<string> & run, char const * dirname )
+/**
+ * A decay curve of a run, read ahead of its fit.
+ */
+struct DecayCurveFile
+{
+	TString filename;	///< Path to the curve
+	bool exists;		///< Whether the curve was counted
+	bool cached;		///< Whether its fit was found in the cache
+	decay::FitResult fit;	///< The cached fit
+	DataFile data;		///< Contents of the curve, unless cached
+};
+
+/**
+ * Read a decay curve, unless its fit is cached.
+ */
+void ReadCurveFile( DecayCurveFile * curve, FitCache * cache, 
+		decay::FitMethod method, double half_life )
+{
+	curve->cached = false;
+	if ( !curve->exists )
+		return;
+
+	curve->cached = LookupDecayFit( curve->filename, cache, method, half_life,
+			&curve->fit );
+	if ( !curve->cached )
+	{
+		ProfileTimer timer( "decay_read" );
+		curve->data.Load( curve->filename );
+	}
+}
+
+/**
+ * Fit a decay curve which has been read, or use its cached fit.
+ */
+decay::FitResult FitCurveFile( DecayCurveFile const & curve, FitCache * cache,
+		decay::FitMethod method, double half_life )
+{
+	if ( curve.cached )
+		return curve.fit;
+
+	TGraphErrors * ge = decay::ParseDataFile( curve.data );
+	decay::FitResult fit = decay::Fit( ge, method, half_life );
+	delete ge;
+
+	StoreDecayFit( curve.filename, cache, method, half_life, fit );
+	return fit;
+}
+
+/**
+ * Run summary columns which the C11 decays depend on, besides the decay
+ * curves, the half-life and the efficiencies
+ */
+int const C11_INPUTS[] = { RS_RUN_NUMBER, RS_INTERIM_TIME };
+int const C11_OUTPUTS[] = { RS_CH2_DECAY, RS_CH2_DECAY_ERR, RS_C12_DECAY, RS_C12_DECAY_ERR };
+int const NUM_C11_INPUTS = sizeof( C11_INPUTS ) / sizeof( C11_INPUTS[0] );
+int const NUM_C11_OUTPUTS = sizeof( C11_OUTPUTS ) / sizeof( C11_OUTPUTS[0] );
+
+/**
+ * The decay curves of a run, read ahead of their fits.
+ */
+struct C11Files
+{
+	Fingerprint inputs;	///< Inputs of the C11 decays
+	bool unchanged;		///< Whether the recorded C11 decays are up to date
+	DecayCurveFile puck;	///< Decay curve of the graphite
+	DecayCurveFile plastic;	///< Decay curve of the CH2
+};
+
+/**
+ * Read the decay curves of a run which must be fit.
+ */
+void ReadC11( vector<string> const & run, char const * dirname, FitCache * cache,
+		decay::FitMethod method, Parameters const & params, Dependencies * deps,
+		C11Files * files )
 {
 	int run_number = atoi( run[n2n::RS_RUN_NUMBER].c_str() );
-	char const * filename_puck = 
-		gSystem->PrependPathName( dirname,
-				TString::Format( "Run%03d_puck.csv", run_number ) );
-	char const * filename_plastic =
-		gSystem->PrependPathName( dirname,
-				TString::Format( "Run%03d_plastic.csv", run_number ) );
+	files->puck.filename = pipeline::DataPath( dirname,
+			TString::Format( "Run%03d_puck.csv", run_number ) );
+	files->plastic.filename = pipeline::DataPath( dirname,
+			TString::Format( "Run%03d_plastic.csv", run_number ) );
+
+	{
+		ProfileTimer timer( "file_checks" );
+		files->puck.exists = files->inputs.AddFile( files->puck.filename );
+		files->plastic.exists = files->inputs.AddFile( files->plastic.filename );
+	}
+
+	files->unchanged = false;
+	if ( deps )
+	{
+		files->inputs.Add( run, C11_INPUTS, NUM_C11_INPUTS );
+		files->inputs.Add( (double) method );
+		params.AddTo( &files->inputs, PAR_HALF_LIFE | PAR_EFFICIENCY );
+		Fingerprint fp = files->inputs;
+		fp.Add( run, C11_OUTPUTS, NUM_C11_OUTPUTS );
+		files->unchanged = deps->Unchanged( 
+				TString::Format( "run %d c11", run_number ), fp );
+		if ( files->unchanged )
+			return;
+	}
+
+	ReadCurveFile( &files->puck, cache, method, params.half_life );
+	ReadCurveFile( &files->plastic, cache, method, params.half_life );
+}
+
+/**
+ * Fit the decay curves of a run which have been read, and calculate the
+ * C11 decays.
+ */
+void FitC11( vector<string> & run, C11Files const & files, FitCache * cache,
+		decay::FitMethod method, Parameters const & params, Dependencies * deps )
+{
+	if ( files.unchanged )
+	{
+		ProfileCount( "update_run", "c11_skipped" );
+		return;
+	}
 
 	double trans_time = atoi( run[n2n::RS_INTERIM_TIME].c_str() ) / 60.0;	// min
-	
-	// NOTE: TSystem::AccessPathName returns *false* if the file exists!
-	// http://root.cern.ch/root/html/TSystem.html#TSystem:AccessPathName
-	if ( !gSystem->AccessPathName( filename_puck ) )
-	{
-		TGraphErrors * ge = decay::ParseDataFile( filename_puck );
-		TFitResultPtr fr = decay::FitDecayCurve( ge );
-		UncertainD n_c11 = decay::Counts( fr, trans_time, 0.12 );
+	if ( files.puck.exists )
+	{
+		decay::FitResult fit = FitCurveFile( files.puck, cache, method, 
+				params.half_life );
+		UncertainD n_c11 = decay::Counts( fit, trans_time, params.efficiency );
 		n2n::WriteUncertainD( n_c11, &run, RS_C12_DECAY, RS_C12_DECAY_ERR );
-		delete ge;
 	}
 
-	if ( !gSystem->AccessPathName( filename_plastic ) )
+	if ( files.plastic.exists )
 	{
-		TGraphErrors * ge = decay::ParseDataFile( filename_plastic );
-		TFitResultPtr fr = decay::FitDecayCurve( ge );
-		UncertainD n_c11 = decay::Counts( fr, trans_time, 0.12 * 5.83 );
+		decay::FitResult fit = FitCurveFile( files.plastic, cache, method,
+				params.half_life );
+		UncertainD n_c11 = decay::Counts( fit, trans_time, 
+				params.efficiency * params.ch2_factor );
 		n2n::WriteUncertainD( n_c11, &run, RS_CH2_DECAY, RS_CH2_DECAY_ERR );
-		delete ge;
+	}
+
+	if ( deps )
+	{
+		Fingerprint fp = files.inputs;
+		fp.Add( run, C11_OUTPUTS, NUM_C11_OUTPUTS );
+		deps->Record( TString::Format( "run %d c11", 
+					atoi( run[n2n::RS_RUN_NUMBER].c_str() ) ), fp );
 	}
 }
 
-void UpdateProtons( vector<string> & run, char const * dirname )
+/**
+ * Run summary columns which the protons depend on, besides the spectra
+ */
+int const PROTON_INPUTS[] = { RS_RUN_NUMBER, RS_DE_DEAD, RS_E_DEAD };
+int const PROTON_OUTPUTS[] = { RS_ROI_XMIN, RS_ROI_XMAX, RS_ROI_YMIN, RS_ROI_YMAX,
+	RS_PROTONS, RS_TOTAL_LIVE };
+int const NUM_PROTON_INPUTS = sizeof( PROTON_INPUTS ) / sizeof( PROTON_INPUTS[0] );
+int const NUM_PROTON_OUTPUTS = sizeof( PROTON_OUTPUTS ) / sizeof( PROTON_OUTPUTS[0] );
+
+/**
+ * Where the protons of a run are counted from
+ */
+enum ProtonSource {
+	PROTONS_NONE,	///< Nowhere; the run has no spectrum
+	PROTONS_CSV,	///< The .csv data file
+	PROTONS_SPC,	///< The binary spectrum file of the .csv data file
+	PROTONS_MPA	///< The spectrum of the .mpa file
+};
+
+/**
+ * The proton spectrum of a run, read ahead of its count.
+ */
+struct ProtonFiles
+{
+	TString filename_csv;	///< Path to the .csv data file
+	TString filename_mpa;	///< Path to the .mpa file
+	TString filename_spc;	///< Path to the binary spectrum file
+	Fingerprint inputs;	///< Inputs of the protons
+	bool unchanged;		///< Whether the recorded protons are up to date
+	ProtonSource source;	///< Where the protons are counted from
+	bool cached;		///< Whether the count was found in the cache
+	Region roi;		///< Region of interest, if known
+	Int_t protons;		///< The cached count
+	vector<proton::SpectrumEntry> entries;	///< Spectrum of the binary spectrum file
+	DataFile data;		///< Contents of the .csv data file or .mpa file
+};
+
+/**
+ * Read the proton spectrum of a run which must be counted.
+ */
+void ReadProtons( vector<string> const & run, char const * dirname, FitCache * cache,
+		Dependencies * deps, ProtonFiles * files )
 {
 	int run_number = atoi( run[n2n::RS_RUN_NUMBER].c_str() );
-	char const * filename_csv =
-		gSystem->PrependPathName( dirname,
-				TString::Format( "Run%03d_1x2.csv", run_number ) );
-	char const * filename_mpa =
-		gSystem->PrependPathName( dirname,
-				TString::Format( "Run%03d.mpa", run_number ) );
-
-	// NOTE: TSystem::AccessPathName returns *false* if the file exists!
-	// http://root.cern.ch/root/html/TSystem.html#TSystem:AccessPathName
-	if ( !gSystem->AccessPathName( filename_csv ) &&
-			!gSystem->AccessPathName( filename_mpa ) )
-	{
-		TH2I * data = proton::ParseDataFile( filename_csv );
-		Region roi = proton::ParseHeaderFile( filename_mpa );
-		Int_t protons = proton::CountsInRegion( data, roi );
-		delete data;
+	files->filename_csv = pipeline::DataPath( dirname,
+			TString::Format( "Run%03d_1x2.csv", run_number ) );
+	files->filename_mpa = pipeline::DataPath( dirname,
+			TString::Format( "Run%03d.mpa", run_number ) );
+
+	files->filename_spc = proton::SpectrumFileName( files->filename_csv );
+	bool use_spc, have_csv, have_mpa;
+	{
+		ProfileTimer timer( "file_checks" );
+		use_spc = proton::UseSpectrumFile( files->filename_csv, files->filename_mpa,
+				files->filename_spc );
+		have_csv = files->inputs.AddFile( files->filename_csv );
+		have_mpa = files->inputs.AddFile( files->filename_mpa );
+	}
+
+	files->unchanged = false;
+	if ( deps )
+	{
+		files->inputs.AddFile( files->filename_spc );
+		files->inputs.Add( run, PROTON_INPUTS, NUM_PROTON_INPUTS );
+		Fingerprint fp = files->inputs;
+		fp.Add( run, PROTON_OUTPUTS, NUM_PROTON_OUTPUTS );
+		files->unchanged = deps->Unchanged( 
+				TString::Format( "run %d protons", run_number ), fp );
+		if ( files->unchanged )
+			return;
+	}
+
+	files->source = PROTONS_NONE;
+	files->cached = false;
+	if ( use_spc || (have_csv && have_mpa) )
+	{
+		files->source = use_spc ? PROTONS_SPC : PROTONS_CSV;
+		files->roi = use_spc ? proton::ParseSpectrumHeader( files->filename_spc ) :
+			proton::ParseHeaderFile( files->filename_mpa );
+		files->cached = LookupProtonCount( 
+				use_spc ? files->filename_spc : files->filename_csv, files->roi, 
+				cache, &files->protons );
+		if ( !files->cached )
+		{
+			ProfileTimer timer( "proton_read" );
+			Region roi;
+			if ( use_spc )
+				proton::ReadSpectrumFile( files->filename_spc, &roi, &files->entries );
+			else
+				files->data.Load( files->filename_csv );
+		}
+	}
+	else if ( have_mpa )
+	{
+		// Without an exported .csv data file, read the spectrum of the .mpa file
+		files->source = PROTONS_MPA;
+		files->cached = LookupProtonMPA( files->filename_mpa, cache, &files->roi,
+				&files->protons );
+		if ( !files->cached )
+		{
+			ProfileTimer timer( "proton_read" );
+			files->data.Load( files->filename_mpa );
+		}
+	}
+}
 
+/**
+ * Count the protons of a run whose spectrum has been read, and calculate
+ * the live time of the proton telescope.
+ */
+void CountProtons( vector<string> & run, ProtonFiles const & files, FitCache * cache,
+		Dependencies * deps )
+{
+	if ( files.unchanged )
+	{
+		ProfileCount( "update_run", "protons_skipped" );
+		return;
+	}
+
+	Region roi = files.roi;
+	Int_t protons = files.protons;
+	bool counted = files.cached;
+	if ( !counted && files.source == PROTONS_CSV )
+	{
+		protons = proton::CountDataFile( files.data, roi );
+		StoreProtonCount( files.filename_csv, roi, cache, protons );
+		counted = true;
+	}
+	else if ( !counted && files.source == PROTONS_SPC )
+	{
+		ProfileTimer timer( "proton_count" );
+		protons = proton::CountEntries( files.entries, roi );
+		StoreProtonCount( files.filename_spc, roi, cache, protons );
+		counted = true;
+	}
+	else if ( !counted && files.source == PROTONS_MPA )
+	{
+		ProfileTimer timer( "proton_count" );
+		vector<proton::SpectrumEntry> entries;
+		counted = proton::ParseMPAFile( files.data, &roi, &entries );
+		if ( counted )
+		{
+			protons = proton::CountEntries( entries, roi );
+			StoreProtonMPA( files.filename_mpa, cache, roi, protons );
+		}
+		else
+			LogMessage( LOG_WARNING, TString::Format( 
+				"%s holds no spectrum, and %s was not exported", 
+				files.filename_mpa.Data(), files.filename_csv.Data() ) );
+	}
+
+	if ( counted )
+	{
 		run[n2n::RS_ROI_XMIN] = TString::Format( "%d", roi.min_x );
 		run[n2n::RS_ROI_XMAX] = TString::Format( "%d", roi.max_x );
 		run[n2n::RS_ROI_YMIN] = TString::Format( "%d", roi.min_y );
@@ -93,18 +584,290 @@ void UpdateProtons( vector<string> & run, char const * dirname )
 	float de_dead = atof( run[n2n::RS_DE_DEAD].c_str() );
 	float live = 1 - sqrt( e_dead * e_dead + de_dead * de_dead );
 	run[n2n::RS_TOTAL_LIVE] = TString::Format( "%f", live );
+
+	if ( deps )
+	{
+		Fingerprint fp = files.inputs;
+		fp.Add( run, PROTON_OUTPUTS, NUM_PROTON_OUTPUTS );
+		deps->Record( TString::Format( "run %d protons", 
+					atoi( run[n2n::RS_RUN_NUMBER].c_str() ) ), fp );
+	}
 }
 
+/**
+ * The raw files of a run, read ahead of the fits and counts which need them.
+ */
+struct RunFiles
+{
+	C11Files c11;		///< Decay curves
+	ProtonFiles protons;	///< Proton spectrum
+};
+
+/**
+ * Runs to be updated, shared between the thread which reads their files
+ * and the worker threads which fit and count them.
+ */
+struct UpdateTask
+{
+	vector< vector<string> > runs;	///< The runs to update
+	vector<RunFiles *> files;	///< Files of each run read ahead, until taken
+	int read_ahead;			///< Runs which may be read before they are taken
+	int next_read;			///< Index of the next run to read
+	int next;			///< Index of the next run to update
+	bool stop;			///< Whether a thread failed
+	mutex lock;			///< Protects files, next_read, next and stop
+	condition_variable changed;	///< Signalled when any of them change
+	char const * dirname_decay;	///< Directory containing decay curves
+	char const * dirname_proton;	///< Directory containing proton data
+	FitCache * cache;		///< Cache of previous results, or NULL
+	decay::FitMethod fit_method;	///< Method used to fit decay curves
+	Parameters const * params;	///< Half-life and efficiencies
+	Dependencies * deps;		///< Record of previous results, or NULL
+	exception_ptr error;		///< First error thrown by a thread
+};
+
+/**
+ * Read the raw files of a run which are needed to update it.
+ */
+void ReadRun( UpdateTask const * task, int i, RunFiles * files )
+{
+	n2n::ReadC11( task->runs[i], task->dirname_decay, task->cache, task->fit_method,
+			*task->params, task->deps, &files->c11 );
+	n2n::ReadProtons( task->runs[i], task->dirname_proton, task->cache, task->deps,
+			&files->protons );
+}
+
+/**
+ * Stop every thread of a task after an error, keeping the first error.
+ * Must be called from a catch block.
+ */
+void StopUpdate( UpdateTask * task )
+{
+	lock_guard<mutex> guard( task->lock );
+	if ( !task->error )
+		task->error = current_exception();
+	task->stop = true;
+	task->changed.notify_all();
+}
+
+/**
+ * Check whether the next run must wait to be read until the workers take
+ * more of the runs already read.
+ */
+bool ReadAheadFull( UpdateTask const * task )
+{
+	return !task->stop && task->next_read < task->runs.size() &&
+		task->next_read >= task->next + task->read_ahead;
+}
+
+/**
+ * Read the files of runs from a task in order, up to read_ahead runs 
+ * ahead of the workers, until none remain.
+ */
+void ReadRuns( UpdateTask * task )
+{
+	for ( ;; )
+	{
+		int i;
+		{
+			unique_lock<mutex> guard( task->lock );
+			if ( ReadAheadFull( task ) )
+				ProfileCount( "read_run", "waits" );
+			while ( ReadAheadFull( task ) )
+				task->changed.wait( guard );
+			if ( task->stop || task->next_read >= task->runs.size() )
+				return;
+			i = task->next_read++;
+		}
+
+		RunFiles * files = new RunFiles;
+		try
+		{
+			ProfileRun profile_run( atoi( task->runs[i][RS_RUN_NUMBER].c_str() ) );
+			ProfileTimer timer( "read_run" );
+			ReadRun( task, i, files );
+		}
+		catch ( ... )
+		{
+			delete files;
+			StopUpdate( task );
+			return;
+		}
+
+		lock_guard<mutex> guard( task->lock );
+		task->files[i] = files;
+		task->changed.notify_all();
+	}
+}
+
+/**
+ * Update runs from a task in order until none remain, taking the files 
+ * read ahead of them, or reading them if nothing is read ahead.
+ */
+void UpdateRuns( UpdateTask * task )
+{
+	for ( ;; )
+	{
+		int i;
+		RunFiles * files = NULL;
+		{
+			unique_lock<mutex> guard( task->lock );
+			if ( task->stop || task->next >= task->runs.size() )
+				return;
+			i = task->next++;
+			task->changed.notify_all();
+
+			if ( task->read_ahead > 0 )
+			{
+				if ( !task->files[i] )
+					ProfileCount( "update_run", "read_waits" );
+				while ( !task->stop && !task->files[i] )
+					task->changed.wait( guard );
+				if ( task->stop )
+					return;
+				files = task->files[i];
+				task->files[i] = NULL;
+			}
+		}
+
+		try
+		{
+			ProfileRun profile_run( atoi( task->runs[i][RS_RUN_NUMBER].c_str() ) );
+			ProfileTimer timer( "update_run" );
+			if ( !files )
+			{
+				files = new RunFiles;
+				ReadRun( task, i, files );
+			}
+			n2n::FitC11( task->runs[i], files->c11, task->cache, task->fit_method,
+					*task->params, task->deps );
+			n2n::CountProtons( task->runs[i], files->protons, task->cache,
+					task->deps );
+		}
+		catch ( ... )
+		{
+			StopUpdate( task );
+		}
+		delete files;
+	}
+}
 
 void RunSummary::Update( char const * dirname )
 {
-	for ( int i = 1; i < NumRuns(); ++i )
+	Update( dirname, INT_MIN, INT_MAX );
+}
+
+void RunSummary::Update( char const * dirname, int first_run, int last_run )
+{
+	TString dirname_decay = pipeline::DataPath( dirname, "Decay Curves" );
+	TString dirname_proton = pipeline::DataPath( dirname,
+			"Proton Telescope" );
+
+	UpdateTask task;
+	task.read_ahead = read_ahead_;
+	task.next_read = 0;
+	task.next = 0;
+	task.stop = false;
+	task.dirname_decay = dirname_decay;
+	task.dirname_proton = dirname_proton;
+	task.cache = cache_;
+	task.fit_method = fit_method_;
+	task.params = &params_;
+	task.deps = deps_;
+	vector<int> rows;
+	FindRuns( first_run, last_run, &rows );
+	for ( int i = 0; i < rows.size(); ++i )
+		task.runs.push_back( GetRow( rows[i] ) );
+	task.files.assign( task.runs.size(), NULL );
+
+	int num_workers = num_workers_ > 0 ? num_workers_ : 
+		thread::hardware_concurrency();
+	if ( num_workers > task.runs.size() )
+		num_workers = task.runs.size();
+	bool reader = task.read_ahead > 0 && !task.runs.empty();
+
+	if ( num_workers > 1 || reader )
+		ROOT::EnableThreadSafety();
+
+	// The files of the next runs are read while the current runs are fit
+	{
+		decay::MinimizerScope minimizer;
+		vector<thread> threads;
+		if ( reader )
+			threads.push_back( thread( ReadRuns, &task ) );
+		for ( int i = 1; i < num_workers; ++i )
+			threads.push_back( thread( UpdateRuns, &task ) );
+		UpdateRuns( &task );
+		for ( int i = 0; i < threads.size(); ++i )
+			threads[i].join();
+	}
+
+	for ( int i = 0; i < task.files.size(); ++i )
+		delete task.files[i];
+	if ( task.error )
+		rethrow_exception( task.error );
+
+	for ( int i = 0; i < task.runs.size(); ++i )
+		SetRow( rows[i], task.runs[i] );
+}
+
+void RunSummary::FindRuns( int first_run, int last_run, vector<int> * rows ) const
+{
+	rows->clear();
+	for ( int i = 0; i < rows_.size(); ++i )
 	{
-		vector<string> run = GetRun( i );
-		n2n::UpdateC11( run, gSystem->PrependPathName( dirname, "Decay Curves" ) );
-		n2n::UpdateProtons( run, gSystem->PrependPathName( dirname, "Proton Telescope" ) );
-		SetRun( i, run );
+		int run_number = run_numbers_[i];
+		if ( run_number != 0 && run_number >= first_run && run_number <= last_run )
+			rows->push_back( rows_[i] );
 	}
 }
 
+void RunSummary::UpdateRun( int run_number, char const * dirname )
+{
+	TString dirname_decay = pipeline::DataPath( dirname, "Decay Curves" );
+	TString dirname_proton = pipeline::DataPath( dirname,
+			"Proton Telescope" );
+
+	ProfileRun profile_run( run_number );
+	ProfileTimer timer( "update_run" );
+	vector<string> run = GetRun( run_number );
+	RunFiles files;
+	decay::MinimizerScope minimizer;
+	n2n::ReadC11( run, dirname_decay, cache_, fit_method_, params_, deps_, &files.c11 );
+	n2n::ReadProtons( run, dirname_proton, cache_, deps_, &files.protons );
+	n2n::FitC11( run, files.c11, cache_, fit_method_, params_, deps_ );
+	n2n::CountProtons( run, files.protons, cache_, deps_ );
+	SetRun( run_number, run );
+}
+
+void RunSummary::SetFitCache( FitCache * cache )
+{
+	cache_ = cache;
+}
+
+void RunSummary::SetNumWorkers( int num_workers )
+{
+	num_workers_ = num_workers;
+}
+
+void RunSummary::SetReadAhead( int num_runs )
+{
+	read_ahead_ = num_runs;
+}
+
+void RunSummary::SetFitMethod( decay::FitMethod method )
+{
+	fit_method_ = method;
+}
+
+void RunSummary::SetParameters( Parameters const & params )
+{
+	params_ = params;
+}
+
+void RunSummary::SetDependencies( Dependencies * deps )
+{
+	deps_ = deps;
+}
+
 } // namespace n2n
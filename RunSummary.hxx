@@ -7,9 +7,16 @@
 #define N2N_RUNSUMMARY_INCL_
 
 #include "CSVFile.hxx"
+#include "Parameters.hxx"
+#include "decay.hxx"
+
+#include <unordered_map>
 
 namespace n2n {
 
+struct Dependencies;
+struct FitCache;
+
 /**
  * Run summary column names
  */
@@ -73,32 +80,204 @@ enum RSFields {
 struct RunSummary : public CSVFile
 {
 	public:
+		RunSummary();
+
+		/**
+		 * Load a run summary, and index its runs by number. Rows 
+		 * without a run number are skipped; if a run number appears
+		 * more than once, the first row is used and a warning logged.
+		 * While its sidecar can be trusted, the run numbers are read 
+		 * from it, and the text only when a run is first retrieved.
+		 * @param filename The file to load.
+		 */
+		virtual void Load( char const * filename );
+
 		/**
 		 * Retrieve a run by number.
 		 * @param run_number The run to retrieve.
 		 * @return The requested run.
+		 * @throw runtime_error The run is not in the summary.
 		 */
 		vector<string> GetRun( int run_number ) const;
 
+		/**
+		 * Get a numeric field of a run, from the sidecar while it can be
+		 * trusted, so that the text need not be read.
+		 * @param run_number The run.
+		 * @param col The field, e.g. RS_INTERIM_TIME.
+		 * @return The value, as atof() would convert the field.
+		 * @throw runtime_error The run is not in the summary.
+		 */
+		double GetRunValue( int run_number, int col ) const;
+
 		/**
 		 * Save a run by number.
 		 * @param run_number The run to save.
-		 * @param row The values to write.
+		 * @param row The values to write; the run number must not change.
 		 */
 		void SetRun( int run_number, vector<string> const & row );
 
 		/**
-		 * Get the number of runs in the file
+		 * Check whether a run is in the summary.
+		 * @param run_number The run to look for.
+		 */
+		bool HasRun( int run_number ) const;
+
+		/**
+		 * Get the number of runs in the file, counting each row with a
+		 * run number, including duplicates.
 		 */
 		int NumRuns() const;
 
 		/**
-		 * Calculate the number of C11 nuclei and protons for each run.
+		 * Retrieve a run by its position in the file.
+		 * @param index The position, from 0 to NumRuns() - 1.
+		 * @return The requested run.
+		 */
+		vector<string> GetRunAt( int index ) const;
+
+		/**
+		 * Get the number of a run by its position in the file.
+		 * @param index The position, from 0 to NumRuns() - 1.
+		 */
+		int GetRunNumberAt( int index ) const;
+
+		/**
+		 * Save a run by its position in the file.
+		 * @param index The position, from 0 to NumRuns() - 1.
+		 * @param row The values to write; the run number must not change.
+		 */
+		void SetRunAt( int index, vector<string> const & row );
+
+		/**
+		 * Calculate the number of C11 nuclei and protons for each run,
+		 * except run 0, which has never been updated.
+		 *
+		 * The raw files of the next runs are read on a separate thread
+		 * while the current runs are fit and counted (see SetReadAhead),
+		 * so that the time taken is that of the slower of reading and
+		 * fitting rather than their sum.
 		 * @param dirname The directory containing all relevant data files.
 		 */
 		void Update( char const * dirname );
+
+		/**
+		 * Calculate the number of C11 nuclei and protons for the runs
+		 * numbered from first_run to last_run only, as above, e.g. as
+		 * one shard of a campaign.
+		 * @param dirname The directory containing all relevant data files.
+		 * @param first_run The first run to update.
+		 * @param last_run The last run to update.
+		 */
+		void Update( char const * dirname, int first_run, int last_run );
+
+		/**
+		 * Find the rows of the runs numbered from first_run to last_run,
+		 * except run 0, which Update skips.
+		 * @param first_run The first run to look for.
+		 * @param last_run The last run to look for.
+		 * @param rows Filled with the matching rows, in file order.
+		 */
+		void FindRuns( int first_run, int last_run, vector<int> * rows ) const;
+
+		/**
+		 * Calculate the number of C11 nuclei and protons for one run.
+		 * @param run_number The run to update.
+		 * @param dirname The directory containing all relevant data files.
+		 */
+		void UpdateRun( int run_number, char const * dirname );
+
+		/**
+		 * Reuse decay fits and proton counts from a cache during Update.
+		 * Newly calculated values are stored in the cache.
+		 * @param cache The cache to use, or NULL to always recalculate.
+		 */
+		void SetFitCache( FitCache * cache );
+
+		/**
+		 * Set the number of runs to update concurrently during Update.
+		 * Results are written back in run order regardless, and decay
+		 * curves are fit with decay::MINIMIZER whatever the number, so
+		 * the results do not depend on it.
+		 * @param num_workers The number of worker threads, or 0 to use 
+		 * one per core.
+		 */
+		void SetNumWorkers( int num_workers );
+
+		/**
+		 * Set how many runs the raw files may be read ahead of the runs
+		 * being fit and counted during Update. Each run read ahead holds
+		 * its decay curves and proton spectrum in memory until it is 
+		 * taken by a worker; files whose results are cached or up to 
+		 * date are not read.
+		 * @param num_runs The number of runs, 4 by default, or 0 for
+		 * each worker to read the files of its run itself.
+		 */
+		void SetReadAhead( int num_runs );
+
+		/**
+		 * Set the method used to fit decay curves during Update.
+		 * @param method The method to use; FIT_MINUIT by default. Fits
+		 * with FIT_CROSSCHECK are always made, and not cached.
+		 */
+		void SetFitMethod( decay::FitMethod method );
+
+		/**
+		 * Set the half-life and efficiencies used to count C11 during
+		 * Update.
+		 * @param params The parameters; Parameters() by default.
+		 */
+		void SetParameters( Parameters const & params );
+
+		/**
+		 * During Update, recalculate the C11 decays and the protons of
+		 * a run only if their inputs changed since they were recorded;
+		 * e.g. a change of efficiency recounts no protons. Results 
+		 * which are calculated are recorded.
+		 * @param deps The record to use, or NULL to always recalculate.
+		 */
+		void SetDependencies( Dependencies * deps );
+
+	private:
+		int RunRow( int run_number ) const;
+		void CheckRunNumber( int row_number, vector<string> const & row ) const;
+
+		vector<int> rows_;			///< Row of each run, in file order
+		vector<int> run_numbers_;		///< Number of each run, likewise
+		unordered_map<int, int> index_;	///< Row of each run number
+		FitCache * cache_;
+		int num_workers_;
+		int read_ahead_;
+		decay::FitMethod fit_method_;
+		Parameters params_;
+		Dependencies * deps_;
 };
 
+/**
+ * Look up a fit of a decay curve in a fit cache, as stored by Update. Fits
+ * which cross-check the linear fit with Minuit are never cached, so that 
+ * the check is made.
+ * @param filename The decay curve.
+ * @param cache The cache, or NULL.
+ * @param method The method of the fit.
+ * @param half_life The half-life of the fit (min).
+ * @param fit Set to the cached fit, if found.
+ * @return False if the curve must be fit.
+ */
+bool LookupDecayFit( char const * filename, FitCache * cache,
+		decay::FitMethod method, double half_life, decay::FitResult * fit );
+
+/**
+ * Store a fit of a decay curve in a fit cache, if any, as above.
+ * @param filename The decay curve.
+ * @param cache The cache, or NULL.
+ * @param method The method of the fit.
+ * @param half_life The half-life of the fit (min).
+ * @param fit The fit.
+ */
+void StoreDecayFit( char const * filename, FitCache * cache,
+		decay::FitMethod method, double half_life, decay::FitResult const & fit );
+
 } // namespace n2n
 
 #endif
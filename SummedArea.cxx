@@ -0,0 +1,48 @@
+/** 
+ * @file n2n/SummedArea.cxx
+ * Copyright (C) 2013 Houghton College
+ */
+
+#include "SummedArea.hxx"
+
+namespace n2n {
+
+void SummedArea::Build( TH2I const * const data )
+{
+	size_x_ = data->GetNbinsX() + 2;
+	size_y_ = data->GetNbinsY() + 2;
+	sums_.assign( (size_x_ + 1) * (size_y_ + 1), 0 );
+
+	for ( Int_t y = 0; y < size_y_; ++y )
+	{
+		Long64_t row = 0;
+		for ( Int_t x = 0; x < size_x_; ++x )
+		{
+			row += (Long64_t) data->GetBinContent( data->GetBin( x, y ) );
+			sums_[(y + 1) * (size_x_ + 1) + x + 1] = Sum( x + 1, y ) + row;
+		}
+	}
+}
+
+Long64_t SummedArea::CountsInRegion( Region const & roi ) const
+{
+	Int_t min_x = roi.min_x > 0 ? roi.min_x : 0;
+	Int_t min_y = roi.min_y > 0 ? roi.min_y : 0;
+	Int_t max_x = roi.max_x < size_x_ - 1 ? roi.max_x : size_x_ - 1;
+	Int_t max_y = roi.max_y < size_y_ - 1 ? roi.max_y : size_y_ - 1;
+	if ( min_x > max_x || min_y > max_y )
+		return 0;
+
+	return Sum( max_x + 1, max_y + 1 ) - Sum( min_x, max_y + 1 )
+		- Sum( max_x + 1, min_y ) + Sum( min_x, min_y );
+}
+
+void SummedArea::CountsInRegions( vector<Region> const & rois, 
+		vector<Long64_t> * counts ) const
+{
+	counts->resize( rois.size() );
+	for ( int i = 0; i < rois.size(); ++i )
+		(*counts)[i] = CountsInRegion( rois[i] );
+}
+
+} // namespace n2n
@@ -0,0 +1,64 @@
+/** 
+ * @file n2n/SummedArea.hxx
+ * Copyright (C) 2013 Houghton College
+ */
+
+#ifndef N2N_SUMMEDAREA_INCL_
+#define N2N_SUMMEDAREA_INCL_
+
+#include "Region.hxx"
+
+#include <vector>
+
+namespace n2n {
+
+/**
+ * A summed-area table (integral image) of a 2D spectrum.
+ *
+ * After it is built, the number of counts in any rectangular region is 
+ * found from four table entries, independent of the size of the region.
+ */
+struct SummedArea
+{
+	public:
+		/**
+		 * Build the table from a histogram, such as one returned by 
+		 * proton::ParseDataFile. The underflow and overflow bins are
+		 * included, so regions are indexed exactly like the histogram.
+		 * @param data The dE-E data.
+		 */
+		void Build( TH2I const * const data );
+
+		/**
+		 * Determine the total number of counts in a region.
+		 * The region is clipped to the bins of the histogram.
+		 * @param roi The region of interest.
+		 * @return The number of counts in the region.
+		 */
+		Long64_t CountsInRegion( Region const & roi ) const;
+
+		/**
+		 * Determine the total number of counts in many regions.
+		 * @param rois The regions of interest.
+		 * @param counts Filled with the number of counts in each region.
+		 */
+		void CountsInRegions( vector<Region> const & rois, 
+				vector<Long64_t> * counts ) const;
+
+	private:
+		Int_t size_x_;			///< Number of bins along x
+		Int_t size_y_;			///< Number of bins along y
+		vector<Long64_t> sums_;		///< Counts below and left of each bin
+
+		/**
+		 * Get the number of counts in bins [0, x) x [0, y).
+		 */
+		Long64_t Sum( Int_t x, Int_t y ) const
+		{
+			return sums_[y * (size_x_ + 1) + x];
+		}
+};
+
+} // namespace n2n
+
+#endif
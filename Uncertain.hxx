@@ -6,6 +6,7 @@
 #ifndef N2N_UNCERTAIN_INCL_
 #define N2N_UNCERTAIN_INCL_
 
+#include <cmath>
 #include <vector>
 
 namespace n2n {
@@ -22,6 +23,247 @@ struct UncertainD
 UncertainD ReadUncertainD( vector<string> const & row, int val_col, int unc_col );
 void WriteUncertainD( UncertainD const & value, vector<string> * row, int val_col, int unc_col );
 
+/**
+ * An arithmetic expression on uncertain values, of type E.
+ *
+ * The leaves of an expression are constants and UncertainSource objects,
+ * which are independent inputs named by a compile-time ID. Evaluate()
+ * calculates the value of the expression and propagates the uncertainty 
+ * of each source to first order,
+ * @f[\delta_f^2=\sum_k\left(\frac{\partial f}{\partial x_k}\delta_{x_k}\right)^2,@f]
+ * where the derivative with respect to a source is summed over every 
+ * place it appears. A source used more than once, such as the neutron 
+ * flux in a ratio of the CH2 and C12 cross sections, is therefore fully
+ * correlated with itself.
+ *
+ * Expressions are built by value on the stack, and the sum over sources
+ * is unrolled at compile time, so no memory is allocated.
+ *
+ * @code
+ * enum { FG, BG };
+ * UncertainSource<FG> fg( fg_protons );
+ * UncertainSource<BG> bg( bg_protons );
+ * UncertainD flux = Evaluate( fg / fg_time - bg / bg_time );
+ * @endcode
+ */
+template <class E>
+struct UncertainExpr
+{
+	E const & Derived() const { return static_cast<E const &>( *this ); }
+};
+
+/**
+ * An independent uncertain input to an expression.
+ * @tparam ID Distinguishes this source from the others in an expression;
+ * IDs should be small, since Evaluate() considers each ID up to the 
+ * largest.
+ */
+template <int ID>
+struct UncertainSource : public UncertainExpr< UncertainSource<ID> >
+{
+	static int const MAX_ID = ID;
+	template <int N> struct Has { static bool const value = N == ID; };
+
+	explicit UncertainSource( UncertainD const & x ) : x_( x ) {}
+
+	double Value() const { return x_.val; }
+	template <int N> double Partial() const { return N == ID ? 1 : 0; }
+	template <int N> double Unc() const { return N == ID ? x_.unc : 0; }
+
+	UncertainD x_;
+};
+
+/**
+ * An exact value in an expression.
+ */
+struct UncertainConstant : public UncertainExpr<UncertainConstant>
+{
+	static int const MAX_ID = -1;
+	template <int N> struct Has { static bool const value = false; };
+
+	explicit UncertainConstant( double val ) : val_( val ) {}
+
+	double Value() const { return val_; }
+	template <int N> double Partial() const { return 0; }
+	template <int N> double Unc() const { return 0; }
+
+	double val_;
+};
+
+/**
+ * A binary operation, Op, in an expression.
+ */
+template <class Op, class L, class R>
+struct UncertainBinary : public UncertainExpr< UncertainBinary<Op, L, R> >
+{
+	static int const MAX_ID = L::MAX_ID > R::MAX_ID ? L::MAX_ID : R::MAX_ID;
+	template <int N> struct Has 
+	{ 
+		static bool const value = 
+			L::template Has<N>::value || R::template Has<N>::value; 
+	};
+
+	UncertainBinary( L const & l, R const & r ) : l_( l ), r_( r ) {}
+
+	double Value() const { return Op::Value( l_.Value(), r_.Value() ); }
+	template <int N> double Partial() const 
+	{
+		return Op::Partial( l_.Value(), l_.template Partial<N>(),
+				r_.Value(), r_.template Partial<N>() );
+	}
+	template <int N> double Unc() const 
+	{ 
+		return L::template Has<N>::value ? 
+			l_.template Unc<N>() : r_.template Unc<N>(); 
+	}
+
+	L l_;
+	R r_;
+};
+
+/**
+ * A function, Op, of one expression.
+ */
+template <class Op, class A>
+struct UncertainUnary : public UncertainExpr< UncertainUnary<Op, A> >
+{
+	static int const MAX_ID = A::MAX_ID;
+	template <int N> struct Has { static bool const value = A::template Has<N>::value; };
+
+	explicit UncertainUnary( A const & a ) : a_( a ) {}
+
+	double Value() const { return Op::Value( a_.Value() ); }
+	template <int N> double Partial() const 
+	{
+		return Op::Partial( a_.Value(), a_.template Partial<N>() );
+	}
+	template <int N> double Unc() const { return a_.template Unc<N>(); }
+
+	A a_;
+};
+
+/// @cond
+// Value and derivative of each operation, given the values (a, b) and 
+// derivatives (da, db) of its operands.
+struct UncertainAdd
+{
+	static double Value( double a, double b ) { return a + b; }
+	static double Partial( double, double da, double, double db ) { return da + db; }
+};
+struct UncertainSub
+{
+	static double Value( double a, double b ) { return a - b; }
+	static double Partial( double, double da, double, double db ) { return da - db; }
+};
+struct UncertainMul
+{
+	static double Value( double a, double b ) { return a * b; }
+	static double Partial( double a, double da, double b, double db ) { return da * b + a * db; }
+};
+struct UncertainDiv
+{
+	static double Value( double a, double b ) { return a / b; }
+	static double Partial( double a, double da, double b, double db ) { return da / b - a * db / (b * b); }
+};
+struct UncertainNeg
+{
+	static double Value( double a ) { return -a; }
+	static double Partial( double, double da ) { return -da; }
+};
+struct UncertainExp
+{
+	static double Value( double a ) { return exp( a ); }
+	static double Partial( double a, double da ) { return exp( a ) * da; }
+};
+struct UncertainLog
+{
+	static double Value( double a ) { return log( a ); }
+	static double Partial( double a, double da ) { return da / a; }
+};
+struct UncertainSqrt
+{
+	static double Value( double a ) { return sqrt( a ); }
+	static double Partial( double a, double da ) { return da / (2 * sqrt( a )); }
+};
+
+#define N2N_UNCERTAIN_BINARY_OPERATOR( OP, NAME ) \
+template <class L, class R> \
+UncertainBinary<NAME, L, R> operator OP ( UncertainExpr<L> const & l, UncertainExpr<R> const & r ) \
+{ return UncertainBinary<NAME, L, R>( l.Derived(), r.Derived() ); } \
+template <class L> \
+UncertainBinary<NAME, L, UncertainConstant> operator OP ( UncertainExpr<L> const & l, double r ) \
+{ return UncertainBinary<NAME, L, UncertainConstant>( l.Derived(), UncertainConstant( r ) ); } \
+template <class R> \
+UncertainBinary<NAME, UncertainConstant, R> operator OP ( double l, UncertainExpr<R> const & r ) \
+{ return UncertainBinary<NAME, UncertainConstant, R>( UncertainConstant( l ), r.Derived() ); }
+
+N2N_UNCERTAIN_BINARY_OPERATOR( +, UncertainAdd )
+N2N_UNCERTAIN_BINARY_OPERATOR( -, UncertainSub )
+N2N_UNCERTAIN_BINARY_OPERATOR( *, UncertainMul )
+N2N_UNCERTAIN_BINARY_OPERATOR( /, UncertainDiv )
+
+#undef N2N_UNCERTAIN_BINARY_OPERATOR
+
+template <class A>
+UncertainUnary<UncertainNeg, A> operator-( UncertainExpr<A> const & a )
+{ return UncertainUnary<UncertainNeg, A>( a.Derived() ); }
+
+// Sum of the squared contributions of sources 0 to N
+template <class E, int N>
+struct UncertainVariance
+{
+	static double Sum( E const & e )
+	{
+		double d = E::template Has<N>::value ? 
+			e.template Partial<N>() * e.template Unc<N>() : 0;
+		return UncertainVariance<E, N - 1>::Sum( e ) + d * d;
+	}
+};
+template <class E>
+struct UncertainVariance<E, -1>
+{
+	static double Sum( E const & ) { return 0; }
+};
+/// @endcond
+
+/**
+ * The exponential of an expression. Named like TMath::Exp, so that exp()
+ * on doubles is not hidden inside namespace n2n.
+ */
+template <class A>
+UncertainUnary<UncertainExp, A> Exp( UncertainExpr<A> const & a )
+{ return UncertainUnary<UncertainExp, A>( a.Derived() ); }
+
+/**
+ * The natural logarithm of an expression.
+ */
+template <class A>
+UncertainUnary<UncertainLog, A> Log( UncertainExpr<A> const & a )
+{ return UncertainUnary<UncertainLog, A>( a.Derived() ); }
+
+/**
+ * The square root of an expression.
+ */
+template <class A>
+UncertainUnary<UncertainSqrt, A> Sqrt( UncertainExpr<A> const & a )
+{ return UncertainUnary<UncertainSqrt, A>( a.Derived() ); }
+
+/**
+ * Calculate the value and uncertainty of an expression.
+ * @param expr The expression.
+ * @return The value, and its uncertainty propagated to first order from
+ * every source in the expression.
+ */
+template <class E>
+UncertainD Evaluate( UncertainExpr<E> const & expr )
+{
+	E const & e = expr.Derived();
+	UncertainD ret;
+	ret.val = e.Value();
+	ret.unc = sqrt( UncertainVariance<E, E::MAX_ID>::Sum( e ) );
+	return ret;
+}
+
 } // namespace n2n
 
 #endif
@@ -0,0 +1,450 @@
+/**
+ * @file n2n/benchmark.cxx
+ * Copyright (C) 2013 Houghton College
+ */
+
+#include "benchmark.hxx"
+#include "synthetic.hxx"
+#include "CrossSection.hxx"
+#include "RunSummary.hxx"
+#include "pipeline.hxx"
+#include "proton.hxx"
+#include "Log.hxx"
+
+#include <TStopwatch.h>
+
+#include <algorithm>
+
+namespace n2n {
+namespace benchmark {
+
+/**
+ * The time taken by one stage.
+ */
+struct StageTime
+{
+	string name;		///< Name of the stage
+	int count;		///< Number of times the stage ran
+	double seconds;		///< Total wall clock time (s)
+};
+
+/**
+ * The result of one kind of check against the truth.
+ */
+struct CheckResult
+{
+	string name;		///< Name of the check
+	int checked;		///< Number of values checked
+	int failed;		///< Number of values which disagreed
+};
+
+/**
+ * Quote a string for JSON.
+ */
+string JSONString( char const * s )
+{
+	string ret = "\"";
+	for ( ; *s; ++s )
+	{
+		if ( *s == '"' || *s == '\\' )
+			ret += '\\';
+		ret += *s;
+	}
+	return ret + "\"";
+}
+
+/**
+ * Check a value against the truth.
+ * @return True if the value is within 5 standard deviations of the truth.
+ */
+bool Agrees( UncertainD const & value, double truth )
+{
+	return fabs( value.val - truth ) <= 5 * value.unc;
+}
+
+/**
+ * Read a whole file.
+ * @param filename The file to read.
+ * @param contents Set to the contents of the file, or emptied if it
+ * cannot be read.
+ * @return True if the file was read.
+ */
+bool ReadFile( char const * filename, string * contents )
+{
+	contents->clear();
+	ifstream is( filename, ios::in | ios::binary );
+	if ( !is )
+		return false;
+	char buf[4096];
+	while ( is.read( buf, sizeof(buf) ) || is.gcount() > 0 )
+		contents->append( buf, is.gcount() );
+	return true;
+}
+
+/**
+ * Process every run of a data set with pipeline::Recalculate, or as 
+ * shards of a campaign (see pipeline::UpdateShard), then put back the 
+ * files it wrote as they were.
+ * @param dirname The directory containing the data set.
+ * @param num_shards The number of shards, or 0 to use Recalculate.
+ * @param num_workers The number of runs each shard updates concurrently.
+ * @param filenames The files written by the campaign.
+ * @param contents Set to the contents of each file as written.
+ */
+void RunCampaign( char const * dirname, int num_shards, int num_workers,
+		vector<TString> const & filenames, vector<string> * contents )
+{
+	vector<string> before( filenames.size() );
+	vector<bool> existed( filenames.size() );
+	for ( int i = 0; i < filenames.size(); ++i )
+		existed[i] = ReadFile( filenames[i], &before[i] );
+
+	if ( num_shards == 0 )
+		pipeline::Recalculate( dirname, num_workers );
+	else
+	{
+		// Split the runs into shards of about the same number of runs
+		TString filename_summary = pipeline::DataPath( dirname,
+				"Run_Summary.csv" );
+		RunSummary sum;
+		sum.Load( filename_summary );
+		vector<int> runs;
+		for ( int i = 0; i < sum.NumRuns(); ++i )
+			runs.push_back( sum.GetRunNumberAt( i ) );
+		sort( runs.begin(), runs.end() );
+
+		vector<int> first_runs, last_runs;
+		for ( int i = 0; i < num_shards; ++i )
+		{
+			int begin = runs.size() * i / num_shards;
+			int end = runs.size() * (i + 1) / num_shards;
+			if ( begin == end )
+				continue;
+			first_runs.push_back( runs[begin] );
+			last_runs.push_back( runs[end - 1] );
+		}
+
+		for ( int i = 0; i < first_runs.size(); ++i )
+			pipeline::UpdateShard( dirname, first_runs[i], last_runs[i],
+					num_workers );
+		pipeline::MergeShards( dirname );
+		for ( int i = 0; i < first_runs.size(); ++i )
+			pipeline::CalculateShard( dirname, first_runs[i], last_runs[i] );
+		pipeline::MergeShards( dirname );
+	}
+
+	contents->resize( filenames.size() );
+	for ( int i = 0; i < filenames.size(); ++i )
+	{
+		ReadFile( filenames[i], &(*contents)[i] );
+		if ( !existed[i] )
+		{
+			gSystem->Unlink( filenames[i] );
+			continue;
+		}
+		ofstream os( filenames[i], ios::out | ios::binary | ios::trunc );
+		os.write( before[i].data(), before[i].size() );
+	}
+}
+
+bool Run( char const * dirname, char const * json_filename, decay::FitMethod method )
+{
+	TString filename_summary = pipeline::DataPath( dirname,
+			"Run_Summary.csv" );
+	TString filename_cross = pipeline::DataPath( dirname,
+			"Cross_Sections.csv" );
+	TString filename_truth = pipeline::DataPath( dirname,
+			"Synthetic_Truth.csv" );
+	TString filename_save = pipeline::DataPath( dirname,
+			"Run_Summary_benchmark.csv" );
+	TString dirname_decay = pipeline::DataPath( dirname, "Decay Curves" );
+	TString dirname_proton = pipeline::DataPath( dirname,
+			"Proton Telescope" );
+
+	CSVFile truth;
+	truth.Load( filename_truth );
+	map< int, vector<string> > truths;
+	for ( int i = 1; i < truth.NumRows(); ++i )
+	{
+		vector<string> row = truth.GetRow( i );
+		truths[atoi( row[synthetic::ST_RUN_NUMBER].c_str() )] = row;
+	}
+
+	vector<StageTime> stages;
+	vector<CheckResult> checks;
+	TStopwatch sw;
+
+	// CSV handling
+	{
+		CSVFile file;
+		sw.Start();
+		file.Load( filename_summary );
+		StageTime load = { "csv_load", 1, sw.RealTime() };
+		stages.push_back( load );
+
+		vector< vector<string> > rows( file.NumRows() );
+		sw.Start();
+		for ( int i = 0; i < file.NumRows(); ++i )
+			rows[i] = file.GetRow( i );
+		StageTime get = { "csv_get_row", file.NumRows(), sw.RealTime() };
+		stages.push_back( get );
+
+		sw.Start();
+		for ( int i = 0; i < file.NumRows(); ++i )
+			file.SetRow( i, rows[i] );
+		StageTime set = { "csv_set_row", file.NumRows(), sw.RealTime() };
+		stages.push_back( set );
+
+		sw.Start();
+		file.Save( filename_save );
+		StageTime save = { "csv_save", 1, sw.RealTime() };
+		stages.push_back( save );
+
+		// Saving again must replace the file just written
+		CheckResult check = { "csv_resave", 1, 0 };
+		int last = file.NumRows() - 1;
+		vector<string> row = rows[last];
+		row.push_back( "resaved" );
+		file.SetRow( last, row );
+		file.Save( filename_save );
+		CSVFile resaved;
+		resaved.Load( filename_save );
+		if ( resaved.NumRows() != file.NumRows() || resaved.GetRow( last ) != row )
+			++check.failed;
+		checks.push_back( check );
+		gSystem->Unlink( filename_save );
+		gSystem->Unlink( BinaryTable::FileName( filename_save ) );
+	}
+
+	// The run summary from its sidecar, which must give the numbers the
+	// text gives
+	{
+		RunSummary sum;
+		sum.Load( filename_summary );
+		sum.SetWriteBinary( true );
+		sum.Save( filename_save );
+
+		RunSummary loaded;
+		sw.Start();
+		loaded.Load( filename_save );
+		StageTime load = { "summary_load", loaded.NumRuns(), sw.RealTime() };
+		stages.push_back( load );
+
+		CheckResult check = { "summary_sidecar", 0, 0 };
+		CSVFile text;
+		text.Load( filename_save );
+		vector<CSVField> fields;
+		for ( int i = 2; i < text.NumRows(); ++i )
+		{
+			text.GetFields( i, &fields );
+			for ( int col = 0; col < fields.size() && col < RS_NUM_COLUMNS; ++col )
+			{
+				double value;
+				FieldKind kind = loaded.GetValue( i, col, &value );
+				double expected = fields[col].ToDouble();
+				++check.checked;
+				if ( kind != fields[col].Kind() ||
+						!(value == expected || (value != value && expected != expected)) )
+					++check.failed;
+			}
+		}
+		checks.push_back( check );
+		gSystem->Unlink( filename_save );
+		gSystem->Unlink( BinaryTable::FileName( filename_save ) );
+	}
+
+	// Proton spectra
+	{
+		TStopwatch sw_parse, sw_count;
+		sw_parse.Reset();
+		sw_count.Reset();
+		CheckResult check = { "proton_counts", 0, 0 };
+		map< int, vector<string> >::iterator i;
+		for ( i = truths.begin(); i != truths.end(); ++i )
+		{
+			TString filename_csv = pipeline::DataPath( dirname_proton,
+					TString::Format( "Run%03d_1x2.csv", i->first ) );
+			TString filename_mpa = pipeline::DataPath( dirname_proton,
+					TString::Format( "Run%03d.mpa", i->first ) );
+
+			sw_parse.Start( kFALSE );
+			TH2I * data = proton::ParseDataFile( filename_csv );
+			Region roi = proton::ParseHeaderFile( filename_mpa );
+			sw_parse.Stop();
+
+			sw_count.Start( kFALSE );
+			Int_t protons = proton::CountsInRegion( data, roi );
+			sw_count.Stop();
+			delete data;
+
+			++check.checked;
+			if ( protons != atoi( i->second[synthetic::ST_PROTONS].c_str() ) )
+				++check.failed;
+		}
+		StageTime parse = { "proton_parse", (int) truths.size(), sw_parse.RealTime() };
+		StageTime count = { "proton_counts", (int) truths.size(), sw_count.RealTime() };
+		stages.push_back( parse );
+		stages.push_back( count );
+		checks.push_back( check );
+	}
+
+	// Decay curves
+	{
+		TStopwatch sw_parse, sw_fit;
+		sw_parse.Reset();
+		sw_fit.Reset();
+		int num_curves = 0;
+		CheckResult check = { "decay_n0", 0, 0 };
+		map< int, vector<string> >::iterator i;
+		for ( i = truths.begin(); i != truths.end(); ++i )
+		{
+			if ( i->second[synthetic::ST_BG_RUN_NUMBER].empty() )
+				continue;
+
+			char const * formats[] = { "Run%03d_puck.csv", "Run%03d_plastic.csv" };
+			int n0_columns[] = { synthetic::ST_PUCK_N0, synthetic::ST_PLASTIC_N0 };
+			for ( int j = 0; j < 2; ++j )
+			{
+				TString filename = pipeline::DataPath( dirname_decay,
+						TString::Format( formats[j], i->first ) );
+
+				sw_parse.Start( kFALSE );
+				TGraphErrors * ge = decay::ParseDataFile( filename );
+				sw_parse.Stop();
+
+				sw_fit.Start( kFALSE );
+				decay::FitResult fit = decay::Fit( ge, method );
+				sw_fit.Stop();
+				delete ge;
+
+				++num_curves;
+				++check.checked;
+				if ( !Agrees( fit.n0, atof( i->second[n0_columns[j]].c_str() ) ) )
+					++check.failed;
+			}
+		}
+		StageTime parse = { "decay_parse", num_curves, sw_parse.RealTime() };
+		StageTime fit = { "decay_fit", num_curves, sw_fit.RealTime() };
+		stages.push_back( parse );
+		stages.push_back( fit );
+		checks.push_back( check );
+	}
+
+	// The half-life from every decay curve
+	{
+		CheckResult check = { "half_life", 1, 0 };
+		sw.Start();
+		UncertainD half_life = pipeline::FitHalfLife( dirname );
+		StageTime fit = { "halflife_fit", 1, sw.RealTime() };
+		stages.push_back( fit );
+		if ( !Agrees( half_life, decay::HALF_LIFE ) )
+			++check.failed;
+		checks.push_back( check );
+	}
+
+	// The whole analysis, without saving
+	{
+		RunSummary sum;
+		sum.Load( filename_summary );
+		sum.SetFitMethod( method );
+		sw.Start();
+		sum.Update( dirname );
+		StageTime update = { "summary_update", sum.NumRuns(), sw.RealTime() };
+		stages.push_back( update );
+
+		CrossSection cross;
+		cross.Load( filename_cross );
+		sw.Start();
+		cross.LoadSummary( &sum );
+		StageTime loadsum = { "cross_loadsum", cross.NumRows() - 3, sw.RealTime() };
+		stages.push_back( loadsum );
+
+		sw.Start();
+		cross.Calculate();
+		StageTime calculate = { "cross_calculate", cross.NumRows() - 3, sw.RealTime() };
+		stages.push_back( calculate );
+
+		CheckResult check = { "cross_sections", 0, 0 };
+		for ( int i = 3; i < cross.NumRows(); ++i )
+		{
+			vector<string> row = cross.GetRow( i );
+			vector<string> const & t = truths[atoi( row[CS_FG_RUN_NUMBER].c_str() )];
+			UncertainD ch2 = ReadUncertainD( row, CS_CH2_XSECT, CS_CH2_XSECT_UNC );
+			UncertainD c12 = ReadUncertainD( row, CS_C12_XSECT, CS_C12_XSECT_UNC );
+			check.checked += 2;
+			if ( !Agrees( ch2, atof( t[synthetic::ST_CH2_XSECT].c_str() ) ) )
+				++check.failed;
+			if ( !Agrees( c12, atof( t[synthetic::ST_C12_XSECT].c_str() ) ) )
+				++check.failed;
+		}
+		checks.push_back( check );
+	}
+
+	// Campaigns, which must write the same files as Recalculate
+	{
+		char const * names[] = { "Run_Summary.csv", "Cross_Sections.csv",
+			"Fit_Cache.csv", "Dependencies.csv" };
+		int const num_names = sizeof(names) / sizeof(names[0]);
+		vector<TString> filenames;
+		for ( int i = 0; i < num_names; ++i )
+		{
+			filenames.push_back( pipeline::DataPath( dirname,
+					names[i] ) );
+		}
+		// The sidecars are put back too, so they are not trusted for 
+		// the restored files
+		filenames.push_back( BinaryTable::FileName( filename_summary ) );
+		filenames.push_back( BinaryTable::FileName( filename_cross ) );
+
+		// Neither the number of shards nor that of workers may matter
+		int const campaigns[][2] = { { 0, 4 }, { 1, 4 }, { 3, 2 } };
+		int const num_campaigns = sizeof(campaigns) / sizeof(campaigns[0]);
+		vector<string> recalculated, sharded;
+		RunCampaign( dirname, 0, 1, filenames, &recalculated );
+
+		CheckResult check = { "shards", 0, 0 };
+		for ( int c = 0; c < num_campaigns; ++c )
+		{
+			RunCampaign( dirname, campaigns[c][0], campaigns[c][1], 
+					filenames, &sharded );
+			for ( int i = 0; i < num_names; ++i )
+			{
+				++check.checked;
+				if ( sharded[i] != recalculated[i] )
+					++check.failed;
+			}
+		}
+		checks.push_back( check );
+	}
+
+	bool passed = true;
+	std::ofstream ofs( json_filename );
+	ofs << "{ \"dirname\": " << JSONString( dirname )
+		<< ", \"num_runs\": " << truths.size() << ",\n  \"stages\": {";
+	for ( int i = 0; i < stages.size(); ++i )
+	{
+		ofs << (i ? ",\n" : "\n") << "    " << JSONString( stages[i].name.c_str() )
+			<< ": { \"count\": " << stages[i].count
+			<< ", \"seconds\": " << stages[i].seconds << " }";
+		LogMessage( LOG_INFO, TString::Format( "%-16s %8d in %10.6f s",
+			stages[i].name.c_str(), stages[i].count, stages[i].seconds ) );
+	}
+	ofs << " },\n  \"checks\": {";
+	for ( int i = 0; i < checks.size(); ++i )
+	{
+		ofs << (i ? ",\n" : "\n") << "    " << JSONString( checks[i].name.c_str() )
+			<< ": { \"checked\": " << checks[i].checked
+			<< ", \"failed\": " << checks[i].failed << " }";
+		if ( checks[i].failed )
+		{
+			passed = false;
+			LogMessage( LOG_ERROR, TString::Format( "%s: %d of %d values disagree",
+				checks[i].name.c_str(), checks[i].failed, checks[i].checked ) );
+		}
+	}
+	ofs << " },\n  \"passed\": " << (passed ? "true" : "false") << " }\n";
+	return passed;
+}
+
+} // namespace benchmark
+} // namespace n2n
@@ -0,0 +1,54 @@
+/** 
+ * @file n2n/benchmark.hxx
+ * Copyright (C) 2013 Houghton College
+ */
+
+#ifndef N2N_BENCHMARK_INCL_
+#define N2N_BENCHMARK_INCL_
+
+#include "decay.hxx"
+
+namespace n2n {
+namespace benchmark {
+
+/**
+ * Time each stage of the analysis on a data set made by 
+ * synthetic::Generate, and check the results against its truth.
+ *
+ * The stages timed are CSVFile Load, GetRow, SetRow and Save on 
+ * Run_Summary.csv; RunSummary::Load from its sidecar; 
+ * proton::ParseDataFile and CountsInRegion on every spectrum; 
+ * decay::ParseDataFile and the decay fit on every curve; 
+ * pipeline::FitHalfLife; and RunSummary::Update, CrossSection::LoadSummary
+ * and CrossSection::Calculate on the whole data set. The checks are that
+ * saving Run_Summary.csv a second time replaces the first save, that its
+ * sidecar gives every value its text gives, that every proton count is 
+ * exact, that every fitted @f$N_0@f$, the fitted half-life and every 
+ * calculated cross section is within 5 standard deviations of the truth,
+ * and that processing the data set with several workers, as one shard 
+ * and as three shards (see pipeline::UpdateShard), writes 
+ * Run_Summary.csv, Cross_Sections.csv, Fit_Cache.csv and Dependencies.csv
+ * byte for byte as pipeline::Recalculate does with one worker.
+ *
+ * The results are written as JSON:
+ * @code
+ * { "dirname": "...", "num_runs": 100,
+ *   "stages": { "csv_load": { "count": 1, "seconds": 0.001 }, ... },
+ *   "checks": { "proton_counts": { "checked": 100, "failed": 0 }, ... },
+ *   "passed": true }
+ * @endcode
+ *
+ * @param dirname The directory containing the data set. Its 
+ * Run_Summary.csv, Cross_Sections.csv, Fit_Cache.csv and Dependencies.csv
+ * are left unchanged.
+ * @param json_filename The file to write the results to.
+ * @param method The method used to fit decay curves.
+ * @return True if every check passed.
+ */
+bool Run( char const * dirname, char const * json_filename,
+		decay::FitMethod method = decay::FIT_MINUIT );
+
+} // namespace benchmark
+} // namespace n2n
+
+#endif
@@ -0,0 +1,162 @@
+/** 
+ * @file n2n/calculate.hxx
+ * Copyright (C) 2013 Houghton College
+ */
+
+#ifndef N2N_CALCULATE_INCL_
+#define N2N_CALCULATE_INCL_
+
+#include "ColumnTable.hxx"
+#include "NPCrossSection.hxx"
+#include "Parameters.hxx"
+#include "Uncertain.hxx"
+
+namespace n2n {
+namespace calculate {
+
+/**
+ * Calculate the proton flux, @f$N_p@f$.
+ *
+ * @f[N_p=
+ *	\frac{N_{p,fg}}{t_{clock,fg}t_{live,fg}}-
+ *      \frac{N_{p,bg}}{t_{clock,bg}t_{live,bg}}@f]
+ * @f[{\delta_{N_p}}^2=
+ * 	\left(\frac{\delta_{N_{p,fg}}}{t_{clock,fg}t_{live,fg}}\right)^2+
+ * 	\left(\frac{\delta_{N_{p,bg}}}{t_{clock,bg}t_{live,bg}}\right)^2@f]
+ *
+ * @param fg_protons Number of protons in foreground, @f$N_{p,fg}@f$ (protons)
+ * @param fg_clock Clock time of foreground, @f$t_{clock,fg}@f$ (s)
+ * @param fg_live Fraction of live time in foreground, @f$t_{live,fg}@f$
+ * @param bg_protons Number of protons in background, @f$N_{p,bg}@f$ (protons)
+ * @param bg_clock Clock time of background, @f$t_{clock,bg}@f$ (s)
+ * @param bg_live Fraction of live time in background, @f$t_{live,bg}@f$
+ *
+ * @return The proton flux, @f$N_p@f$ (@f$\frac{\text{protons}}{\text{s}}@f$)
+ */
+UncertainD ProtonFlux( UncertainD fg_protons, double fg_clock, double fg_live, 
+		       UncertainD bg_protons, double bg_clock, double bg_live );
+
+/**
+ * Calculate the @f$(n,p)@f$ cross section, @f$\sigma_{np}(T)@f$, at the given energy 
+ * by interpolating between known cross sections at 0 deg, from
+ * NPCrossSection::Default().
+ *
+ * @param energy The kinetic energy, @f$T@f$ (MeV)
+ * @return The cross section, @f$\sigma_{np}(T)@f$ 
+ * (@f$\frac{\text{mbarn}}{\text{sr}}@f$)
+ */
+double CalcNPCrossSection( double energy );
+
+/**
+ * Calculate a solid angle from a distance and area.
+ *
+ * @f[\Omega=\frac{A}{d^2}@f]
+ *
+ * @param area The area of the target, @f$A@f$ (@f$\text{cm}^2@f$)
+ * @param dist The distance to the target, @f$d@f$ (cm)
+ * @return The solid angle, @f$\Omega@f$ (sr)
+ */
+double CalcSolidAngle( double area, double dist );
+
+/**
+ * Calculate the areal density of hydrogen in a @f$\text{CH}_2@f$ target.
+ *
+ * @param thickness The thickness of the target (cm)
+ * @param density The density of @f$\text{CH}_2@f$ (@f$\frac{\text{g}}{\text{cm}^3}@f$)
+ * @return The areal density, @f$N_{H,CH_2}@f$ (@f$\frac{\text{H nuclei}}{\text{barn}}@f$)
+ */
+double CalcThicknessH_CH2( double thickness, double density );
+
+/**
+ * Calculate the areal density of carbon in a @f$\text{CH}_2@f$ target.
+ *
+ * @param thickness The thickness of the target (cm)
+ * @param density The density of @f$\text{CH}_2@f$ (@f$\frac{\text{g}}{\text{cm}^3}@f$)
+ * @return The areal density, @f$N_{C,CH_2}@f$ (@f$\frac{\text{C nuclei}}{\text{barn}}@f$)
+ */
+double CalcThicknessC_CH2( double thickness, double density );
+
+/**
+ * Calculate the areal density of carbon in a graphite target.
+ *
+ * @param thickness The thickness of the target (cm)
+ * @param density The density of graphite (@f$\frac{\text{g}}{\text{cm}^3}@f$)
+ * @return The areal density, @f$N_{C,C12}@f$ (@f$\frac{\text{C nuclei}}{\text{barn}}@f$)
+ */
+double CalcThicknessC_C12( double thickness, double density );
+
+/**
+ * Calculate the neutron flux, @f$N_{flux}@f$.
+ *
+ * @f[N_{flux}=\frac{N_p}{\sigma_{np}(T)N_{H,CH_2}\Omega_{det}\Omega_{CH_2}}@f]
+ * @f[\delta_{N_{flux}}=\frac{\delta_{N_p}}{\sigma_{np}(T)N_{H,CH_2}\Omega_{det}\Omega_{CH_2}}@f]
+ *
+ * @param protons The proton flux, @f$N_p@f$ (@f$\frac{\text{protons}}{\text{s}}@f$)
+ * @param sigma_np The cross section of the @f$(n,p)@f$ reaction, @f$\sigma_{np}@f$ 
+ * (@f$\frac{\text{mbarn}}{\text{sr}}@f$)
+ * @param ch2 The @f$\text{CH}_2@f$ target.
+ * @param sang_det The solid angle of the proton detector, @f$\Omega_{det}@f$ (sr)
+ * @return The neutron flux, @f$N_{flux}@f$ 
+ * (@f$\frac{\text{neutrons}}{\text{s}\cdot\text{sr}}@f$)
+ */
+UncertainD CalcNeutronFlux( UncertainD protons, double sigma_np, double ch2_nH, double ch2_sang, 
+			    double det_sang );
+
+/**
+ * Calculate the @f${}^{12}\text{C}(n,2n){}^{11}\text{C}@f$ cross section, 
+ * @f$\sigma_{n2n}@f$, where @f$\lambda_{C11} = \frac{\ln(2)}{t_{1/2}}@f$
+ * is the @f${}^{11}\text{C}@f$ decay constant.
+ *
+ * @f[\sigma_{n2n}=\frac{N_{C11}}{\text{efficiency}}\frac{\lambda_{C11}}
+ * {N_{C,tar}N_{flux}\Omega_{tar}(1-e^{-\lambda_{C11}t_{act}})}@f]
+ * @f[\delta_{\sigma_{n2n}}=\frac{N_{C11}}{\text{efficiency}}\frac{\lambda_{C11}}
+ * {N_{C,tar}N_{flux}\Omega_{tar}(1-e^{-\lambda_{C11}t_{act}})}
+ * \sqrt{\left(\frac{\delta_{N_{flux}}}{N_{flux}}\right)^2+
+ * \left(\frac{\delta_{N_{C11}}}{N_{C11}}\right)^2}@f]
+ * 
+ * @param target The target for which the cross section should be calculated
+ * @param neutrons The neutron flux, @f$N_{flux}@f$ 
+ * (@f$\frac{\text{neutrons}}{\text{s}\cdot\text{sr}}@f$)
+ * @param efficiency An efficiency correction factor
+ * @param time The total activation time, @f$t_{act}@f$ (s)
+ * (@f$\frac{\text{C nuclei}}{\text{barn}}@f$)
+ * @param half_life The half-life of @f${}^{11}\text{C}@f$, @f$t_{1/2}@f$ (min)
+ * @return The cross section, @f$\sigma_{n2n}@f$ (mb). Its uncertainty is
+ * NaN if @f$N_{C11}=0@f$.
+ */
+UncertainD CalcN2NCrossSection( UncertainD tar_decay, UncertainD neutrons, double time, 
+                                double tar_nC, double tar_sang, double half_life );
+
+/**
+ * Calculate the proton flux, CS_PROTON_FLUX, for every row of a table.
+ *
+ * @param table The cross sections, indexed by CSFields.
+ */
+void ProtonFlux( ColumnTable * table );
+
+/**
+ * Calculate the neutron flux, CS_NEUTRON_FLUX, for every row of a table.
+ * The proton flux must already have been calculated. Rows whose energy is
+ * outside the n-p cross section table are logged, and get a NaN flux.
+ *
+ * @param table The cross sections, indexed by CSFields.
+ * @param np_xsect The n-p cross sections at 0 deg.
+ * @param params The density of CH2 is used.
+ */
+void CalcNeutronFlux( ColumnTable * table, NPCrossSection const & np_xsect,
+		Parameters const & params );
+
+/**
+ * Calculate the CH2 and C12 cross sections, CS_CH2_XSECT and CS_C12_XSECT,
+ * for every row of a table. The neutron flux must already have been 
+ * calculated.
+ *
+ * @param table The cross sections, indexed by CSFields.
+ * @param params The densities and the half-life of C11 are used.
+ */
+void CalcN2NCrossSection( ColumnTable * table, Parameters const & params );
+
+} // namespace calculate
+} // namespace n2n
+
+#endif
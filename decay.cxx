@@ -6,6 +6,11 @@
  */
 
 #include "decay.hxx"
+#include "DataFile.hxx"
+#include "Profile.hxx"
+
+#include <atomic>
+#include <stdexcept>
 #include <vector>
 
 namespace n2n {
@@ -13,52 +18,169 @@ namespace decay {
 
 TGraphErrors * ParseDataFile( char const * filename )
 {
-	ifstream is( filename );
+	DataFile file;
+	{
+		ProfileTimer timer( "decay_read" );
+		file.Load( filename );
+	}
+	return ParseDataFile( file );
+}
 
-	string line;
-	while ( getline( is, line ) )
+TGraphErrors * ParseDataFile( DataFile const & file )
+{
+	ProfileTimer timer( "decay_parse" );
+	string::size_type offset = file.FindSection( "[DATA]" );
+	if ( offset == string::npos )
 	{
-		if ( line == "[DATA]" )
-			break;
+		cerr << "No [DATA] section in decay curve file: " << file.Filename() << endl;
+		throw runtime_error( "Invalid decay curve file" );
 	}
 
 	vector<float> times;
 	vector<float> counts;
 	vector<float> errors; 
-	float cur_time, cur_count; 
-	while ( is >> cur_time >> cur_count )
+	double entry[2];	// time, count
+	while ( file.NextRow( &offset, 2, entry ) )
 	{
-		times.push_back( cur_time );
-		counts.push_back( cur_count );
-		errors.push_back( sqrt( cur_count ) );
+		times.push_back( entry[0] );
+		counts.push_back( entry[1] );
+		errors.push_back( sqrt( (float) entry[1] ) );
 	}
+	ProfileCount( "decay_parse", "bytes", file.Size() );
+	ProfileCount( "decay_parse", "lines", times.size() );
 
 	return new TGraphErrors( times.size(), &times[0], &counts[0], 
 				 NULL, &errors[0] );
 }
 
-TFitResultPtr FitDecayCurve( TGraphErrors * ge )
+/**
+ * The decay curve model, @f$N_0 e^{-\lambda t}+A@f$.
+ * A compiled function is used instead of a formula, so fitting neither 
+ * invokes the interpreter nor depends on any global state.
+ */
+Double_t DecayModel( Double_t * x, Double_t * par )
+{
+	return par[0] * TMath::Exp( -par[1] * x[0] ) + par[2];
+}
+
+TFitResultPtr FitDecayCurve( TGraphErrors * ge, double half_life )
 {
 	Double_t xmin, ymin, xmax, ymax;
 	ge->ComputeRange( xmin, ymin, xmax, ymax );
 
-	TF1 * decay = 
-		new TF1( "decay", "[0]*TMath::Exp(-[1]*x)+[2]", 
-			 xmin, xmax );
-	decay->SetParNames( "N_{0}", "#lambda", "A" );
-	decay->SetParameter( 0, ymax );
-	decay->FixParameter( 1, TMath::Log( 2 ) / 20.334 );
-	decay->SetParameter( 2, 0 );
+	// Each fit gets its own function, so curves can be fit concurrently
+	static atomic<int> num_fits( 0 );
+	TF1 decay( TString::Format( "decay_%d", num_fits++ ), DecayModel, 
+		   xmin, xmax, 3 );
+	decay.SetParNames( "N_{0}", "#lambda", "A" );
+	decay.SetParameter( 0, ymax );
+	decay.FixParameter( 1, TMath::Log( 2 ) / half_life );
+	decay.SetParameter( 2, 0 );
+
+	TFitResultPtr fr = ge->Fit( &decay, "s", "", xmin, xmax );
+	ProfileCount( "decay_fit", "minuit_fits" );
+	if ( ProfilingEnabled() && fr.Get() )
+		ProfileCount( "decay_fit", "minuit_calls", fr->NCalls() );
+	return fr;
+}
+
+FitResult FitDecayCurveLinear( int n, double const * t, double const * y, 
+			       double const * ey, double lambda )
+{
+	double s = 0, s_e = 0, s_ee = 0, s_y = 0, s_ey = 0, s_yy = 0;
+	int num_points = 0;
+	for ( int i = 0; i < n; ++i )
+	{
+		if ( ey[i] <= 0 )
+			continue;
+
+		double w = 1 / (ey[i] * ey[i]);
+		double e = TMath::Exp( -lambda * t[i] );
+		s += w;
+		s_e += w * e;
+		s_ee += w * e * e;
+		s_y += w * y[i];
+		s_ey += w * e * y[i];
+		s_yy += w * y[i] * y[i];
+		++num_points;
+	}
+
+	FitResult fit;
+	fit.lambda = lambda;
+	fit.ndf = num_points - 2;
+
+	double det = s_ee * s - s_e * s_e;
+	if ( num_points < 2 || det <= 0 )
+	{
+		fit.n0.val = fit.n0.unc = fit.a.val = fit.a.unc = 0;
+		fit.chi2 = 0;
+		fit.status = 1;
+		return fit;
+	}
+
+	fit.n0.val = (s * s_ey - s_e * s_y) / det;
+	fit.a.val = (s_ee * s_y - s_e * s_ey) / det;
+	fit.n0.unc = sqrt( s / det );
+	fit.a.unc = sqrt( s_ee / det );
+
+	double n0 = fit.n0.val, a = fit.a.val;
+	fit.chi2 = s_yy - 2 * n0 * s_ey - 2 * a * s_y 
+		+ n0 * n0 * s_ee + 2 * n0 * a * s_e + a * a * s;
+	if ( fit.chi2 < 0 )	// Rounding error in a perfect fit
+		fit.chi2 = 0;
+	fit.status = 0;
+	return fit;
+}
+
+FitResult FitDecayCurveLinear( TGraphErrors const * ge, double half_life )
+{
+	return FitDecayCurveLinear( ge->GetN(), ge->GetX(), ge->GetY(), ge->GetEY(),
+				    TMath::Log( 2 ) / half_life );
+}
+
+/**
+ * Check whether two values agree to a part in 10^4.
+ */
+bool Agree( double a, double b )
+{
+	return fabs( a - b ) <= 1e-4 * (fabs( a ) > fabs( b ) ? fabs( a ) : fabs( b ));
+}
+
+FitResult Fit( TGraphErrors * ge, FitMethod method, double half_life )
+{
+	ProfileTimer timer( "decay_fit" );
+	FitResult fit = method == FIT_MINUIT ? 
+		Summarize( FitDecayCurve( ge, half_life ) ) : 
+		FitDecayCurveLinear( ge, half_life );
+	ProfileCount( "decay_fit", "fits" );
+	if ( fit.status != 0 )
+		ProfileCount( "decay_fit", "failed" );
 
-	return ge->Fit( decay, "s", "", xmin, xmax );
+	if ( method == FIT_CROSSCHECK )
+	{
+		FitResult check = Summarize( FitDecayCurve( ge, half_life ) );
+		if ( !Agree( fit.n0.val, check.n0.val ) || !Agree( fit.n0.unc, check.n0.unc ) ||
+				!Agree( fit.a.val, check.a.val ) || !Agree( fit.a.unc, check.a.unc ) )
+		{
+			cerr << "Linear and Minuit decay fits disagree:"
+				<< " N0 = " << fit.n0.val << " +- " << fit.n0.unc
+				<< " vs " << check.n0.val << " +- " << check.n0.unc
+				<< ", A = " << fit.a.val << " +- " << fit.a.unc
+				<< " vs " << check.a.val << " +- " << check.a.unc << endl;
+		}
+	}
+	return fit;
 }
 
 UncertainD Counts( TFitResultPtr fr, double trans_time, double efficiency )
 {
-	UncertainD n0;
-	n0.val = fr->Parameter( 0 );
-	n0.unc = fr->ParError( 0 );
-	Double_t lambda = fr->Parameter( 1 );
+	return Counts( Summarize( fr ), trans_time, efficiency );
+}
+
+UncertainD Counts( FitResult const & fit, double trans_time, double efficiency )
+{
+	UncertainD n0 = fit.n0;
+	Double_t lambda = fit.lambda;
 
 	UncertainD n_c11;
 	n_c11.val = n0.val * TMath::Exp( lambda * trans_time ) / (lambda * efficiency);
@@ -66,5 +188,30 @@ UncertainD Counts( TFitResultPtr fr, double trans_time, double efficiency )
 	return n_c11;
 }
 
+FitResult Summarize( TFitResultPtr fr )
+{
+	FitResult fit;
+	fit.n0.val = fr->Parameter( 0 );
+	fit.n0.unc = fr->ParError( 0 );
+	fit.lambda = fr->Parameter( 1 );
+	fit.a.val = fr->Parameter( 2 );
+	fit.a.unc = fr->ParError( 2 );
+	fit.chi2 = fr->Chi2();
+	fit.ndf = fr->Ndf();
+	fit.status = fr->Status();
+	return fit;
+}
+
+MinimizerScope::MinimizerScope()
+	: previous_( ROOT::Math::MinimizerOptions::DefaultMinimizerType() )
+{
+	ROOT::Math::MinimizerOptions::SetDefaultMinimizer( MINIMIZER );
+}
+
+MinimizerScope::~MinimizerScope()
+{
+	ROOT::Math::MinimizerOptions::SetDefaultMinimizer( previous_.c_str() );
+}
+
 } // namespace decay
 } // namespace n2n
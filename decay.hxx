@@ -9,8 +9,45 @@
 #include "Uncertain.hxx"
 
 namespace n2n {
+
+struct DataFile;
+
 namespace decay {
 
+/**
+ * The half-life of C11 used when fitting decay curves (min).
+ */
+double const HALF_LIFE = 20.334;
+
+/**
+ * The minimizer used by the pipeline for Minuit fits. TMinuit keeps
+ * global state, so concurrent fits need Minuit2, and it is used for any
+ * number of threads so that the fits do not depend on it.
+ */
+char const * const MINIMIZER = "Minuit2";
+
+/**
+ * Methods of fitting a decay curve.
+ */
+enum FitMethod {
+	FIT_MINUIT,	///< Minimize the chi-square with Minuit (@ref FitDecayCurve)
+	FIT_LINEAR,	///< Solve the linear least squares problem (@ref FitDecayCurveLinear)
+	FIT_CROSSCHECK	///< Use FIT_LINEAR, but compare it with FIT_MINUIT
+};
+
+/**
+ * The parameters of a decay curve fit, @f$N_0 e^{-\lambda t}+A@f$.
+ */
+struct FitResult
+{
+	UncertainD n0;		///< Initial activity, @f$N_0@f$
+	UncertainD a;		///< Constant background, @f$A@f$
+	double lambda;		///< Decay constant, @f$\lambda@f$ (1/min)
+	double chi2;		///< Chi-square of the fit
+	int ndf;		///< Number of degrees of freedom of the fit
+	int status;		///< Status of the fit (0 if successful)
+};
+
 /**
  * Parse a decay curve given in a tab-separated file into a TGraphErrors 
  * object.
@@ -24,15 +61,77 @@ namespace decay {
  */
 TGraphErrors * ParseDataFile( char const * filename );
 
+/**
+ * Parse a decay curve file which has already been read into memory, as
+ * above.
+ *
+ * @param file The contents of the file.
+ *
+ * @return A TGraphErrors object containing the input decay curve.
+ */
+TGraphErrors * ParseDataFile( DataFile const & file );
+
 /**
  * Fit an exponential decay curve to a TGraphErrors object.
  * The decay curve is given by @f$N_0 e^{-\lambda t}+A@f$.
 
  * @param ge The TGraphErrors object to be fit.
+ * @param half_life The half-life which fixes @f$\lambda@f$ (min).
 
  * @return A TFitResultPtr containing the results of the fit.
  */
-TFitResultPtr FitDecayCurve( TGraphErrors * ge );
+TFitResultPtr FitDecayCurve( TGraphErrors * ge, double half_life = HALF_LIFE );
+
+/**
+ * Fit an exponential decay curve, @f$N_0 e^{-\lambda t}+A@f$, with a fixed
+ * decay constant by weighted linear least squares.
+ *
+ * With @f$\lambda@f$ fixed the curve is linear in @f$N_0@f$ and @f$A@f$, so
+ * the chi-square is minimized by solving the normal equations
+ * @f[\begin{pmatrix}S_{ee}&S_e\\S_e&S\end{pmatrix}
+ * \begin{pmatrix}N_0\\A\end{pmatrix}=
+ * \begin{pmatrix}S_{ey}\\S_y\end{pmatrix}@f]
+ * where @f$e_i=e^{-\lambda t_i}@f$, @f$w_i=1/\delta_{y_i}^2@f$ and, e.g.,
+ * @f$S_{ey}=\sum w_i e_i y_i@f$. The errors are the square roots of the
+ * diagonal of the inverse matrix. This gives the same result as
+ * @ref FitDecayCurve in a single pass over the data, without Minuit.
+ * Points with zero error are ignored, as they are by TGraphErrors::Fit.
+ *
+ * @param n The number of points.
+ * @param t The times of the points, @f$t_i@f$ (min).
+ * @param y The counts of the points, @f$y_i@f$.
+ * @param ey The errors in the counts, @f$\delta_{y_i}@f$.
+ * @param lambda The decay constant, @f$\lambda@f$ (1/min).
+ *
+ * @return The parameters of the fit.
+ */
+FitResult FitDecayCurveLinear( int n, double const * t, double const * y, 
+			       double const * ey, double lambda );
+
+/**
+ * Fit an exponential decay curve to a TGraphErrors object by weighted 
+ * linear least squares, with the decay constant fixed by a half-life.
+ *
+ * @param ge The TGraphErrors object to be fit.
+ * @param half_life The half-life (min).
+ *
+ * @return The parameters of the fit.
+ */
+FitResult FitDecayCurveLinear( TGraphErrors const * ge, double half_life = HALF_LIFE );
+
+/**
+ * Fit an exponential decay curve to a TGraphErrors object.
+ * With FIT_CROSSCHECK, a warning is printed if the linear and Minuit fits
+ * disagree by more than a part in @f$10^4@f$ in @f$N_0@f$, @f$A@f$ or 
+ * their errors.
+ *
+ * @param ge The TGraphErrors object to be fit.
+ * @param method The method to use.
+ * @param half_life The half-life which fixes @f$\lambda@f$ (min).
+ *
+ * @return The parameters of the fit.
+ */
+FitResult Fit( TGraphErrors * ge, FitMethod method, double half_life = HALF_LIFE );
 
 /**
  * Calculate the total number of C11 originally in the sample, @f$N_{C11}@f$.
@@ -48,6 +147,40 @@ TFitResultPtr FitDecayCurve( TGraphErrors * ge );
  */
 UncertainD Counts( TFitResultPtr fr, double trans_time, double efficiency );
 
+/**
+ * Calculate the total number of C11 originally in the sample, as above.
+ *
+ * @param fit The parameters of the fitted decay curve.
+ * @param trans_time The elapsed time before counting began, @f$t_{trans}@f$
+ * @param efficiency The efficiency of counting in this sample, @f$\text{eff}@f$
+ *
+ * @return The total number of C11 originally present in the sample.
+ */
+UncertainD Counts( FitResult const & fit, double trans_time, double efficiency );
+
+/**
+ * Copy the parameters out of a fit returned by @ref FitDecayCurve.
+ *
+ * @param fr The TFitResultPtr returned by @ref FitDecayCurve.
+ *
+ * @return The parameters of the fit.
+ */
+FitResult Summarize( TFitResultPtr fr );
+
+/**
+ * Make MINIMIZER the default minimizer while it exists, and restore the
+ * previous default when it is destroyed, e.g. by an exception.
+ */
+struct MinimizerScope
+{
+	public:
+		MinimizerScope();
+		~MinimizerScope();
+
+	private:
+		string previous_;	///< The previous default minimizer
+};
+
 } // namespace decay
 } // namespace n2n
 
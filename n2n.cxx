@@ -0,0 +1,62 @@
+/** 
+ * @file n2n/n2n.cxx
+ * Copyright (C) 2013 Houghton College
+ *
+ * Compile every source file into a single shared library with ACLiC, so
+ * the analysis can run without interpreting the sources.
+ *
+ * @code
+ * .L n2n/n2n.cxx+
+ * @endcode
+ */
+
+#include <TF1.h>
+#include <TFitResult.h>
+#include <TFitResultPtr.h>
+#include <TGraphErrors.h>
+#include <TH2.h>
+#include <TMath.h>
+#include <TROOT.h>
+#include <TString.h>
+#include <TSystem.h>
+#include <Math/Interpolator.h>
+#include <Math/MinimizerOptions.h>
+
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#include "Log.cxx"
+#include "Profile.cxx"
+#include "CSVFile.cxx"
+#include "BinaryTable.cxx"
+#include "Uncertain.cxx"
+#include "DataFile.cxx"
+#include "ColumnTable.cxx"
+#include "NPCrossSection.cxx"
+#include "FitCache.cxx"
+#include "Dependencies.cxx"
+#include "Parameters.cxx"
+#include "SummedArea.cxx"
+#include "decay.cxx"
+#include "GlobalFit.cxx"
+#include "proton.cxx"
+#include "RunSummary.cxx"
+#include "CrossSection_loadsum.cxx"
+#include "CrossSection_calculate.cxx"
+#include "CrossSection_montecarlo.cxx"
+#include "CrossSection_sweep.cxx"
+#include "pipeline.cxx"
+#include "pipeline_watch.cxx"
+#include "pipeline_shard.cxx"
+#include "synthetic.cxx"
+#include "benchmark.cxx"
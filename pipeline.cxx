@@ -0,0 +1,322 @@
+/** 
+ * @file n2n/pipeline.cxx
+ * Copyright (C) 2013 Houghton College
+ */
+
+#include "pipeline.hxx"
+#include "RunSummary.hxx"
+#include "CrossSection.hxx"
+#include "Dependencies.hxx"
+#include "FitCache.hxx"
+#include "GlobalFit.hxx"
+#include "SummedArea.hxx"
+#include "proton.hxx"
+#include "Log.hxx"
+
+namespace n2n {
+namespace pipeline {
+
+TString DataPath( char const * dirname, char const * name )
+{
+	TString path = name;
+	gSystem->PrependPathName( dirname, path );
+	return path;
+}
+
+bool LoadNPCrossSection( char const * dirname, NPCrossSection * np_xsect )
+{
+	TString filename = DataPath( dirname, "NP_Cross_Sections.csv" );
+
+	// NOTE: TSystem::AccessPathName returns *false* if the file exists!
+	if ( gSystem->AccessPathName( filename ) )
+		return false;
+	np_xsect->Load( filename );
+	return true;
+}
+
+void Recalculate( char const * dirname, int num_workers )
+{
+	TString filename_summary = DataPath( dirname, "Run_Summary.csv" );
+	TString filename_cross = DataPath( dirname, "Cross_Sections.csv" );
+	TString filename_cache = DataPath( dirname, "Fit_Cache.csv" );
+	TString filename_params = DataPath( dirname, "Parameters.csv" );
+	TString filename_deps = DataPath( dirname, "Dependencies.csv" );
+
+	FitCache cache;
+	cache.Load( filename_cache );
+	Dependencies deps;
+	deps.Load( filename_deps );
+	Parameters params;
+	params.Load( filename_params );
+
+	RunSummary sum;
+	sum.Load( filename_summary );
+	sum.SetFitCache( &cache );
+	sum.SetNumWorkers( num_workers );
+	sum.SetParameters( params );
+	sum.SetDependencies( &deps );
+	sum.Update( dirname );
+
+	NPCrossSection np_xsect;
+	CrossSection cross;
+	cross.Load( filename_cross );
+	if ( LoadNPCrossSection( dirname, &np_xsect ) )
+		cross.SetNPCrossSection( &np_xsect );
+	cross.SetParameters( params );
+	cross.SetDependencies( &deps );
+	cross.LoadSummary( &sum );
+	cross.Calculate();
+
+	// The record is saved last, so results are only trusted once saved
+	sum.SetWriteBinary( true );
+	sum.Save( filename_summary );
+	cross.Save( filename_cross );
+	cache.Save( filename_cache );
+	deps.Save( filename_deps );
+}
+
+void ScanRegion( char const * dirname, int row_number, int step, int num_steps )
+{
+	TString filename_cross = DataPath( dirname, "Cross_Sections.csv" );
+	TString filename_scan = DataPath( dirname, "ROI_Scan.csv" );
+	TString dirname_proton = DataPath( dirname, "Proton Telescope" );
+
+	CrossSection cross;
+	cross.Load( filename_cross );
+	vector<string> row = cross.GetRow( row_number );
+	int fg_run_number = atoi( row[CS_FG_RUN_NUMBER].c_str() );
+	int bg_run_number = atoi( row[CS_BG_RUN_NUMBER].c_str() );
+
+	TString filename_mpa = DataPath( dirname_proton,
+			TString::Format( "Run%03d.mpa", fg_run_number ) );
+	Region nominal = proton::ParseHeaderFile( filename_mpa );
+
+	SummedArea fg, bg;
+	TString filename_fg = DataPath( dirname_proton,
+			TString::Format( "Run%03d_1x2.csv", fg_run_number ) );
+	TH2I * data = proton::ParseDataFile( filename_fg );
+	fg.Build( data );
+	delete data;
+
+	TString filename_bg = DataPath( dirname_proton,
+			TString::Format( "Run%03d_1x2.csv", bg_run_number ) );
+	data = proton::ParseDataFile( filename_bg );
+	bg.Build( data );
+	delete data;
+
+	vector<ScanPoint> points;
+	cross.ScanRegion( row_number, fg, bg, nominal, step, num_steps, &points );
+
+	CSVFile scan;
+	char const * header[] = { "ROI X Min", "ROI X Max", "ROI Y Min", "ROI Y Max",
+		"FG Protons", "BG Protons", "Proton Flux", "Proton Flux Unc" };
+	scan.AddRow( vector<string>( header, header + 8 ) );
+	for ( int i = 0; i < points.size(); ++i )
+	{
+		vector<string> out( 8 );
+		out[0] = TString::Format( "%d", points[i].roi.min_x );
+		out[1] = TString::Format( "%d", points[i].roi.max_x );
+		out[2] = TString::Format( "%d", points[i].roi.min_y );
+		out[3] = TString::Format( "%d", points[i].roi.max_y );
+		out[4] = TString::Format( "%lld", points[i].fg_protons );
+		out[5] = TString::Format( "%lld", points[i].bg_protons );
+		out[6] = TString::Format( "%f", points[i].flux.val );
+		out[7] = TString::Format( "%f", points[i].flux.unc );
+		scan.AddRow( out );
+	}
+	scan.Save( filename_scan );
+}
+
+void ConvertSpectra( char const * dirname )
+{
+	TString filename_summary = DataPath( dirname, "Run_Summary.csv" );
+	TString dirname_proton = DataPath( dirname, "Proton Telescope" );
+
+	RunSummary sum;
+	sum.Load( filename_summary );
+	for ( int i = 0; i < sum.NumRuns(); ++i )
+	{
+		int run_number = sum.GetRunNumberAt( i );
+
+		TString filename_csv = DataPath( dirname_proton,
+				TString::Format( "Run%03d_1x2.csv", run_number ) );
+		TString filename_mpa = DataPath( dirname_proton,
+				TString::Format( "Run%03d.mpa", run_number ) );
+		TString filename_spc = proton::SpectrumFileName( filename_csv );
+
+		// NOTE: TSystem::AccessPathName returns *false* if the file exists!
+		if ( gSystem->AccessPathName( filename_csv ) || 
+				gSystem->AccessPathName( filename_mpa ) ||
+				proton::UseSpectrumFile( filename_csv, filename_mpa, filename_spc ) )
+			continue;
+
+		proton::WriteSpectrumFile( filename_csv, filename_mpa, filename_spc );
+		cout << "Converted " << filename_csv << endl;
+	}
+}
+
+UncertainD FitHalfLife( char const * dirname, int num_workers )
+{
+	TString filename_summary = DataPath( dirname, "Run_Summary.csv" );
+	TString dirname_decay = DataPath( dirname, "Decay Curves" );
+
+	RunSummary sum;
+	sum.Load( filename_summary );
+
+	decay::GlobalFit fit;
+	fit.SetNumWorkers( num_workers );
+	for ( int i = 0; i < sum.NumRuns(); ++i )
+	{
+		int run_number = sum.GetRunNumberAt( i );
+
+		char const * formats[] = { "Run%03d_puck.csv", "Run%03d_plastic.csv" };
+		for ( int j = 0; j < 2; ++j )
+		{
+			TString filename = DataPath( dirname_decay,
+					TString::Format( formats[j], run_number ) );
+
+			// NOTE: TSystem::AccessPathName returns *false* if the file exists!
+			if ( gSystem->AccessPathName( filename ) )
+				continue;
+
+			TGraphErrors * ge = decay::ParseDataFile( filename );
+			fit.AddCurve( ge );
+			delete ge;
+		}
+	}
+
+	// Search half-lives from 10 to 40 min
+	if ( !fit.Fit( TMath::Log( 2 ) / 40, TMath::Log( 2 ) / 10 ) )
+	{
+		TString msg = TString::Format( 
+			"No C11 half-life from 10 to 40 min fits the %d decay curves in %s",
+			fit.NumCurves(), dirname_decay.Data() );
+		LogMessage( LOG_ERROR, msg );
+		throw runtime_error( msg.Data() );
+	}
+
+	UncertainD half_life = fit.HalfLife();
+	cout << "C11 half-life from " << fit.NumCurves() << " decay curves: "
+		<< half_life.val << " +- " << half_life.unc << " min" << endl;
+	return half_life;
+}
+
+void Sweep( char const * dirname, int num_workers )
+{
+	TString filename_summary = DataPath( dirname, "Run_Summary.csv" );
+	TString filename_cross = DataPath( dirname, "Cross_Sections.csv" );
+	TString filename_params = DataPath( dirname, "Parameters.csv" );
+	TString filename_sets = DataPath( dirname, "Sweep_Parameters.csv" );
+	TString filename_results = DataPath( dirname, "Sweep_Results.csv" );
+	TString filename_cache = DataPath( dirname, "Fit_Cache.csv" );
+
+	Parameters params;
+	params.Load( filename_params );
+	vector<Parameters> sets;
+	vector<string> names;
+	LoadParameterSets( filename_sets, params, &sets, &names );
+
+	RunSummary sum;
+	sum.Load( filename_summary );
+	FitCache cache;
+	cache.Load( filename_cache );
+
+	NPCrossSection np_xsect;
+	CrossSection cross;
+	cross.Load( filename_cross );
+	if ( LoadNPCrossSection( dirname, &np_xsect ) )
+		cross.SetNPCrossSection( &np_xsect );
+	cross.SetParameters( params );
+	cross.SetFitCache( &cache );
+	cross.LoadSummary( &sum );
+
+	vector<double> results;
+	cross.CalculateSweep( &sum, dirname, sets, &results, num_workers );
+	cache.Save( filename_cache );
+
+	CSVFile out;
+	vector<string> header = names;
+	for ( int i = 3; i < cross.NumRows(); ++i )
+	{
+		vector<string> row = cross.GetRow( i );
+		header.push_back( TString::Format( "%s-%s CH2 Xsect", 
+			row[CS_FG_RUN_NUMBER].c_str(), row[CS_BG_RUN_NUMBER].c_str() ).Data() );
+		header.push_back( TString::Format( "%s-%s C12 Xsect", 
+			row[CS_FG_RUN_NUMBER].c_str(), row[CS_BG_RUN_NUMBER].c_str() ).Data() );
+	}
+	out.AddRow( header );
+
+	int num_values = 2 * (cross.NumRows() - 3);
+	for ( int s = 0; s < sets.size(); ++s )
+	{
+		vector<string> row;
+		for ( int j = 0; j < names.size(); ++j )
+			row.push_back( TString::Format( "%.15g", 
+				sets[s].Get( names[j].c_str() ) ).Data() );
+		for ( int j = 0; j < num_values; ++j )
+			row.push_back( TString::Format( "%f", 
+				results[(size_t) s * num_values + j] ).Data() );
+		out.AddRow( row );
+	}
+	out.Save( filename_results );
+	LogMessage( LOG_INFO, TString::Format( "%s: %d parameter sets", 
+				filename_results.Data(), (int) sets.size() ) );
+}
+
+void PropagateUncertainties( char const * dirname, int num_samples, 
+		int num_workers )
+{
+	TString filename_cross = DataPath( dirname, "Cross_Sections.csv" );
+	TString filename_mc = DataPath( dirname, "Cross_Sections_MC.csv" );
+
+	TString filename_params = DataPath( dirname, "Parameters.csv" );
+
+	Parameters params;
+	params.Load( filename_params );
+
+	NPCrossSection np_xsect;
+	CrossSection cross;
+	cross.Load( filename_cross );
+	if ( LoadNPCrossSection( dirname, &np_xsect ) )
+		cross.SetNPCrossSection( &np_xsect );
+	cross.SetParameters( params );
+
+	vector<MCRow> rows;
+	cross.CalculateMonteCarlo( num_samples, &rows, num_workers );
+
+	CSVFile mc;
+	char const * quantities[] = { "Proton Flux", "Neutron Flux", 
+		"CH2 Xsect", "C12 Xsect" };
+	char const * stats[] = { "Mean", "Std Dev", "P16", "P50", "P84" };
+	vector<string> header( 2 );
+	header[0] = "FG Run";
+	header[1] = "BG Run";
+	for ( int j = 0; j < 4; ++j )
+	for ( int k = 0; k < 5; ++k )
+		header.push_back( TString::Format( "%s %s", quantities[j], stats[k] ).Data() );
+	mc.AddRow( header );
+
+	for ( int i = 0; i < rows.size(); ++i )
+	{
+		vector<string> row = cross.GetRow( i + 3 );
+		vector<string> out( 2 );
+		out[0] = row[CS_FG_RUN_NUMBER];
+		out[1] = row[CS_BG_RUN_NUMBER];
+
+		MCSummary const * summaries[] = { &rows[i].proton_flux, 
+			&rows[i].neutron_flux, &rows[i].ch2_xsect, &rows[i].c12_xsect };
+		for ( int j = 0; j < 4; ++j )
+		{
+			out.push_back( TString::Format( "%f", summaries[j]->mean ).Data() );
+			out.push_back( TString::Format( "%f", summaries[j]->std_dev ).Data() );
+			out.push_back( TString::Format( "%f", summaries[j]->p16 ).Data() );
+			out.push_back( TString::Format( "%f", summaries[j]->p50 ).Data() );
+			out.push_back( TString::Format( "%f", summaries[j]->p84 ).Data() );
+		}
+		mc.AddRow( out );
+	}
+	mc.Save( filename_mc );
+}
+
+} // namespace pipeline
+} // namespace n2n
@@ -0,0 +1,240 @@
+/** 
+ * @file n2n/pipeline.hxx
+ * Copyright (C) 2013 Houghton College
+ */
+
+#ifndef N2N_PIPELINE_INCL_
+#define N2N_PIPELINE_INCL_
+
+#include "Uncertain.hxx"
+
+namespace n2n {
+
+struct NPCrossSection;
+
+namespace pipeline {
+
+/**
+ * Get the path of a file or directory in a data directory.
+ * @param dirname The data directory.
+ * @param name The name of the file or directory, e.g. "Decay Curves".
+ */
+TString DataPath( char const * dirname, char const * name );
+
+/**
+ * Load NP_Cross_Sections.csv from a directory, if it exists.
+ * @param dirname The directory to look in.
+ * @param np_xsect The table to load into.
+ * @return True if the table was loaded.
+ */
+bool LoadNPCrossSection( char const * dirname, NPCrossSection * np_xsect );
+
+/**
+ * Recalculate every run summary and cross section in a single pass.
+ *
+ * This is equivalent to running summary_update.C, cross_loadsum.C and
+ * cross_calculate.C in that order, except that the updated run summary is
+ * handed to the cross sections in memory and each file is written only once.
+ * If the directory contains NP_Cross_Sections.csv, it replaces the default
+ * n-p cross sections (see NPCrossSection::Load), and if it contains 
+ * Parameters.csv, it replaces the default geometry, efficiencies, half-life
+ * and densities (see Parameters::Load).
+ *
+ * What each result was calculated from is recorded in Dependencies.csv, and
+ * only results whose inputs changed are recalculated: editing the geometry
+ * refits no decay curves and recounts no protons, editing an efficiency 
+ * recounts no protons, and only the rows of Cross_Sections.csv whose 
+ * inputs changed are recalculated. Delete Dependencies.csv to recalculate
+ * everything.
+ *
+ * Run_Summary.csv and Cross_Sections.csv are saved with their binary 
+ * sidecars (see BinaryTable), so that later loads need not read them as
+ * text.
+ *
+ * @param dirname The directory containing Run_Summary.csv, 
+ * Cross_Sections.csv and the raw data directories.
+ * @param num_workers The number of runs to update concurrently, or 0 to
+ * use one per core.
+ */
+void Recalculate( char const * dirname, int num_workers = 1 );
+
+/**
+ * Scan the region of interest used for the proton flux of one row of
+ * Cross_Sections.csv, and write the results to ROI_Scan.csv.
+ *
+ * The nominal region is read from the .mpa file of the foreground run, and
+ * the flux is recalculated with each boundary moved independently.
+ *
+ * @param dirname The directory containing Cross_Sections.csv and the raw
+ * data directories.
+ * @param row_number The row of Cross_Sections.csv to scan.
+ * @param step The change in a boundary between grid points (channels).
+ * @param num_steps The number of grid points on either side of each 
+ * nominal boundary.
+ */
+void ScanRegion( char const * dirname, int row_number, int step, int num_steps );
+
+/**
+ * Convert the proton telescope data of every run in Run_Summary.csv into
+ * binary spectrum files, which are read in place of the .csv data files
+ * from then on. Runs with an up-to-date spectrum file are skipped.
+ *
+ * @param dirname The directory containing Run_Summary.csv and the raw 
+ * data directories.
+ */
+void ConvertSpectra( char const * dirname );
+
+/**
+ * Measure the half-life of C11 with a simultaneous fit of the puck and
+ * plastic decay curves of every run in Run_Summary.csv, and print it.
+ *
+ * @param dirname The directory containing Run_Summary.csv and the raw 
+ * data directories.
+ * @param num_workers The number of threads used to evaluate the 
+ * likelihood, or 0 to use one per core.
+ *
+ * @return The fitted half-life (min). An exception is thrown if no 
+ * half-life from 10 to 40 min fits.
+ */
+UncertainD FitHalfLife( char const * dirname, int num_workers = 0 );
+
+/**
+ * Propagate the uncertainties of every input in Cross_Sections.csv to the
+ * calculated values by Monte Carlo, and write the distributions to
+ * Cross_Sections_MC.csv. See CrossSection::CalculateMonteCarlo. As in
+ * Recalculate, NP_Cross_Sections.csv and Parameters.csv are used if they
+ * exist.
+ *
+ * @param dirname The directory containing Cross_Sections.csv.
+ * @param num_samples The number of samples per row.
+ * @param num_workers The number of threads, or 0 to use one per core.
+ */
+void PropagateUncertainties( char const * dirname, int num_samples, 
+		int num_workers = 0 );
+
+/**
+ * Calculate every cross section for many sets of parameters, e.g. to 
+ * study the systematic uncertainty from the geometry or the half-life, 
+ * and write them to Sweep_Results.csv. See CrossSection::CalculateSweep.
+ *
+ * The sets are read from Sweep_Parameters.csv, as a list or a grid (see
+ * LoadParameterSets); parameters which are not named are read from 
+ * Parameters.csv if it exists. Sweep_Results.csv has one row per set,
+ * holding the parameters which vary, then the CH2 and C12 cross sections
+ * of each row of Cross_Sections.csv. Run_Summary.csv should be up to 
+ * date, e.g. from Recalculate; neither it nor Cross_Sections.csv is 
+ * changed. Decay fits are shared with Recalculate through Fit_Cache.csv,
+ * which is saved with the fits of any new half-life.
+ *
+ * @param dirname The directory containing Run_Summary.csv, 
+ * Cross_Sections.csv, Sweep_Parameters.csv and the raw data directories.
+ * @param num_workers The number of threads, or 0 to use one per core.
+ */
+void Sweep( char const * dirname, int num_workers = 0 );
+
+/**
+ * Watch the raw data directories during a beam shift, and update the run
+ * summary and cross sections as soon as the data files of a run are 
+ * written.
+ *
+ * The "Decay Curves" and "Proton Telescope" directories are polled for 
+ * new or modified Run%03d_puck.csv, _plastic.csv, _1x2.csv and .mpa files.
+ * A file is complete once its size and modification time have not changed
+ * for settle_time. Then only its run is updated, only the rows of 
+ * Cross_Sections.csv which use that run as foreground or background are 
+ * recalculated, and Run_Summary.csv, Cross_Sections.csv and Fit_Cache.csv
+ * are each replaced in one step, so a reader never sees a partial file.
+ * Files present when watching starts are assumed to be up to date already.
+ *
+ * As in Recalculate, NP_Cross_Sections.csv and Parameters.csv are used if
+ * they exist when watching starts.
+ *
+ * A run must have a row in Run_Summary.csv before it can be updated. If
+ * Run_Summary.csv or Cross_Sections.csv is edited while watching, it is 
+ * reloaded, and runs which were waiting for a row are updated.
+ *
+ * @param dirname The directory containing Run_Summary.csv, 
+ * Cross_Sections.csv and the raw data directories.
+ * @param poll_interval The time between checks of the directories (ms).
+ * @param settle_time The time a file must be unchanged before it is 
+ * used (ms).
+ * @param num_polls The number of checks before returning, or 0 to watch
+ * until interrupted.
+ */
+void Watch( char const * dirname, int poll_interval = 100, 
+		int settle_time = 300, int num_polls = 0 );
+
+/**
+ * Update the runs numbered from first_run to last_run of Run_Summary.csv, 
+ * as one shard of a campaign too large for one process.
+ *
+ * A campaign is split into run ranges, and each range is processed by a
+ * separate process, on this machine or on any node of a batch system which
+ * shares the data directory; the processes do not communicate. It takes 
+ * four steps, each waiting for the previous one to finish:
+ *
+ * 1. UpdateShard for every range;
+ * 2. MergeShards, which writes Run_Summary.csv;
+ * 3. CalculateShard for every range, since the background run of a row 
+ *    may belong to another range;
+ * 4. MergeShards, which writes Cross_Sections.csv.
+ *
+ * The ranges need not be equal, and may overlap if the overlapping runs
+ * agree. Fit_Cache.csv and Dependencies.csv are saved sorted, and every
+ * decay fit uses decay::MINIMIZER, so the merged files are byte for byte
+ * those written by Recalculate, whatever the number of shards and of 
+ * workers; benchmark::Run checks this.
+ *
+ * Nothing shared is written: the updated runs are written to the partial 
+ * file Run_Summary.shard_<first_run>-<last_run>.csv, and the new entries 
+ * of Fit_Cache.csv and Dependencies.csv to partial files named likewise. 
+ * As in Recalculate, Parameters.csv is used if it exists.
+ *
+ * @param dirname The directory containing Run_Summary.csv and the raw 
+ * data directories.
+ * @param first_run The first run of the shard.
+ * @param last_run The last run of the shard.
+ * @param num_workers The number of runs to update concurrently, or 0 to
+ * use one per core.
+ */
+void UpdateShard( char const * dirname, int first_run, int last_run,
+		int num_workers = 1 );
+
+/**
+ * Calculate the rows of Cross_Sections.csv whose foreground run is 
+ * numbered from first_run to last_run, as one shard of a campaign (see 
+ * UpdateShard), writing them to the partial file 
+ * Cross_Sections.shard_<first_run>-<last_run>.csv. As in Recalculate,
+ * NP_Cross_Sections.csv and Parameters.csv are used if they exist.
+ *
+ * @param dirname The directory containing Run_Summary.csv and 
+ * Cross_Sections.csv.
+ * @param first_run The first foreground run of the shard.
+ * @param last_run The last foreground run of the shard.
+ * @throw runtime_error The partial run summaries of UpdateShard have not
+ * been merged.
+ */
+void CalculateShard( char const * dirname, int first_run, int last_run );
+
+/**
+ * Merge the partial files written by every shard of a campaign (see 
+ * UpdateShard) into Run_Summary.csv, Cross_Sections.csv, Fit_Cache.csv and
+ * Dependencies.csv, then delete them.
+ *
+ * Each row of a partial replaces the row of the same number, so the rows 
+ * keep their order whatever the number and order of the shards. Every 
+ * partial is checked before anything is saved, and a warning is logged
+ * for runs or rows which no shard calculated. As in Recalculate, the 
+ * merged Run_Summary.csv and Cross_Sections.csv are saved with their 
+ * sidecars; shards never write one.
+ *
+ * @param dirname The directory containing the files.
+ * @throw runtime_error A partial was written from a different version of
+ * its table, or two partials give different values for the same row.
+ */
+void MergeShards( char const * dirname );
+
+} // namespace pipeline
+} // namespace n2n
+
+#endif
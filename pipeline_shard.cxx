@@ -0,0 +1,366 @@
+/**
+ * @file n2n/pipeline_shard.cxx
+ * Copyright (C) 2013 Houghton College
+ */
+
+#include "pipeline.hxx"
+#include "RunSummary.hxx"
+#include "CrossSection.hxx"
+#include "Dependencies.hxx"
+#include "FitCache.hxx"
+#include "Log.hxx"
+
+#include <algorithm>
+#include <climits>
+
+namespace n2n {
+namespace pipeline {
+
+/**
+ * Get the name of the partial file of a table written by the shard which
+ * processes the runs from first_run to last_run, e.g.
+ * Run_Summary.shard_100-199.csv for Run_Summary.csv.
+ */
+TString ShardFileName( char const * filename, int first_run, int last_run )
+{
+	TString name = filename;
+	if ( name.EndsWith( ".csv" ) )
+		name.Remove( name.Length() - 4 );
+	name += TString::Format( ".shard_%d-%d.csv", first_run, last_run );
+	return name;
+}
+
+/**
+ * Find the partial files of a table written by every shard, sorted by
+ * name so that they are merged in the same order on every machine.
+ * @param dirname The directory containing the table.
+ * @param name The name of the table, e.g. "Run_Summary.csv".
+ * @param filenames Filled with the full path of each partial file.
+ */
+void FindShardFiles( char const * dirname, char const * name,
+		vector<string> * filenames )
+{
+	filenames->clear();
+	TString prefix = name;
+	if ( prefix.EndsWith( ".csv" ) )
+		prefix.Remove( prefix.Length() - 4 );
+	prefix += ".shard_";
+
+	void * dir = gSystem->OpenDirectory( dirname );
+	if ( !dir )
+		return;
+
+	char const * entry;
+	while ( (entry = gSystem->GetDirEntry( dir )) != NULL )
+	{
+		TString filename = entry;
+		if ( !filename.BeginsWith( prefix ) || !filename.EndsWith( ".csv" ) )
+			continue;
+		filenames->push_back( DataPath( dirname, filename ).Data() );
+	}
+	gSystem->FreeDirectory( dir );
+	sort( filenames->begin(), filenames->end() );
+}
+
+/**
+ * Get a hash of the contents of a table, which identifies the version of
+ * the table a partial file was written from.
+ */
+ULong64_t TableHash( CSVFile const & table )
+{
+	Fingerprint fp;
+	vector<CSVField> fields;
+	for ( int i = 0; i < table.NumRows(); ++i )
+	{
+		table.GetFields( i, &fields );
+		fp.Add( (double) fields.size() );
+		for ( int j = 0; j < fields.size(); ++j )
+			fp.Add( fields[j].ToString() );
+	}
+	return fp.Value();
+}
+
+/**
+ * Write some rows of a table to a partial file. The first row holds the
+ * hash of the table as it was loaded (see TableHash), and each following
+ * row holds the number of a row in the table (counting from 1) and then 
+ * its fields.
+ */
+void SavePartial( CSVFile const & table, ULong64_t table_hash,
+		vector<int> const & rows, char const * filename )
+{
+	CSVFile partial;
+	vector<string> header( 2 );
+	header[0] = "Table Hash";
+	header[1] = TString::Format( "%016llx", table_hash );
+	partial.AddRow( header );
+
+	for ( int i = 0; i < rows.size(); ++i )
+	{
+		vector<string> row = table.GetRow( rows[i] );
+		row.insert( row.begin(), string( TString::Format( "%d", rows[i] + 1 ) ) );
+		partial.AddRow( row );
+	}
+	partial.Save( filename );
+}
+
+/**
+ * Write the rows of a table which changed since it was loaded to a file,
+ * e.g. the new entries of a FitCache.
+ */
+void SaveChangedRows( CSVFile const & table, char const * filename )
+{
+	CSVFile changed;
+	for ( int i = 0; i < table.NumRows(); ++i )
+		if ( table.RowChanged( i ) )
+			changed.AddRow( table.GetRow( i ) );
+	changed.Save( filename );
+}
+
+/**
+ * Report a partial file which cannot be merged.
+ */
+void ShardError( TString const & msg )
+{
+	LogMessage( LOG_ERROR, msg );
+	throw runtime_error( msg.Data() );
+}
+
+/**
+ * Copy the rows of partial files into the table they were written from.
+ *
+ * Each row must still belong to the same run, i.e. keep its first field.
+ * A row may be given by several partials, e.g. if the ranges of two shards
+ * overlap, but only if they agree on its values.
+ * @param table The table to merge into.
+ * @param filenames The partial files.
+ * @param merged Set to whether each row of the table was merged.
+ * @throw runtime_error A partial was written from another version of the
+ * table, or two partials give different values for the same row.
+ */
+void MergePartials( CSVFile * table, vector<string> const & filenames,
+		vector<bool> * merged )
+{
+	TString table_hash = TString::Format( "%016llx", TableHash( *table ) );
+	vector<int> owner( table->NumRows(), -1 );
+	for ( int f = 0; f < filenames.size(); ++f )
+	{
+		char const * filename = filenames[f].c_str();
+		CSVFile partial;
+		partial.Load( filename );
+
+		vector<string> header = partial.NumRows() > 0 ? partial.GetRow( 0 ) :
+			vector<string>();
+		if ( header.size() < 2 || header[0] != "Table Hash" )
+			ShardError( TString::Format( "%s is not a partial file", filename ) );
+		if ( header[1] != table_hash.Data() )
+			ShardError( TString::Format(
+				"%s was written from another version of the table",
+				filename ) );
+
+		for ( int i = 1; i < partial.NumRows(); ++i )
+		{
+			vector<string> row = partial.GetRow( i );
+			int row_number = row.empty() ? 0 : atoi( row[0].c_str() ) - 1;
+			if ( row_number < 0 || row_number >= table->NumRows() || row.size() < 2 )
+				ShardError( TString::Format( "%s row %d: invalid row",
+							filename, i + 1 ) );
+			row.erase( row.begin() );
+
+			vector<string> current = table->GetRow( row_number );
+			if ( current.empty() || current[0] != row[0] )
+				ShardError( TString::Format(
+					"%s row %d: expected '%s' in row %d but found '%s'",
+					filename, i + 1, current.empty() ? "" : current[0].c_str(),
+					row_number + 1, row[0].c_str() ) );
+			if ( owner[row_number] >= 0 && current != row )
+				ShardError( TString::Format(
+					"%s and %s give different values for row %d",
+					filenames[owner[row_number]].c_str(), filename,
+					row_number + 1 ) );
+
+			table->SetRow( row_number, row );
+			owner[row_number] = f;
+		}
+	}
+
+	merged->resize( owner.size() );
+	for ( int i = 0; i < owner.size(); ++i )
+		(*merged)[i] = owner[i] >= 0;
+}
+
+/**
+ * Warn about rows which no shard calculated.
+ */
+void WarnUnmerged( vector<bool> const & merged, vector<int> const & rows,
+		char const * filename, char const * what )
+{
+	int missing = 0;
+	for ( int i = 0; i < rows.size(); ++i )
+		if ( !merged[rows[i]] )
+			++missing;
+	if ( missing > 0 )
+		LogMessage( LOG_WARNING, TString::Format(
+			"%s: %d of %d %s were in no shard, and are unchanged",
+			filename, missing, (int) rows.size(), what ) );
+}
+
+void UpdateShard( char const * dirname, int first_run, int last_run,
+		int num_workers )
+{
+	TString filename_summary = DataPath( dirname, "Run_Summary.csv" );
+	TString filename_cache = DataPath( dirname, "Fit_Cache.csv" );
+	TString filename_params = DataPath( dirname, "Parameters.csv" );
+	TString filename_deps = DataPath( dirname, "Dependencies.csv" );
+
+	FitCache cache;
+	cache.Load( filename_cache );
+	Dependencies deps;
+	deps.Load( filename_deps );
+	Parameters params;
+	params.Load( filename_params );
+
+	RunSummary sum;
+	sum.Load( filename_summary );
+	ULong64_t sum_hash = TableHash( sum );
+	sum.SetFitCache( &cache );
+	sum.SetNumWorkers( num_workers );
+	sum.SetParameters( params );
+	sum.SetDependencies( &deps );
+	sum.Update( dirname, first_run, last_run );
+
+	// The record is saved last, so results are only trusted once saved
+	vector<int> rows;
+	sum.FindRuns( first_run, last_run, &rows );
+	SavePartial( sum, sum_hash, rows, ShardFileName( filename_summary, first_run, last_run ) );
+	SaveChangedRows( cache, ShardFileName( filename_cache, first_run, last_run ) );
+	SaveChangedRows( deps, ShardFileName( filename_deps, first_run, last_run ) );
+
+	LogMessage( LOG_INFO, TString::Format( "Updated %d runs from %d to %d",
+				(int) rows.size(), first_run, last_run ) );
+}
+
+void CalculateShard( char const * dirname, int first_run, int last_run )
+{
+	TString filename_summary = DataPath( dirname, "Run_Summary.csv" );
+	TString filename_cross = DataPath( dirname, "Cross_Sections.csv" );
+	TString filename_params = DataPath( dirname, "Parameters.csv" );
+	TString filename_deps = DataPath( dirname, "Dependencies.csv" );
+
+	// A row uses the background run of another shard, so every run must
+	// be merged first
+	vector<string> pending;
+	FindShardFiles( dirname, "Run_Summary.csv", &pending );
+	if ( !pending.empty() )
+		ShardError( TString::Format(
+			"%s is not merged; run MergeShards after UpdateShard",
+			pending[0].c_str() ) );
+
+	Dependencies deps;
+	deps.Load( filename_deps );
+	Parameters params;
+	params.Load( filename_params );
+
+	RunSummary sum;
+	sum.Load( filename_summary );
+
+	NPCrossSection np_xsect;
+	CrossSection cross;
+	cross.Load( filename_cross );
+	ULong64_t cross_hash = TableHash( cross );
+	if ( LoadNPCrossSection( dirname, &np_xsect ) )
+		cross.SetNPCrossSection( &np_xsect );
+	cross.SetParameters( params );
+	cross.SetDependencies( &deps );
+
+	vector<int> rows;
+	cross.FindRuns( first_run, last_run, &rows );
+	cross.LoadSummary( &sum, rows );
+	cross.Calculate( rows );
+
+	SavePartial( cross, cross_hash, rows, ShardFileName( filename_cross, first_run, last_run ) );
+	SaveChangedRows( deps, ShardFileName( filename_deps, first_run, last_run ) );
+
+	LogMessage( LOG_INFO, TString::Format(
+				"Calculated %d rows with foreground runs from %d to %d",
+				(int) rows.size(), first_run, last_run ) );
+}
+
+void MergeShards( char const * dirname )
+{
+	TString filename_summary = DataPath( dirname, "Run_Summary.csv" );
+	TString filename_cross = DataPath( dirname, "Cross_Sections.csv" );
+	TString filename_cache = DataPath( dirname, "Fit_Cache.csv" );
+	TString filename_deps = DataPath( dirname, "Dependencies.csv" );
+
+	vector<string> summary_files, cross_files, cache_files, deps_files;
+	FindShardFiles( dirname, "Run_Summary.csv", &summary_files );
+	FindShardFiles( dirname, "Cross_Sections.csv", &cross_files );
+	FindShardFiles( dirname, "Fit_Cache.csv", &cache_files );
+	FindShardFiles( dirname, "Dependencies.csv", &deps_files );
+
+	// Every partial is checked before anything is saved
+	RunSummary sum;
+	CrossSection cross;
+	vector<bool> merged;
+	vector<int> rows;
+	if ( !summary_files.empty() )
+	{
+		sum.Load( filename_summary );
+		MergePartials( &sum, summary_files, &merged );
+		sum.FindRuns( INT_MIN, INT_MAX, &rows );
+		WarnUnmerged( merged, rows, filename_summary, "runs" );
+	}
+	if ( !cross_files.empty() )
+	{
+		cross.Load( filename_cross );
+		MergePartials( &cross, cross_files, &merged );
+		rows.clear();
+		for ( int i = 3; i < cross.NumRows(); ++i )
+			rows.push_back( i );
+		WarnUnmerged( merged, rows, filename_cross, "rows" );
+	}
+
+	FitCache cache;
+	cache.Load( filename_cache );
+	for ( int i = 0; i < cache_files.size(); ++i )
+	{
+		CSVFile partial;
+		partial.Load( cache_files[i].c_str() );
+		cache.Merge( partial );
+	}
+	Dependencies deps;
+	deps.Load( filename_deps );
+	for ( int i = 0; i < deps_files.size(); ++i )
+	{
+		CSVFile partial;
+		partial.Load( deps_files[i].c_str() );
+		deps.Merge( partial );
+	}
+
+	// The record is saved last, so results are only trusted once saved
+	if ( !summary_files.empty() )
+	{
+		sum.SetWriteBinary( true );
+		sum.Save( filename_summary );
+	}
+	if ( !cross_files.empty() )
+		cross.Save( filename_cross );
+	if ( !cache_files.empty() )
+		cache.Save( filename_cache );
+	if ( !deps_files.empty() )
+		deps.Save( filename_deps );
+
+	vector<string> const * all[] = { &summary_files, &cross_files, &cache_files,
+		&deps_files };
+	for ( int i = 0; i < 4; ++i )
+		for ( int j = 0; j < all[i]->size(); ++j )
+			gSystem->Unlink( (*all[i])[j].c_str() );
+
+	LogMessage( LOG_INFO, TString::Format(
+				"Merged %d run summary and %d cross section shards",
+				(int) summary_files.size(), (int) cross_files.size() ) );
+}
+
+} // namespace pipeline
+} // namespace n2n
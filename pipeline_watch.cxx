@@ -0,0 +1,260 @@
+/**
+ * @file n2n/pipeline_watch.cxx
+ * Copyright (C) 2013 Houghton College
+ */
+
+#include "pipeline.hxx"
+#include "RunSummary.hxx"
+#include "CrossSection.hxx"
+#include "FitCache.hxx"
+#include "Log.hxx"
+
+#include <chrono>
+#include <cstring>
+#include <set>
+
+namespace n2n {
+namespace pipeline {
+
+/**
+ * The last seen state of a watched file.
+ */
+struct WatchedFile
+{
+	int run_number;		///< Run the file belongs to, or -1
+	Long64_t size;		///< Size of the file (bytes)
+	Long_t mtime;		///< Modification time of the file
+	double changed;		///< Time the size or mtime last changed (ms)
+	bool pending;		///< Changed since its run was last updated
+};
+
+/**
+ * Get the current time (ms), for measuring intervals.
+ */
+double WatchClock()
+{
+	return chrono::duration<double, milli>(
+			chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+/**
+ * Get the run number of a raw data file from its name.
+ * @return The run number, or -1 if the file is not raw data.
+ */
+int WatchRunNumber( char const * name )
+{
+	int run_number;
+	char suffix[32];
+	if ( sscanf( name, "Run%d%31s", &run_number, suffix ) != 2 )
+		return -1;
+
+	char const * suffixes[] = { "_puck.csv", "_plastic.csv", "_1x2.csv", ".mpa" };
+	for ( int i = 0; i < 4; ++i )
+		if ( strcmp( suffix, suffixes[i] ) == 0 )
+			return run_number;
+	return -1;
+}
+
+/**
+ * Check a file for changes.
+ * @param filename The file to check.
+ * @param now The current time (ms).
+ * @param file The last seen state of the file, updated if it changed.
+ * @return True if the file changed.
+ */
+bool WatchCheckFile( char const * filename, double now, WatchedFile * file )
+{
+	FileStat_t stat;
+	if ( gSystem->GetPathInfo( filename, stat ) != 0 )
+		return false;
+	if ( stat.fSize == file->size && stat.fMtime == file->mtime )
+		return false;
+
+	file->size = stat.fSize;
+	file->mtime = stat.fMtime;
+	file->changed = now;
+	return true;
+}
+
+/**
+ * Check every raw data file in a directory for changes.
+ * @param dirname The directory to check.
+ * @param now The current time (ms).
+ * @param files The last seen state of each file, by full path.
+ * @param initial True if files found now are already up to date.
+ */
+void WatchDirectory( char const * dirname, double now,
+		map<string, WatchedFile> * files, bool initial )
+{
+	void * dir = gSystem->OpenDirectory( dirname );
+	if ( !dir )
+		return;
+
+	char const * name;
+	while ( (name = gSystem->GetDirEntry( dir )) != NULL )
+	{
+		int run_number = WatchRunNumber( name );
+		if ( run_number < 0 )
+			continue;
+
+		TString filename = DataPath( dirname, name );
+		map<string, WatchedFile>::iterator i = files->find( filename.Data() );
+		if ( i == files->end() )
+		{
+			WatchedFile file = { run_number, -1, 0, now, false };
+			i = files->insert( make_pair( string( filename.Data() ), file ) ).first;
+		}
+		if ( WatchCheckFile( filename, now, &i->second ) && !initial )
+			i->second.pending = true;
+	}
+	gSystem->FreeDirectory( dir );
+}
+
+/**
+ * Save a file, and remember its new state so that the save is not taken
+ * for an edit by hand. Unchanged files are not written. A changed file is
+ * replaced in one step with RenameReplacing, which also works on Windows
+ * where the file already exists, so readers see the old or new contents.
+ */
+void WatchSave( CSVFile & file, char const * filename, WatchedFile * state )
+{
+	file.Save( filename );
+	WatchCheckFile( filename, WatchClock(), state );
+}
+
+/**
+ * Update one run and the cross sections which use it.
+ * @return The number of cross sections updated.
+ */
+int WatchUpdateRun( int run_number, char const * dirname,
+		RunSummary * sum, CrossSection * cross )
+{
+	sum->UpdateRun( run_number, dirname );
+
+	vector<int> rows;
+	cross->FindRun( run_number, &rows );
+	cross->LoadSummary( sum, rows );
+	cross->Calculate( rows );
+	return rows.size();
+}
+
+void Watch( char const * dirname, int poll_interval, int settle_time,
+		int num_polls )
+{
+	TString filename_summary = DataPath( dirname, "Run_Summary.csv" );
+	TString filename_cross = DataPath( dirname, "Cross_Sections.csv" );
+	TString filename_cache = DataPath( dirname, "Fit_Cache.csv" );
+	TString filename_params = DataPath( dirname, "Parameters.csv" );
+	TString dirname_decay = DataPath( dirname, "Decay Curves" );
+	TString dirname_proton = DataPath( dirname, "Proton Telescope" );
+
+	FitCache cache;
+	cache.Load( filename_cache );
+
+	Parameters params;
+	params.Load( filename_params );
+
+	NPCrossSection np_xsect;
+	RunSummary sum;
+	CrossSection cross;
+	if ( LoadNPCrossSection( dirname, &np_xsect ) )
+		cross.SetNPCrossSection( &np_xsect );
+	sum.SetFitCache( &cache );
+	sum.SetParameters( params );
+	cross.SetParameters( params );
+
+	double now = WatchClock();
+	WatchedFile summary_state = { -1, -1, 0, now, true };
+	WatchedFile cross_state = { -1, -1, 0, now, true };
+	WatchedFile cache_state = { -1, -1, 0, now, false };
+
+	map<string, WatchedFile> files;
+	WatchDirectory( dirname_decay, now, &files, true );
+	WatchDirectory( dirname_proton, now, &files, true );
+	LogMessage( LOG_INFO, TString::Format( "Watching %d data files in %s",
+				(int) files.size(), dirname ) );
+
+	set<int> waiting;	// Runs without a row in the summary
+	for ( int poll = 0; num_polls == 0 || poll < num_polls; ++poll )
+	{
+		if ( gSystem->ProcessEvents() )
+			break;
+		gSystem->Sleep( poll_interval );
+		now = WatchClock();
+
+		// Reload tables which were edited by hand
+		bool reload_summary = WatchCheckFile( filename_summary, now, &summary_state );
+		bool reload_cross = WatchCheckFile( filename_cross, now, &cross_state );
+		if ( reload_summary || reload_cross )
+		{
+			sum.Load( filename_summary );
+			cross.Load( filename_cross );
+			LogMessage( LOG_INFO, "Reloaded Run_Summary.csv and Cross_Sections.csv" );
+		}
+
+		WatchDirectory( dirname_decay, now, &files, false );
+		WatchDirectory( dirname_proton, now, &files, false );
+
+		// A run is ready once every changed file has settled
+		map<int, double> ready;		// Run number, time of last change
+		set<int> busy;
+		map<string, WatchedFile>::iterator i;
+		for ( i = files.begin(); i != files.end(); ++i )
+		{
+			if ( !i->second.pending )
+				continue;
+			if ( now - i->second.changed < settle_time )
+				busy.insert( i->second.run_number );
+			else if ( ready[i->second.run_number] < i->second.changed )
+				ready[i->second.run_number] = i->second.changed;
+		}
+		if ( reload_summary )
+			for ( set<int>::iterator j = waiting.begin(); j != waiting.end(); ++j )
+				ready.insert( make_pair( *j, now ) );
+
+		bool updated = false;
+		for ( map<int, double>::iterator j = ready.begin(); j != ready.end(); ++j )
+		{
+			int run_number = j->first;
+			if ( busy.count( run_number ) )
+				continue;
+			for ( i = files.begin(); i != files.end(); ++i )
+				if ( i->second.run_number == run_number )
+					i->second.pending = false;
+
+			waiting.erase( run_number );
+			if ( !sum.HasRun( run_number ) )
+			{
+				LogMessage( LOG_WARNING, TString::Format(
+					"Run %d is not in Run_Summary.csv; waiting for it to be added",
+					run_number ) );
+				waiting.insert( run_number );
+				continue;
+			}
+
+			try
+			{
+				int num_rows = WatchUpdateRun( run_number, dirname, &sum, &cross );
+				LogMessage( LOG_INFO, TString::Format(
+					"Run %d: updated %d cross sections %.0f ms after its data was written",
+					run_number, num_rows, WatchClock() - j->second ) );
+				updated = true;
+			}
+			catch ( exception & e )
+			{
+				LogMessage( LOG_ERROR, TString::Format( "Run %d: %s",
+							run_number, e.what() ) );
+			}
+		}
+
+		if ( updated )
+		{
+			WatchSave( sum, filename_summary, &summary_state );
+			WatchSave( cross, filename_cross, &cross_state );
+			WatchSave( cache, filename_cache, &cache_state );
+		}
+	}
+}
+
+} // namespace pipeline
+} // namespace n2n
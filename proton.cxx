@@ -4,44 +4,162 @@
  */
 
 #include "proton.hxx"
+#include "DataFile.hxx"
+#include "Profile.hxx"
 
+#include <cstring>
 #include <stdexcept>
 
 namespace n2n {
 namespace proton {
 
-TH2I * ParseDataFile( char const * const filename )
+/**
+ * Check that a file is a .csv data file and find its [DATA] section.
+ * @return The offset of the first row of data.
+ */
+string::size_type FindData( DataFile const & file )
 {
-	ifstream is( filename );
+	if ( !file.StartsWith( "[DISPLAY]" ) )
+	{
+		cerr << "Not a valid CSV Data file: " << file.Filename() << endl;
+		throw runtime_error( "Invalid CSV file" );
+	}
 
-	string line;
-	getline( is, line );
-	if ( line.substr( 0, 9 ) != "[DISPLAY]" )
+	string::size_type offset = file.FindSection( "[DATA]" );
+	if ( offset == string::npos )
 	{
-		cerr << "Not a valid CSV Data file: " << filename << endl;
+		cerr << "No [DATA] section in CSV Data file: " << file.Filename() << endl;
 		throw runtime_error( "Invalid CSV file" );
 	}
+	return offset;
+}
+
+/**
+ * Find the bin of the 1024 bin axis used by @ref ParseDataFile containing
+ * a channel. Channels outside the axis fall in the underflow (0) and 
+ * overflow (1025) bins.
+ */
+Int_t ChannelBin( Int_t channel )
+{
+	if ( channel < 1 )
+		return 0;
+	if ( channel >= 1024 )
+		return 1025;
+	return channel;
+}
+
+/**
+ * The header of a binary spectrum file.
+ */
+struct SpectrumHeader
+{
+	char magic[8];		///< Identifies the file and format version
+	Int_t roi[4];		///< min_x, max_x, min_y and max_y of the ROI
+	UInt_t num_entries;	///< Number of SpectrumEntry following the header
+	UInt_t reserved;
+};
+
+char const SPECTRUM_MAGIC[8] = { 'N', '2', 'N', 'S', 'P', 'E', 'C', 1 };
+
+/**
+ * Calculate the region of interest given by the [MAP0] section of an .mpa
+ * file, whose channels are numbered y * xdim + x.
+ */
+Region MapRegion( int xdim, int roi_min, int roi_max )
+{
+	Region roi;
+	roi.min_x = roi_min - (roi_min / xdim) * xdim;
+	roi.min_y = (roi_min / xdim);
+	roi.max_x = roi_max - (roi_max / xdim) * xdim;
+	roi.max_y = (roi_max / xdim);
+	return roi;
+}
+
+/**
+ * Collect the bins with counts, ordered by y and then x.
+ * @param bins The counts in each of the 1026 x 1026 bins of the histogram,
+ * including underflow and overflow, ordered by y and then x.
+ * @param entries Set to the bins with counts.
+ */
+void CollectEntries( vector<UInt_t> const & bins, vector<SpectrumEntry> * entries )
+{
+	entries->clear();
+	for ( int i = 0; i < bins.size(); ++i )
+	{
+		if ( bins[i] == 0 )
+			continue;
+
+		SpectrumEntry e;
+		e.x = i % 1026;
+		e.y = i / 1026;
+		e.value = bins[i];
+		entries->push_back( e );
+	}
+}
 
-	while ( line != "[DATA]" )
+/**
+ * Read the bins with counts of a spectrum from an .mpa file, or from a 
+ * binary spectrum file which is to be used in place of a .csv data file.
+ * @return False if the .csv data file must be parsed instead.
+ */
+bool ReadEntries( char const * const filename, vector<SpectrumEntry> * entries )
+{
+	Region roi;
+	if ( TString( filename ).EndsWith( ".mpa" ) )
 	{
-		while ( getline( is, line ) && line[0] != '[' )
+		if ( !ParseMPAFile( filename, &roi, entries ) )
 		{
-			// Do nothing
+			cerr << "No spectrum in MPA file: " << filename << endl;
+			throw runtime_error( "Invalid file" );
+		}
+		return true;
+	}
+
+	TString spc_filename = SpectrumFileName( filename );
+	if ( !UseSpectrumFile( filename, HeaderFileName( filename ), spc_filename ) )
+		return false;
+	ReadSpectrumFile( spc_filename, &roi, entries );
+	return true;
+}
+
+TH2I * ParseDataFile( char const * const filename )
+{
+	ProfileTimer timer( "proton_parse" );
+	vector<SpectrumEntry> entries;
+	if ( ReadEntries( filename, &entries ) )
+	{
+		TH2I * hist = new TH2I( filename, filename, 1024, 1, 1024, 1024, 1, 1024 );
+		hist->SetDirectory( NULL );
+		for ( int i = 0; i < entries.size(); ++i )
+		{
+			Int_t bin = hist->GetBin( entries[i].x, entries[i].y );
+			hist->SetBinContent( bin, entries[i].value );
 		}
+		return hist;
 	}
 
+	DataFile file;
+	file.Load( filename );
+	string::size_type offset = FindData( file );
+
 	TH2I * hist = new TH2I( filename, filename, 1024, 1, 1024, 1024, 1, 1024 );
-	Int_t a2, a1, value;
-	while ( is >> a2 >> a1 >> value )
+	hist->SetDirectory( NULL );	// Owned by the caller, not gDirectory
+	Int_t entry[3];		// a2, a1, value
+	int num_rows = 0;
+	while ( file.NextRow( &offset, 3, entry ) )
 	{
-		hist->Fill( a2, a1, value );
+		hist->Fill( entry[0], entry[1], entry[2] );
+		++num_rows;
 	}
 
+	ProfileCount( "proton_parse", "bytes", file.Size() );
+	ProfileCount( "proton_parse", "lines", num_rows );
 	return hist;
 }
 
 Region ParseHeaderFile( char const * const filename )
 {
+	ProfileTimer timer( "proton_header" );
 	std::ifstream ifs( filename );
 	std::string line;
 	
@@ -71,7 +189,7 @@ Region ParseHeaderFile( char const * const filename )
 		{
 			std::cerr << "Expected 'param=1'" << std::endl;
 			std::clog << line << std::endl;
-			return false;
+			throw std::runtime_error( "Invalid MAP0 section" );
 		}
 
 		// Locate X dimension
@@ -88,17 +206,93 @@ Region ParseHeaderFile( char const * const filename )
 	std::sscanf( str_xdim.c_str(), "xdim=%d", &xdim );
 	std::sscanf( str_roi.c_str(), "roi=%d %d", &roi_min, &roi_max );
 
-	// Calculate region boundaries
-	Region roi;
-	roi.min_x = roi_min - (roi_min / xdim) * xdim;
-	roi.min_y = (roi_min / xdim);
-	roi.max_x = roi_max - (roi_max / xdim) * xdim;
-	roi.max_y = (roi_max / xdim);
-	return roi;
+	return MapRegion( xdim, roi_min, roi_max );
+}
+
+bool ParseMPAFile( char const * const filename, Region * roi,
+		   vector<SpectrumEntry> * entries )
+{
+	DataFile file;
+	{
+		ProfileTimer timer( "proton_read" );
+		file.Load( filename );
+	}
+	return ParseMPAFile( file, roi, entries );
+}
+
+bool ParseMPAFile( DataFile const & file, Region * roi,
+		   vector<SpectrumEntry> * entries )
+{
+	ProfileTimer timer( "proton_mpa" );
+	char const * filename = file.Filename();
+	if ( !file.StartsWith( "[MPA4A]" ) )
+	{
+		cerr << "Not a valid MPA file: " << filename << endl;
+		throw runtime_error( "Invalid file" );
+	}
+
+	// Read the header, up to the spectrum of [MAP0]
+	string::size_type offset = 0;
+	string section, line;
+	int xdim = 0, roi_min = 0, roi_max = 0, num_channels = -1;
+	while ( num_channels < 0 && file.NextLine( &offset, &line ) )
+	{
+		if ( !line.empty() && line[0] == '[' )
+		{
+			section = line;
+			sscanf( line.c_str(), "[CDAT0,%d", &num_channels );
+		}
+		else if ( section == "[MAP0]" )
+		{
+			// Ensure [MAP0] is actually a_2 x a_1
+			if ( line.compare( 0, 6, "param=" ) == 0 && line != "param=1" )
+			{
+				cerr << "Expected 'param=1' in MPA file: " << filename << endl;
+				throw runtime_error( "Invalid MAP0 section" );
+			}
+			sscanf( line.c_str(), "xdim=%d", &xdim );
+			sscanf( line.c_str(), "roi=%d %d", &roi_min, &roi_max );
+		}
+	}
+	if ( xdim <= 0 )
+	{
+		cerr << "No xdim in [MAP0] section of MPA file: " << filename << endl;
+		throw runtime_error( "Invalid MAP0 section" );
+	}
+	*roi = MapRegion( xdim, roi_min, roi_max );
+	if ( num_channels < 0 )
+		return false;
+
+	// Bin exactly as the histogram, including underflow and overflow
+	vector<UInt_t> bins( 1026 * 1026, 0 );
+	Int_t value;
+	int channel = 0;
+	while ( file.NextRow( &offset, 1, &value ) )
+	{
+		if ( value != 0 && channel < num_channels )
+			bins[ChannelBin( channel / xdim ) * 1026 + ChannelBin( channel % xdim )] += value;
+		++channel;
+	}
+	if ( channel != num_channels )
+	{
+		cerr << "Expected " << num_channels << " channels but found " << channel
+			<< " in [CDAT0] section of MPA file: " << filename << endl;
+		throw runtime_error( "Invalid CDAT0 section" );
+	}
+
+	CollectEntries( bins, entries );
+	ProfileCount( "proton_mpa", "bytes", file.Size() );
+	ProfileCount( "proton_mpa", "lines", num_channels );
+	return true;
 }
 
 Int_t CountsInRegion( TH2I const * const data, Region const & roi )
 {
+	ProfileTimer timer( "proton_roi" );
+	if ( roi.max_x >= roi.min_x && roi.max_y >= roi.min_y )
+		ProfileCount( "proton_roi", "bins", 
+				(roi.max_x - roi.min_x + 1.0) * (roi.max_y - roi.min_y + 1.0) );
+
 	Int_t sum = 0;
 	for ( Int_t x = roi.min_x; x <= roi.max_x; ++x )
 	{
@@ -111,5 +305,205 @@ Int_t CountsInRegion( TH2I const * const data, Region const & roi )
 	return sum;
 }
 
+Int_t CountEntries( vector<SpectrumEntry> const & entries, Region const & roi,
+		   vector<Int_t> * x_proj, vector<Int_t> * y_proj )
+{
+	if ( x_proj )
+		x_proj->assign( roi.max_x >= roi.min_x ? roi.max_x - roi.min_x + 1 : 0, 0 );
+	if ( y_proj )
+		y_proj->assign( roi.max_y >= roi.min_y ? roi.max_y - roi.min_y + 1 : 0, 0 );
+	ProfileCount( "proton_count", "spectrum_entries", entries.size() );
+
+	Int_t sum = 0;
+	for ( int i = 0; i < entries.size(); ++i )
+	{
+		Int_t x = entries[i].x;
+		Int_t y = entries[i].y;
+		if ( x < roi.min_x || x > roi.max_x || y < roi.min_y || y > roi.max_y )
+			continue;
+
+		sum += entries[i].value;
+		if ( x_proj )
+			(*x_proj)[x - roi.min_x] += entries[i].value;
+		if ( y_proj )
+			(*y_proj)[y - roi.min_y] += entries[i].value;
+	}
+	return sum;
+}
+
+Int_t CountDataFile( char const * const filename, Region const & roi,
+		     vector<Int_t> * x_proj, vector<Int_t> * y_proj )
+{
+	vector<SpectrumEntry> entries;
+	if ( ReadEntries( filename, &entries ) )
+	{
+		ProfileTimer timer( "proton_count" );
+		return CountEntries( entries, roi, x_proj, y_proj );
+	}
+
+	DataFile file;
+	{
+		ProfileTimer timer( "proton_read" );
+		file.Load( filename );
+	}
+	return CountDataFile( file, roi, x_proj, y_proj );
+}
+
+Int_t CountDataFile( DataFile const & file, Region const & roi,
+		     vector<Int_t> * x_proj, vector<Int_t> * y_proj )
+{
+	ProfileTimer timer( "proton_count" );
+	if ( x_proj )
+		x_proj->assign( roi.max_x >= roi.min_x ? roi.max_x - roi.min_x + 1 : 0, 0 );
+	if ( y_proj )
+		y_proj->assign( roi.max_y >= roi.min_y ? roi.max_y - roi.min_y + 1 : 0, 0 );
+
+	string::size_type offset = FindData( file );
+	Int_t sum = 0;
+	Int_t entry[3];		// a2, a1, value
+	int num_rows = 0;
+	while ( file.NextRow( &offset, 3, entry ) )
+	{
+		++num_rows;
+		Int_t x = ChannelBin( entry[0] );
+		Int_t y = ChannelBin( entry[1] );
+		Int_t value = entry[2];
+		if ( x < roi.min_x || x > roi.max_x || y < roi.min_y || y > roi.max_y )
+			continue;
+
+		sum += value;
+		if ( x_proj )
+			(*x_proj)[x - roi.min_x] += value;
+		if ( y_proj )
+			(*y_proj)[y - roi.min_y] += value;
+	}
+
+	ProfileCount( "proton_count", "bytes", file.Size() );
+	ProfileCount( "proton_count", "lines", num_rows );
+	return sum;
+}
+
+TString SpectrumFileName( char const * const filename )
+{
+	TString spc_filename = filename;
+	if ( spc_filename.EndsWith( ".csv" ) )
+		spc_filename.Remove( spc_filename.Length() - 4 );
+	spc_filename += ".spc";
+	return spc_filename;
+}
+
+TString HeaderFileName( char const * const filename )
+{
+	TString mpa_filename = filename;
+	if ( mpa_filename.EndsWith( "_1x2.csv" ) )
+		mpa_filename.Remove( mpa_filename.Length() - 8 );
+	else if ( mpa_filename.EndsWith( ".csv" ) )
+		mpa_filename.Remove( mpa_filename.Length() - 4 );
+	mpa_filename += ".mpa";
+	return mpa_filename;
+}
+
+void WriteSpectrumFile( char const * const csv_filename, 
+			char const * const mpa_filename,
+			char const * const spc_filename )
+{
+	Region roi = ParseHeaderFile( mpa_filename );
+
+	DataFile file;
+	file.Load( csv_filename );
+	string::size_type offset = FindData( file );
+
+	// Bin exactly as the histogram, including underflow and overflow
+	vector<UInt_t> bins( 1026 * 1026, 0 );
+	Int_t entry[3];		// a2, a1, value
+	while ( file.NextRow( &offset, 3, entry ) )
+	{
+		bins[ChannelBin( entry[1] ) * 1026 + ChannelBin( entry[0] )] += entry[2];
+	}
+
+	vector<SpectrumEntry> entries;
+	CollectEntries( bins, &entries );
+
+	SpectrumHeader header;
+	memcpy( header.magic, SPECTRUM_MAGIC, sizeof( header.magic ) );
+	header.roi[0] = roi.min_x;
+	header.roi[1] = roi.max_x;
+	header.roi[2] = roi.min_y;
+	header.roi[3] = roi.max_y;
+	header.num_entries = entries.size();
+	header.reserved = 0;
+
+	ofstream os( spc_filename, ios::out | ios::binary );
+	os.write( (char const *) &header, sizeof( header ) );
+	if ( !entries.empty() )
+		os.write( (char const *) &entries[0], entries.size() * sizeof( SpectrumEntry ) );
+	if ( !os )
+	{
+		cerr << "Could not write spectrum file: " << spc_filename << endl;
+		throw runtime_error( "Could not write spectrum file" );
+	}
+}
+
+/**
+ * Read and check the header of a binary spectrum file.
+ */
+Region ReadSpectrumHeader( istream & is, char const * const filename, 
+			   SpectrumHeader * header )
+{
+	is.read( (char *) header, sizeof( *header ) );
+	if ( !is || memcmp( header->magic, SPECTRUM_MAGIC, sizeof( header->magic ) ) != 0 )
+	{
+		cerr << "Not a valid spectrum file: " << filename << endl;
+		throw runtime_error( "Invalid spectrum file" );
+	}
+
+	Region roi;
+	roi.min_x = header->roi[0];
+	roi.max_x = header->roi[1];
+	roi.min_y = header->roi[2];
+	roi.max_y = header->roi[3];
+	return roi;
+}
+
+Region ParseSpectrumHeader( char const * const filename )
+{
+	ifstream is( filename, ios::in | ios::binary );
+	SpectrumHeader header;
+	return ReadSpectrumHeader( is, filename, &header );
+}
+
+void ReadSpectrumFile( char const * const filename, Region * roi,
+		       vector<SpectrumEntry> * entries )
+{
+	ifstream is( filename, ios::in | ios::binary );
+	SpectrumHeader header;
+	*roi = ReadSpectrumHeader( is, filename, &header );
+
+	entries->resize( header.num_entries );
+	if ( header.num_entries > 0 )
+		is.read( (char *) &(*entries)[0], header.num_entries * sizeof( SpectrumEntry ) );
+	if ( !is )
+	{
+		cerr << "Truncated spectrum file: " << filename << endl;
+		throw runtime_error( "Invalid spectrum file" );
+	}
+}
+
+bool UseSpectrumFile( char const * const csv_filename, 
+		      char const * const mpa_filename,
+		      char const * const spc_filename )
+{
+	FileStat_t spc_stat, csv_stat, mpa_stat;
+	if ( gSystem->GetPathInfo( spc_filename, spc_stat ) != 0 )
+		return false;
+	if ( gSystem->GetPathInfo( csv_filename, csv_stat ) == 0 &&
+			spc_stat.fMtime < csv_stat.fMtime )
+		return false;
+	if ( gSystem->GetPathInfo( mpa_filename, mpa_stat ) == 0 &&
+			spc_stat.fMtime < mpa_stat.fMtime )
+		return false;
+	return true;
+}
+
 } // namespace proton
 } // namespace n2n
@@ -8,11 +8,29 @@
 
 #include "Region.hxx"
 
+#include <vector>
+
 namespace n2n {
+
+struct DataFile;
+
 namespace proton {
 
+/**
+ * The counts in one bin of a spectrum stored in a binary spectrum file.
+ */
+struct SpectrumEntry
+{
+	UShort_t x;	///< Bin along a_2, as in the histogram of @ref ParseDataFile
+	UShort_t y;	///< Bin along a_1, as in the histogram of @ref ParseDataFile
+	UInt_t value;	///< Counts in the bin
+};
+
 /**
  * Parse the .csv data file produced by MPA4 for the proton telescope.
+ * If an up-to-date binary spectrum file exists for the data file, it is
+ * read instead. An .mpa file may be given in place of the .csv data file,
+ * in which case its spectrum is read as by @ref ParseMPAFile.
  *
  * @param filename The path to the file.
  *
@@ -29,6 +47,38 @@ TH2I * ParseDataFile( char const * const filename );
  */
 Region ParseHeaderFile( char const * const filename );
 
+/**
+ * Parse the .mpa file produced by MPA4 for the proton telescope, reading
+ * both the region of interest and the a_2 x a_1 spectrum in a single pass,
+ * so that the .csv data file need not be exported.
+ *
+ * The spectrum is the [CDAT0,n] section following the header, holding 
+ * the counts of each of the n channels of [MAP0] in turn, where channel
+ * y * xdim + x holds the counts at a_2 = x and a_1 = y. Entries are
+ * binned exactly as by @ref ParseDataFile.
+ *
+ * @param filename The path to the file.
+ * @param roi Set to the region of interest for the run.
+ * @param entries Set to the bins with counts, ordered by y and then x.
+ *
+ * @return False if the file holds no spectrum, e.g. if MPA4 saved the 
+ * spectrum to a separate file; entries is then unchanged.
+ */
+bool ParseMPAFile( char const * const filename, Region * roi,
+		   vector<SpectrumEntry> * entries );
+
+/**
+ * Parse an .mpa file which has already been read into memory, as above.
+ *
+ * @param file The contents of the file.
+ * @param roi Set to the region of interest for the run.
+ * @param entries Set to the bins with counts, ordered by y and then x.
+ *
+ * @return False if the file holds no spectrum.
+ */
+bool ParseMPAFile( DataFile const & file, Region * roi,
+		   vector<SpectrumEntry> * entries );
+
 /**
  * Determine the total number of counts in the region of interest.
  *
@@ -39,6 +89,121 @@ Region ParseHeaderFile( char const * const filename );
  */
 Int_t CountsInRegion( TH2I const * const data, Region const & roi );
 
+/**
+ * Determine the total number of counts in the region of interest directly
+ * from the .csv data file produced by MPA4, without building a histogram.
+ * Entries are binned exactly as by @ref ParseDataFile, and a binary 
+ * spectrum file or an .mpa file is used in the same way.
+ *
+ * @param filename The path to the file.
+ * @param roi The region of interest.
+ * @param x_proj If not NULL, filled with the counts in each column of the
+ * region, from roi.min_x to roi.max_x.
+ * @param y_proj If not NULL, filled with the counts in each row of the
+ * region, from roi.min_y to roi.max_y.
+ *
+ * @return The number of counts in the region.
+ */
+Int_t CountDataFile( char const * const filename, Region const & roi,
+		     vector<Int_t> * x_proj = NULL, vector<Int_t> * y_proj = NULL );
+
+/**
+ * Determine the total number of counts in the region of interest of a .csv
+ * data file which has already been read into memory. Unlike the above, a
+ * binary spectrum file is never used in its place.
+ *
+ * @param file The contents of the .csv data file.
+ * @param roi The region of interest.
+ * @param x_proj If not NULL, filled with the counts in each column of the
+ * region.
+ * @param y_proj If not NULL, filled with the counts in each row of the
+ * region.
+ *
+ * @return The number of counts in the region.
+ */
+Int_t CountDataFile( DataFile const & file, Region const & roi,
+		     vector<Int_t> * x_proj = NULL, vector<Int_t> * y_proj = NULL );
+
+/**
+ * Determine the total number of counts in the region of interest of a
+ * spectrum read by @ref ParseMPAFile or @ref ReadSpectrumFile.
+ *
+ * @param entries The bins with counts.
+ * @param roi The region of interest.
+ * @param x_proj If not NULL, filled with the counts in each column of the
+ * region.
+ * @param y_proj If not NULL, filled with the counts in each row of the
+ * region.
+ *
+ * @return The number of counts in the region.
+ */
+Int_t CountEntries( vector<SpectrumEntry> const & entries, Region const & roi,
+		    vector<Int_t> * x_proj = NULL, vector<Int_t> * y_proj = NULL );
+
+/**
+ * Get the name of the binary spectrum file for a .csv data file, which
+ * replaces the .csv extension by .spc.
+ *
+ * @param filename The path to the .csv data file.
+ *
+ * @return The path to the binary spectrum file.
+ */
+TString SpectrumFileName( char const * const filename );
+
+/**
+ * Get the name of the .mpa file of a .csv data file, which replaces the
+ * _1x2.csv ending by .mpa.
+ *
+ * @param filename The path to the .csv data file.
+ *
+ * @return The path to the .mpa file.
+ */
+TString HeaderFileName( char const * const filename );
+
+/**
+ * Convert a .csv data file and the region of interest from its .mpa file
+ * into a binary spectrum file. Only bins with counts are stored.
+ *
+ * @param csv_filename The path to the .csv data file.
+ * @param mpa_filename The path to the .mpa file.
+ * @param spc_filename The path to the binary spectrum file to write.
+ */
+void WriteSpectrumFile( char const * const csv_filename, 
+			char const * const mpa_filename,
+			char const * const spc_filename );
+
+/**
+ * Read a binary spectrum file.
+ *
+ * @param filename The path to the file.
+ * @param roi Set to the region of interest of the run.
+ * @param entries Set to the bins with counts, ordered by y and then x.
+ */
+void ReadSpectrumFile( char const * const filename, Region * roi,
+		       vector<SpectrumEntry> * entries );
+
+/**
+ * Read the region of interest stored in a binary spectrum file.
+ *
+ * @param filename The path to the file.
+ *
+ * @return The region of interest for the run.
+ */
+Region ParseSpectrumHeader( char const * const filename );
+
+/**
+ * Check whether a binary spectrum file should be read in place of a .csv
+ * data file: it must exist and be no older than the .csv file or the .mpa
+ * file it was converted from, if either exists.
+ *
+ * @param csv_filename The path to the .csv data file.
+ * @param mpa_filename The path to the .mpa file.
+ * @param spc_filename The path to the binary spectrum file.
+ */
+bool UseSpectrumFile( char const * const csv_filename, 
+		      char const * const mpa_filename,
+		      char const * const spc_filename );
+
 } // namespace proton
 } // namespace n2n
 
@@ -0,0 +1,258 @@
+/**
+ * @file n2n/synthetic.cxx
+ * Copyright (C) 2013 Houghton College
+ */
+
+#include "synthetic.hxx"
+#include "pipeline.hxx"
+#include "CrossSection.hxx"
+#include "RunSummary.hxx"
+#include "NPCrossSection.hxx"
+#include "calculate.hxx"
+#include "decay.hxx"
+
+#include <TRandom3.h>
+
+namespace n2n {
+namespace synthetic {
+
+/**
+ * Region of interest of every synthetic proton spectrum.
+ */
+Region const ROI = { 200, 700, 150, 600 };
+
+/**
+ * Rates of protons in the region of interest (protons/s).
+ */
+double const FG_PROTON_RATE = 5.0;
+double const BG_PROTON_RATE = 1.0;
+
+/**
+ * Background of every decay curve (counts/min).
+ */
+double const DECAY_BACKGROUND = 20;
+
+/**
+ * Length of every decay curve (min), counted in 1 min bins.
+ */
+int const DECAY_LENGTH = 60;
+
+double TrueCrossSection( double energy )
+{
+	// Rises linearly from the 12C(n,2n) threshold near 20 MeV
+	return 2 + 3 * (energy - 20);
+}
+
+/**
+ * Write a proton spectrum and the .mpa header which describes its region
+ * of interest.
+ * @return The number of protons in the region of interest.
+ */
+Int_t WriteProtonFiles( char const * filename_csv, char const * filename_mpa,
+		double num_protons, TRandom3 * rng )
+{
+	// Counts in each channel, indexed by y * 1024 + x
+	map<Int_t, Int_t> bins;
+	double center_x = (ROI.min_x + ROI.max_x) / 2.0;
+	double center_y = (ROI.min_y + ROI.max_y) / 2.0;
+	double width_x = (ROI.max_x - ROI.min_x) / 6.0;
+	double width_y = (ROI.max_y - ROI.min_y) / 6.0;
+	int num_signal = rng->Poisson( num_protons );
+	for ( int i = 0; i < num_signal; ++i )
+	{
+		Int_t x = (Int_t) rng->Gaus( center_x, width_x );
+		Int_t y = (Int_t) rng->Gaus( center_y, width_y );
+		if ( x >= 1 && x <= 1023 && y >= 1 && y <= 1023 )
+			++bins[y * 1024 + x];
+	}
+
+	// Noise spread over the whole detector
+	int num_noise = rng->Poisson( 0.2 * num_protons );
+	for ( int i = 0; i < num_noise; ++i )
+	{
+		Int_t x = 1 + (Int_t) rng->Uniform( 1023 );
+		Int_t y = 1 + (Int_t) rng->Uniform( 1023 );
+		++bins[y * 1024 + x];
+	}
+
+	std::ofstream csv( filename_csv );
+	csv << "[DISPLAY]\n[DATA]\n";
+	Int_t protons = 0;
+	for ( map<Int_t, Int_t>::iterator i = bins.begin(); i != bins.end(); ++i )
+	{
+		Int_t x = i->first % 1024;
+		Int_t y = i->first / 1024;
+		csv << x << ' ' << y << ' ' << i->second << '\n';
+		if ( x >= ROI.min_x && x <= ROI.max_x && y >= ROI.min_y && y <= ROI.max_y )
+			protons += i->second;
+	}
+
+	std::ofstream mpa( filename_mpa );
+	mpa << "[MPA4A]\n[MAP0]\nparam=1\nxdim=1024\n"
+		<< "roi=" << ROI.min_y * 1024 + ROI.min_x << ' '
+		<< ROI.max_y * 1024 + ROI.max_x << '\n';
+	return protons;
+}
+
+/**
+ * Write a decay curve, @f$N_0 e^{-\lambda t}+A@f$, with Poisson counts in
+ * 1 min bins.
+ */
+void WriteDecayFile( char const * filename, double n0, double a, TRandom3 * rng )
+{
+	double lambda = TMath::Log( 2 ) / decay::HALF_LIFE;	// (1/min)
+	std::ofstream ofs( filename );
+	ofs << "[DISPLAY]\n[DATA]\n";
+	for ( int i = 0; i < DECAY_LENGTH; ++i )
+	{
+		double t = i + 0.5;
+		ofs << t << '\t' << rng->Poisson( n0 * TMath::Exp( -lambda * t ) + a ) << '\n';
+	}
+}
+
+/**
+ * Get the live fraction of a run exactly as RunSummary::Update writes it.
+ */
+double LiveFraction( vector<string> const & run )
+{
+	float e_dead = atof( run[RS_E_DEAD].c_str() );
+	float de_dead = atof( run[RS_DE_DEAD].c_str() );
+	float live = 1 - sqrt( e_dead * e_dead + de_dead * de_dead );
+	return atof( TString::Format( "%f", live ) );
+}
+
+void Generate( char const * dirname, int num_runs, UInt_t seed )
+{
+	TString dirname_decay = pipeline::DataPath( dirname, "Decay Curves" );
+	TString dirname_proton = pipeline::DataPath( dirname,
+			"Proton Telescope" );
+	gSystem->mkdir( dirname_decay, kTRUE );
+	gSystem->mkdir( dirname_proton, kTRUE );
+
+	TRandom3 rng( seed );
+
+	// The geometry is the same for every row
+	Parameters params;
+	vector<string> geometry( CS_NUM_COLUMNS );
+	loadsum::UpdateGeometry( geometry, params );
+	double det_sang = calculate::CalcSolidAngle(
+		atof( geometry[CS_DET_AREA].c_str() ), atof( geometry[CS_DET_DISTANCE].c_str() ) );
+	double ch2_sang = calculate::CalcSolidAngle(
+		atof( geometry[CS_CH2_AREA].c_str() ), atof( geometry[CS_CH2_DISTANCE].c_str() ) );
+	double c12_sang = calculate::CalcSolidAngle(
+		atof( geometry[CS_C12_AREA].c_str() ), atof( geometry[CS_C12_DISTANCE].c_str() ) );
+	double ch2_thickness = atof( geometry[CS_CH2_THICKNESS].c_str() );
+	double c12_thickness = atof( geometry[CS_C12_THICKNESS].c_str() );
+
+	CSVFile summary, cross, truth;
+	summary.AddRow( vector<string>( 1, "Synthetic run summary" ) );
+	summary.AddRow( vector<string>( 1, "Run" ) );
+	cross.AddRow( vector<string>( 1, "Synthetic cross sections" ) );
+	cross.AddRow( vector<string>( 1, "FG Run" ) );
+	cross.AddRow( vector<string>( 1, "" ) );
+
+	char const * truth_header[] = { "Run", "BG Run", "Protons", "Puck N0",
+		"Puck A", "Plastic N0", "Plastic A", "CH2 Xsect", "C12 Xsect" };
+	truth.AddRow( vector<string>( truth_header, truth_header + ST_NUM_COLUMNS ) );
+
+	for ( int fg_run_number = 1; fg_run_number <= num_runs; fg_run_number += 2 )
+	{
+		int bg_run_number = fg_run_number + 1;
+		double energy = rng.Uniform( 20.5, 27.5 );
+
+		vector<string> runs[2];
+		vector<string> truths[2];
+		Int_t protons[2];
+		for ( int j = 0; j < 2; ++j )
+		{
+			int run_number = j == 0 ? fg_run_number : bg_run_number;
+			vector<string> & run = runs[j];
+			run.assign( RS_NUM_COLUMNS, "" );
+			run[RS_RUN_NUMBER] = TString::Format( "%d", run_number );
+			run[RS_NEUTRON_ENERGY] = TString::Format( "%.3f", energy );
+			run[RS_CLOCK_TIME] = TString::Format( "%.0f", rng.Uniform( 3000, 4000 ) );
+			run[RS_DE_DEAD] = TString::Format( "%.4f", rng.Uniform( 0.005, 0.03 ) );
+			run[RS_E_DEAD] = TString::Format( "%.4f", rng.Uniform( 0.005, 0.03 ) );
+			run[RS_INTERIM_TIME] = TString::Format( "%.0f", rng.Uniform( 120, 300 ) );
+
+			TString filename_csv = pipeline::DataPath( dirname_proton,
+					TString::Format( "Run%03d_1x2.csv", run_number ) );
+			TString filename_mpa = pipeline::DataPath( dirname_proton,
+					TString::Format( "Run%03d.mpa", run_number ) );
+			double rate = j == 0 ? FG_PROTON_RATE : BG_PROTON_RATE;
+			protons[j] = WriteProtonFiles( filename_csv, filename_mpa,
+				rate * atof( run[RS_CLOCK_TIME].c_str() ) * LiveFraction( run ),
+				&rng );
+
+			truths[j].assign( ST_NUM_COLUMNS, "" );
+			truths[j][ST_RUN_NUMBER] = run[RS_RUN_NUMBER];
+			truths[j][ST_PROTONS] = TString::Format( "%d", protons[j] );
+		}
+
+		// Work forward through the calculation to the C11 in each target
+		UncertainD fg_protons = { (double) protons[0], 0 };
+		UncertainD bg_protons = { (double) protons[1], 0 };
+		double fg_clock = atof( runs[0][RS_CLOCK_TIME].c_str() );
+		double bg_clock = atof( runs[1][RS_CLOCK_TIME].c_str() );
+		UncertainD proton_flux = calculate::ProtonFlux(
+			fg_protons, fg_clock, LiveFraction( runs[0] ),
+			bg_protons, bg_clock, LiveFraction( runs[1] ) );
+		double energy_row = atof( runs[0][RS_NEUTRON_ENERGY].c_str() );
+		UncertainD neutrons = calculate::CalcNeutronFlux( proton_flux,
+			NPCrossSection::Default().Eval( energy_row ),
+			calculate::CalcThicknessH_CH2( ch2_thickness, params.ch2_density ), ch2_sang, det_sang );
+
+		double xsect = TrueCrossSection( energy_row );
+		double decay_s = TMath::Log( 2 ) / (params.half_life * 60);	// (1/s)
+		double activation = (1 - TMath::Exp( -decay_s * fg_clock )) / decay_s;
+		double c12_c11 = xsect * 1e-3 * calculate::CalcThicknessC_C12( c12_thickness, params.c12_density ) *
+			neutrons.val * c12_sang * activation;
+		double ch2_c11 = xsect * 1e-3 * calculate::CalcThicknessC_CH2( ch2_thickness, params.ch2_density ) *
+			neutrons.val * ch2_sang * activation;
+
+		// Then back from the C11 to the decay curves, as decay::Counts
+		double lambda = TMath::Log( 2 ) / params.half_life;	// (1/min)
+		double trans_time = atoi( runs[0][RS_INTERIM_TIME].c_str() ) / 60.0;
+		double survive = lambda * TMath::Exp( -lambda * trans_time );
+		double puck_n0 = c12_c11 * survive * params.efficiency;
+		double plastic_n0 = ch2_c11 * survive * params.efficiency * params.ch2_factor;
+
+		TString filename_puck = pipeline::DataPath( dirname_decay,
+				TString::Format( "Run%03d_puck.csv", fg_run_number ) );
+		WriteDecayFile( filename_puck, puck_n0, DECAY_BACKGROUND, &rng );
+		TString filename_plastic = pipeline::DataPath( dirname_decay,
+				TString::Format( "Run%03d_plastic.csv", fg_run_number ) );
+		WriteDecayFile( filename_plastic, plastic_n0, DECAY_BACKGROUND, &rng );
+
+		truths[0][ST_BG_RUN_NUMBER] = runs[1][RS_RUN_NUMBER];
+		truths[0][ST_PUCK_N0] = TString::Format( "%.17g", puck_n0 );
+		truths[0][ST_PUCK_A] = TString::Format( "%.17g", DECAY_BACKGROUND );
+		truths[0][ST_PLASTIC_N0] = TString::Format( "%.17g", plastic_n0 );
+		truths[0][ST_PLASTIC_A] = TString::Format( "%.17g", DECAY_BACKGROUND );
+		truths[0][ST_CH2_XSECT] = TString::Format( "%.17g", xsect );
+		truths[0][ST_C12_XSECT] = TString::Format( "%.17g", xsect );
+
+		vector<string> row( CS_NUM_COLUMNS );
+		row[CS_FG_RUN_NUMBER] = runs[0][RS_RUN_NUMBER];
+		row[CS_BG_RUN_NUMBER] = runs[1][RS_RUN_NUMBER];
+		cross.AddRow( row );
+		for ( int j = 0; j < 2; ++j )
+		{
+			summary.AddRow( runs[j] );
+			truth.AddRow( truths[j] );
+		}
+	}
+
+	TString filename_summary = pipeline::DataPath( dirname,
+			"Run_Summary.csv" );
+	summary.Save( filename_summary );
+	TString filename_cross = pipeline::DataPath( dirname,
+			"Cross_Sections.csv" );
+	cross.Save( filename_cross );
+	TString filename_truth = pipeline::DataPath( dirname,
+			"Synthetic_Truth.csv" );
+	truth.Save( filename_truth );
+}
+
+} // namespace synthetic
+} // namespace n2n
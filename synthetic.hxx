@@ -0,0 +1,58 @@
+/** 
+ * @file n2n/synthetic.hxx
+ * Copyright (C) 2013 Houghton College
+ */
+
+#ifndef N2N_SYNTHETIC_INCL_
+#define N2N_SYNTHETIC_INCL_
+
+namespace n2n {
+namespace synthetic {
+
+/**
+ * Synthetic_Truth.csv column names
+ */
+enum STFields {
+	ST_RUN_NUMBER,		///< Run number
+	ST_BG_RUN_NUMBER,	///< Background run, for foreground runs only
+	ST_PROTONS,		///< Protons in the region of interest (counts)
+	ST_PUCK_N0,		///< @f$N_0@f$ of the puck decay curve (counts/min)
+	ST_PUCK_A,		///< @f$A@f$ of the puck decay curve (counts/min)
+	ST_PLASTIC_N0,		///< @f$N_0@f$ of the plastic decay curve (counts/min)
+	ST_PLASTIC_A,		///< @f$A@f$ of the plastic decay curve (counts/min)
+	ST_CH2_XSECT,		///< (n,2n) cross section in CH2 (mbarn)
+	ST_C12_XSECT,		///< (n,2n) cross section in C12 (mbarn)
+	ST_NUM_COLUMNS
+};
+
+/**
+ * Generate a complete synthetic data set: Run_Summary.csv, 
+ * Cross_Sections.csv, and a decay curve, proton spectrum and .mpa header
+ * for each run, laid out like the real data.
+ *
+ * Runs come in foreground/background pairs, each with one row of 
+ * Cross_Sections.csv. Every quantity is drawn from a known truth: the 
+ * proton spectra have a fixed number of counts in the region of interest,
+ * and the number of C11 nuclei behind each decay curve is calculated from
+ * a chosen (n,2n) cross section with the same formulas as 
+ * CrossSection::Calculate, so the analysis should recover it within its
+ * uncertainty. The truth is written to Synthetic_Truth.csv, indexed by
+ * STFields.
+ *
+ * @param dirname The directory to create the data set in.
+ * @param num_runs The number of runs; rounded up to an even number.
+ * @param seed The random number seed.
+ */
+void Generate( char const * dirname, int num_runs, UInt_t seed = 1 );
+
+/**
+ * The (n,2n) cross section used by Generate.
+ * @param energy The neutron energy (MeV).
+ * @return The cross section (mbarn).
+ */
+double TrueCrossSection( double energy );
+
+} // namespace synthetic
+} // namespace n2n
+
+#endif